@@ -0,0 +1,245 @@
+//
+//  AudioDecoder.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "AudioDecoder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <AudioToolbox/AudioToolbox.h>
+
+#include "PublicUtility/CADebugMacros.h"
+#endif
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // Frames per read: large enough that per-call overhead doesn't show, small enough that
+    // the conversion scratch stays in cache.
+    const size_t decodeChunkFrames = 65536;
+    
+    // Room in the arena for the file as decoded and, when its rate isn't the target's, for the
+    // resampled copy straight after it.
+    int16_t* reserveDecode(PcmArena& arena, const Resampler& resampler, size_t fileFrames, unsigned int channels)
+    {
+        size_t resampledFrames = resampler.getUpFactor() != resampler.getDownFactor() ? resampler.getOutputFrames(fileFrames) : 0;
+        return arena.reserve((fileFrames + resampledFrames) * channels);
+    }
+    
+    void finishDecode(const Resampler& resampler, int16_t* samples, size_t framesRead, const AudioFormat& format, DecodedAudio& audio)
+    {
+        audio.samples = samples;
+        audio.numFrames = framesRead;
+        if (resampler.getUpFactor() != resampler.getDownFactor()) {
+            int16_t* resampled = samples + framesRead * format.channels;
+            resampler.process(samples, framesRead, format.channels, resampled);
+            audio.samples = resampled;
+            audio.numFrames = resampler.getOutputFrames(framesRead);
+        }
+        audio.channels = format.channels;
+        audio.sampleRate = format.sampleRate;
+    }
+}
+
+PcmArena::PcmArena() : capacity(0)
+{
+}
+
+int16_t* PcmArena::reserve(size_t numSamples)
+{
+    if (numSamples > capacity) {
+        // No need to copy: callers never expect earlier contents back.
+        samples.reset();
+        samples.reset(new int16_t[numSamples]);
+        capacity = numSamples;
+    }
+    return samples.get();
+}
+
+void PcmArena::release()
+{
+    samples.reset();
+    capacity = 0;
+}
+
+size_t PcmArena::getCapacityBytes() const
+{
+    return capacity * sizeof(int16_t);
+}
+
+size_t DecodedAudio::getSizeBytes() const
+{
+    return numFrames * channels * sizeof(int16_t);
+}
+
+#if defined(__APPLE__)
+
+bool OpenGLApp::decodeAudioFile(const std::string& path, PcmArena& arena, DecodedAudio& audio, const AudioFormat& format, ResamplerQuality quality)
+{
+    OSStatus err = noErr;
+    ExtAudioFileRef extAudioFile = NULL;
+    AudioStreamBasicDescription fileFormat;
+    CAStreamBasicDescription clientFormat;
+    unsigned int channels = format.channels;
+    SInt64 fileLengthFrames = 0;
+    UInt32 propSize;
+    int16_t* samples = NULL;
+    size_t totalFramesRead = 0;
+    
+    CFURLRef fileUrl = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (const UInt8*)path.c_str(), path.length(), false);
+    err = ExtAudioFileOpenURL(fileUrl, &extAudioFile);
+    CFRelease(fileUrl);
+    if (err != noErr) {
+        std::cerr << "Couldn't open " << path << " for reading (" << (long)err << ")" << std::endl;
+        return false;
+    }
+    
+    propSize = sizeof(fileFormat);
+    FailIf((err = ExtAudioFileGetProperty(extAudioFile, kExtAudioFileProperty_FileDataFormat, &propSize, &fileFormat)), fail, "ExtAudioFileGetProperty: kExtAudioFileProperty_FileDataFormat");
+    
+    // The pipeline format, but at the file's own rate: ExtAudioFile's converter would otherwise
+    // resample behind our back, with a quality and cost we don't choose.
+    clientFormat = AudioFormat(fileFormat.mSampleRate, channels).getStreamDescription();
+    FailIf((err = ExtAudioFileSetProperty(extAudioFile, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat)), fail, "ExtAudioFileSetProperty: kExtAudioFileProperty_ClientDataFormat");
+    
+    propSize = sizeof(fileLengthFrames);
+    FailIf((err = ExtAudioFileGetProperty(extAudioFile, kExtAudioFileProperty_FileLengthFrames, &propSize, &fileLengthFrames)), fail, "ExtAudioFileGetProperty: kExtAudioFileProperty_FileLengthFrames");
+    
+    // Exactly one frame count's worth of samples, read straight into place a chunk at a time.
+    // Scoped so the FailIf jumps above don't cross the resampler's construction.
+    {
+        Resampler resampler(fileFormat.mSampleRate, format.sampleRate, quality);
+        samples = reserveDecode(arena, resampler, (size_t)fileLengthFrames, channels);
+        while (totalFramesRead < (size_t)fileLengthFrames) {
+            AudioBufferList bufferList;
+            UInt32 framesRead = (UInt32)min(decodeChunkFrames, (size_t)fileLengthFrames - totalFramesRead);
+            bufferList.mNumberBuffers = 1;
+            bufferList.mBuffers[0].mNumberChannels = channels;
+            bufferList.mBuffers[0].mDataByteSize = framesRead * clientFormat.mBytesPerFrame;
+            bufferList.mBuffers[0].mData = samples + totalFramesRead * channels;
+            FailIf((err = ExtAudioFileRead(extAudioFile, &framesRead, &bufferList)), fail, "ExtAudioFileRead");
+            if (framesRead == 0) {
+                // Compressed formats only estimate their length; stop at the real end.
+                break;
+            }
+            totalFramesRead += framesRead;
+        }
+        
+        ExtAudioFileDispose(extAudioFile);
+        finishDecode(resampler, samples, totalFramesRead, format, audio);
+        return true;
+    }
+    
+fail:
+    ExtAudioFileDispose(extAudioFile);
+    std::cerr << "Couldn't decode " << path << " (" << (long)err << ")" << std::endl;
+    return false;
+}
+
+#else
+
+namespace {
+    uint32_t readLittleEndian(const unsigned char* bytes, int numBytes)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < numBytes; ++i) {
+            value |= (uint32_t)bytes[i] << (8 * i);
+        }
+        return value;
+    }
+}
+
+bool OpenGLApp::decodeAudioFile(const std::string& path, PcmArena& arena, DecodedAudio& audio, const AudioFormat& format, ResamplerQuality quality)
+{
+    unsigned int channels = format.channels;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        std::cerr << "Couldn't open " << path << " for reading" << std::endl;
+        return false;
+    }
+    
+    unsigned char header[12];
+    unsigned int fileChannels = 0;
+    unsigned int sampleRate = 0;
+    unsigned int bitsPerSample = 0;
+    uint32_t dataBytes = 0;
+    bool foundData = false;
+    
+    if (fread(header, 1, sizeof(header), fp) == sizeof(header) && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0) {
+        // Walk the chunks up to the sample data, picking up the format on the way.
+        unsigned char chunk[8];
+        while (!foundData && fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk)) {
+            uint32_t chunkBytes = readLittleEndian(chunk + 4, 4);
+            if (memcmp(chunk, "fmt ", 4) == 0 && chunkBytes >= 16) {
+                unsigned char fmtChunk[16];
+                if (fread(fmtChunk, 1, sizeof(fmtChunk), fp) != sizeof(fmtChunk) || readLittleEndian(fmtChunk, 2) != 1) {
+                    break;
+                }
+                fileChannels = readLittleEndian(fmtChunk + 2, 2);
+                sampleRate = readLittleEndian(fmtChunk + 4, 4);
+                bitsPerSample = readLittleEndian(fmtChunk + 14, 2);
+                fseek(fp, (long)(chunkBytes - sizeof(fmtChunk) + (chunkBytes & 1)), SEEK_CUR);
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                dataBytes = chunkBytes;
+                foundData = true;
+            } else {
+                fseek(fp, (long)(chunkBytes + (chunkBytes & 1)), SEEK_CUR);
+            }
+        }
+    }
+    
+    if (!foundData || bitsPerSample != 16 || (fileChannels != 1 && fileChannels != 2)) {
+        fclose(fp);
+        std::cerr << "Couldn't decode " << path << ": not a 16-bit PCM WAV file" << std::endl;
+        return false;
+    }
+    
+    size_t numFrames = dataBytes / (fileChannels * sizeof(int16_t));
+    Resampler resampler(sampleRate, format.sampleRate, quality);
+    int16_t* samples = reserveDecode(arena, resampler, numFrames, channels);
+    size_t totalFramesRead = 0;
+    
+    if (fileChannels == channels) {
+        while (totalFramesRead < numFrames) {
+            size_t framesRead = fread(samples + totalFramesRead * channels, channels * sizeof(int16_t),
+                                      min(decodeChunkFrames, numFrames - totalFramesRead), fp);
+            if (framesRead == 0) {
+                break;
+            }
+            totalFramesRead += framesRead;
+        }
+    } else {
+        vector<int16_t> chunk(decodeChunkFrames * fileChannels);
+        while (totalFramesRead < numFrames) {
+            size_t framesRead = fread(chunk.data(), fileChannels * sizeof(int16_t), min(decodeChunkFrames, numFrames - totalFramesRead), fp);
+            if (framesRead == 0) {
+                break;
+            }
+            int16_t* out = samples + totalFramesRead * channels;
+            for (size_t i = 0; i < framesRead; ++i) {
+                if (channels == 1) {
+                    out[i] = (int16_t)(((int)chunk[2 * i] + chunk[2 * i + 1]) / 2);
+                } else {
+                    out[2 * i] = out[2 * i + 1] = chunk[i];
+                }
+            }
+            totalFramesRead += framesRead;
+        }
+    }
+    fclose(fp);
+    
+    finishDecode(resampler, samples, totalFramesRead, format, audio);
+    return true;
+}
+
+#endif
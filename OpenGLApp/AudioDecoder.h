@@ -0,0 +1,60 @@
+//
+//  AudioDecoder.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__AudioDecoder__
+#define __OpenGLApp__AudioDecoder__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "AudioFormat.h"
+#include "Resampler.h"
+
+namespace OpenGLApp {
+    
+    // Scratch memory for decoded PCM. It grows to fit the largest file decoded into it and
+    // is then reused, so loading a batch of files costs one allocation rather than one per
+    // file. Call release() once the batch has been uploaded.
+    class PcmArena
+    {
+    public:
+        PcmArena();
+        
+        // At least numSamples samples; earlier contents are not kept.
+        int16_t* reserve(size_t numSamples);
+        void release();
+        
+        size_t getCapacityBytes() const;
+    private:
+        std::unique_ptr<int16_t[]> samples;
+        size_t capacity;
+    };
+    
+    // A decoded file, interleaved signed 16-bit PCM. samples points into the arena it was
+    // decoded into and is only valid until that arena is next used or released.
+    struct DecodedAudio
+    {
+        const int16_t* samples = nullptr;
+        size_t numFrames = 0;
+        unsigned int channels = 0;
+        double sampleRate = 0;
+        
+        size_t getSizeBytes() const;
+    };
+    
+    // Decodes a whole file into format. Uses ExtAudioFile (so anything Core Audio reads) on
+    // OS X and reads 16-bit PCM WAV elsewhere, either way only for decoding and channel
+    // mapping: a file at another rate goes through the Resampler at the given quality, once,
+    // here. Reports the problem on stderr and returns false if the file can't be read.
+    bool decodeAudioFile(const std::string& path, PcmArena& arena, DecodedAudio& audio, const AudioFormat& format,
+                         ResamplerQuality quality = ResamplerQuality::Medium);
+}
+
+#endif /* defined(__OpenGLApp__AudioDecoder__) */
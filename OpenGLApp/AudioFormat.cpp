@@ -0,0 +1,50 @@
+//
+//  AudioFormat.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "AudioFormat.h"
+
+#include <cstdint>
+
+using namespace std;
+using namespace OpenGLApp;
+
+// Plenty for General MIDI instruments, and a quarter of the memory of 44.1 kHz stereo.
+const double AudioFormat::defaultSampleRate = 16000.0;
+
+AudioFormat::AudioFormat(double sampleRate, unsigned int channels) : sampleRate(sampleRate), channels(channels)
+{
+}
+
+size_t AudioFormat::getBytesPerFrame() const
+{
+    return channels * sizeof(int16_t);
+}
+
+bool AudioFormat::isValid() const
+{
+    return sampleRate >= 1000.0 && sampleRate <= 192000.0 && (channels == 1 || channels == 2);
+}
+
+bool AudioFormat::operator==(const AudioFormat& other) const
+{
+    return sampleRate == other.sampleRate && channels == other.channels;
+}
+
+bool AudioFormat::operator!=(const AudioFormat& other) const
+{
+    return !(*this == other);
+}
+
+#if defined(__APPLE__)
+
+CAStreamBasicDescription AudioFormat::getStreamDescription() const
+{
+    return CAStreamBasicDescription(sampleRate, channels, CAStreamBasicDescription::kPCMFormatInt16, true);
+}
+
+#endif
@@ -0,0 +1,46 @@
+//
+//  AudioFormat.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__AudioFormat__
+#define __OpenGLApp__AudioFormat__
+
+#include <cstddef>
+
+#if defined(__APPLE__)
+#include "PublicUtility/CAStreamBasicDescription.h"
+#endif
+
+namespace OpenGLApp {
+    
+    // The one sample format audio is kept in between rendering and playback: interleaved,
+    // packed, signed 16-bit PCM at sampleRate with one or two channels. The synths render
+    // straight into it, decoded files are brought into it once on load, and the OpenAL
+    // context is created to mix at the same rate, so nothing on the way converts a track.
+    struct AudioFormat
+    {
+        static const double defaultSampleRate;
+        
+        double sampleRate;
+        unsigned int channels;
+        
+        AudioFormat(double sampleRate = defaultSampleRate, unsigned int channels = 1);
+        
+        size_t getBytesPerFrame() const;
+        bool isValid() const;
+        
+        bool operator==(const AudioFormat& other) const;
+        bool operator!=(const AudioFormat& other) const;
+
+#if defined(__APPLE__)
+        // The same format as Core Audio describes it, for ExtAudioFile client formats and the like.
+        CAStreamBasicDescription getStreamDescription() const;
+#endif
+    };
+}
+
+#endif /* defined(__OpenGLApp__AudioFormat__) */
@@ -0,0 +1,204 @@
+//
+//  AudioState.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "AudioState.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace OpenGLApp;
+
+AudioState::AudioState() :
+    listenerPositionDirty(false), listenerOrientationDirty(false), deferUpdates(NULL), processUpdates(NULL), callsThisFrame(0)
+{
+    // OpenAL's defaults, which the cache starts out agreeing with.
+    fill(listenerPosition, listenerPosition + 3, 0.0f);
+    const float defaultOrientation[6] = { 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f };
+    copy(defaultOrientation, defaultOrientation + 6, listenerOrientation);
+    
+    if (alIsExtensionPresent("AL_SOFT_deferred_updates")) {
+        deferUpdates = (DeferUpdatesFunction)alGetProcAddress("alDeferUpdatesSOFT");
+        processUpdates = (DeferUpdatesFunction)alGetProcAddress("alProcessUpdatesSOFT");
+        if (!deferUpdates || !processUpdates) {
+            deferUpdates = processUpdates = NULL;
+        }
+    }
+    
+    stats.frames = 0;
+    stats.totalCalls = 0;
+    stats.callsLastFrame = 0;
+    stats.maxCallsPerFrame = 0;
+}
+
+void AudioState::setListenerPosition(float x, float y, float z)
+{
+    if (listenerPosition[0] != x || listenerPosition[1] != y || listenerPosition[2] != z) {
+        listenerPosition[0] = x;
+        listenerPosition[1] = y;
+        listenerPosition[2] = z;
+        listenerPositionDirty = true;
+    }
+}
+
+void AudioState::setListenerOrientation(const float at[3], const float up[3])
+{
+    float orientation[6] = { at[0], at[1], at[2], up[0], up[1], up[2] };
+    if (!equal(orientation, orientation + 6, listenerOrientation)) {
+        copy(orientation, orientation + 6, listenerOrientation);
+        listenerOrientationDirty = true;
+    }
+}
+
+void AudioState::setSourcePosition(ALuint source, float x, float y, float z)
+{
+    SourceState& state = getSource(source);
+    if (state.position[0] != x || state.position[1] != y || state.position[2] != z) {
+        markDirty(source, state);
+        state.position[0] = x;
+        state.position[1] = y;
+        state.position[2] = z;
+        state.positionDirty = true;
+    }
+}
+
+void AudioState::setSourceGain(ALuint source, float gain)
+{
+    SourceState& state = getSource(source);
+    if (state.gain != gain) {
+        markDirty(source, state);
+        state.gain = gain;
+        state.gainDirty = true;
+    }
+}
+
+void AudioState::playSources(const vector<ALuint>& sources)
+{
+    if (sources.empty()) {
+        return;
+    }
+    alSourcePlayv((ALsizei)sources.size(), sources.data());
+    ++callsThisFrame;
+    for (ALuint source : sources) {
+        getSource(source).state = AL_PLAYING;
+    }
+}
+
+void AudioState::pauseSources(const vector<ALuint>& sources)
+{
+    if (sources.empty()) {
+        return;
+    }
+    alSourcePausev((ALsizei)sources.size(), sources.data());
+    ++callsThisFrame;
+    for (ALuint source : sources) {
+        SourceState& state = getSource(source);
+        // Pausing a source that never started leaves it where it was.
+        if (state.state == AL_PLAYING) {
+            state.state = AL_PAUSED;
+        }
+    }
+}
+
+void AudioState::setSampleOffsets(const vector<ALuint>& sources, ALint offset)
+{
+    for (ALuint source : sources) {
+        alSourcei(source, AL_SAMPLE_OFFSET, offset);
+    }
+    callsThisFrame += sources.size();
+}
+
+ALint AudioState::getSampleOffset(ALuint source)
+{
+    ALint offset = 0;
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+    ++callsThisFrame;
+    return offset;
+}
+
+ALint AudioState::getSourceState(ALuint source) const
+{
+    auto it = sourceStates.find(source);
+    return it == sourceStates.end() ? AL_INITIAL : it->second.state;
+}
+
+void AudioState::flush()
+{
+    bool dirty = listenerPositionDirty || listenerOrientationDirty || !dirtySources.empty();
+    if (dirty && deferUpdates) {
+        deferUpdates();
+        ++callsThisFrame;
+    }
+    
+    if (listenerPositionDirty) {
+        alListenerfv(AL_POSITION, listenerPosition);
+        ++callsThisFrame;
+        listenerPositionDirty = false;
+    }
+    if (listenerOrientationDirty) {
+        alListenerfv(AL_ORIENTATION, listenerOrientation);
+        ++callsThisFrame;
+        listenerOrientationDirty = false;
+    }
+    for (ALuint source : dirtySources) {
+        SourceState& state = sourceStates[source];
+        if (state.positionDirty) {
+            alSourcefv(source, AL_POSITION, state.position);
+            ++callsThisFrame;
+            state.positionDirty = false;
+        }
+        if (state.gainDirty) {
+            alSourcef(source, AL_GAIN, state.gain);
+            ++callsThisFrame;
+            state.gainDirty = false;
+        }
+    }
+    dirtySources.clear();
+    
+    if (dirty && processUpdates) {
+        processUpdates();
+        ++callsThisFrame;
+    }
+}
+
+void AudioState::endFrame()
+{
+    ++stats.frames;
+    stats.totalCalls += callsThisFrame;
+    stats.callsLastFrame = callsThisFrame;
+    stats.maxCallsPerFrame = max(stats.maxCallsPerFrame, callsThisFrame);
+    callsThisFrame = 0;
+}
+
+bool AudioState::hasDeferredUpdates() const
+{
+    return deferUpdates != NULL;
+}
+
+AudioState::Stats AudioState::getStats() const
+{
+    return stats;
+}
+
+AudioState::SourceState& AudioState::getSource(ALuint source)
+{
+    auto it = sourceStates.find(source);
+    if (it == sourceStates.end()) {
+        // OpenAL's defaults for a new source.
+        SourceState state = { { 0.0f, 0.0f, 0.0f }, 1.0f, AL_INITIAL, false, false };
+        it = sourceStates.insert(make_pair(source, state)).first;
+    }
+    return it->second;
+}
+
+void AudioState::markDirty(ALuint source, const SourceState& state)
+{
+    // Queued once, however many of its values change before the flush.
+    if (!state.positionDirty && !state.gainDirty) {
+        dirtySources.push_back(source);
+    }
+}
@@ -0,0 +1,98 @@
+//
+//  AudioState.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__AudioState__
+#define __OpenGLApp__AudioState__
+
+#include <OpenAL/al.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace OpenGLApp {
+    
+    // What the render thread has told OpenAL, kept on this side of the driver. Setters only
+    // record the new value and mark it dirty when it actually changed; flush(), once a frame,
+    // sends whatever is dirty as one batch, deferred with AL_SOFT_deferred_updates where the
+    // implementation has it so the mixer applies it all at once. Source states are tracked as
+    // the sources are played and paused here, so nothing ever has to be polled.
+    //
+    // Every OpenAL call made through it is counted, per frame and in total. Calls made by
+    // other threads (StemStreamer, MixerOutput) are theirs and not counted.
+    class AudioState
+    {
+    public:
+        struct Stats
+        {
+            uint64_t frames;
+            uint64_t totalCalls;
+            uint64_t callsLastFrame;
+            uint64_t maxCallsPerFrame;
+        };
+        
+        // Needs the OpenAL context to be current.
+        AudioState();
+        
+        void setListenerPosition(float x, float y, float z);
+        void setListenerOrientation(const float at[3], const float up[3]);
+        
+        void setSourcePosition(ALuint source, float x, float y, float z);
+        void setSourceGain(ALuint source, float gain);
+        
+        // Batched transport changes: these go straight through, since they must land together.
+        void playSources(const std::vector<ALuint>& sources);
+        void pauseSources(const std::vector<ALuint>& sources);
+        void setSampleOffsets(const std::vector<ALuint>& sources, ALint offset);
+        ALint getSampleOffset(ALuint source);
+        
+        // AL_PLAYING, AL_PAUSED or AL_INITIAL, as last set through playSources()/pauseSources().
+        ALint getSourceState(ALuint source) const;
+        
+        // Sends every change since the last flush. Once a frame, and before starting sources
+        // whose positions have just been set.
+        void flush();
+        
+        // Closes the frame's call count.
+        void endFrame();
+        
+        bool hasDeferredUpdates() const;
+        Stats getStats() const;
+    private:
+        struct SourceState
+        {
+            float position[3];
+            float gain;
+            ALint state;
+            bool positionDirty;
+            bool gainDirty;
+        };
+        
+        typedef void (*DeferUpdatesFunction)();
+        
+        float listenerPosition[3];
+        float listenerOrientation[6];
+        bool listenerPositionDirty;
+        bool listenerOrientationDirty;
+        std::map<ALuint, SourceState> sourceStates;
+        std::vector<ALuint> dirtySources;
+        
+        DeferUpdatesFunction deferUpdates;
+        DeferUpdatesFunction processUpdates;
+        
+        uint64_t callsThisFrame;
+        Stats stats;
+        
+        SourceState& getSource(ALuint source);
+        // Call before setting one of state's dirty flags.
+        void markDirty(ALuint source, const SourceState& state);
+    };
+}
+
+#endif /* defined(__OpenGLApp__AudioState__) */
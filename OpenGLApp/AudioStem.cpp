@@ -0,0 +1,198 @@
+//
+//  AudioStem.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "AudioStem.h"
+#include "WavFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    const double mergeGapSeconds = 0.5;
+    
+    // Frames quantised at a time, so the scratch fits on the stack.
+    const size_t appendChunkFrames = 256;
+}
+
+void AudioStem::clear()
+{
+    lengthFrames = 0;
+    segments.clear();
+    samples.clear();
+}
+
+AudioFormat AudioStem::getFormat() const
+{
+    return AudioFormat(sampleRate, channels);
+}
+
+uint64_t AudioStem::getNumFrames() const
+{
+    return lengthFrames;
+}
+
+double AudioStem::getDurationSeconds() const
+{
+    return sampleRate > 0 ? lengthFrames / sampleRate : 0.0;
+}
+
+size_t AudioStem::getStoredFrames() const
+{
+    return channels > 0 ? samples.size() / channels : 0;
+}
+
+size_t AudioStem::getSizeBytes() const
+{
+    return samples.size() * sizeof(int16_t);
+}
+
+void AudioStem::appendSilence(uint64_t numFrames)
+{
+    lengthFrames += numFrames;
+}
+
+void AudioStem::appendAudible(const int16_t* data, size_t numFrames)
+{
+    uint64_t mergeGapFrames = (uint64_t)(mergeGapSeconds * sampleRate);
+    
+    if (!segments.empty() && lengthFrames - (segments.back().startFrame + segments.back().numFrames) <= mergeGapFrames) {
+        // Close a short gap with stored zeros instead of starting a new segment.
+        Segment& last = segments.back();
+        size_t gap = (size_t)(lengthFrames - (last.startFrame + last.numFrames));
+        samples.insert(samples.end(), gap * channels, 0);
+        last.numFrames += gap;
+    } else {
+        Segment segment = { lengthFrames, 0, samples.size() };
+        segments.push_back(segment);
+    }
+    
+    samples.insert(samples.end(), data, data + numFrames * channels);
+    segments.back().numFrames += numFrames;
+    lengthFrames += numFrames;
+}
+
+void AudioStem::appendStereo(const float* left, const float* right, size_t numFrames)
+{
+    float chunk[appendChunkFrames * 2];
+    
+    for (size_t done = 0; done < numFrames; done += appendChunkFrames) {
+        size_t n = min(appendChunkFrames, numFrames - done);
+        if (channels == 1) {
+            for (size_t i = 0; i < n; ++i) {
+                chunk[i] = 0.5f * (left[done + i] + right[done + i]);
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                chunk[i * 2] = left[done + i];
+                chunk[i * 2 + 1] = right[done + i];
+            }
+        }
+        appendInterleaved(chunk, n);
+    }
+}
+        
+void AudioStem::appendMono(const float* mono, size_t numFrames)
+{
+    if (channels != 1) {
+        throw logic_error("appendMono() needs a mono stem");
+    }
+    for (size_t done = 0; done < numFrames; done += appendChunkFrames) {
+        appendInterleaved(mono + done, min(appendChunkFrames, numFrames - done));
+    }
+}
+        
+void AudioStem::appendInterleaved(const float* data, size_t numFrames)
+{
+    int16_t quantised[appendChunkFrames * 2];
+    size_t count = numFrames * channels;
+    floatToInt16(data, quantised, count);
+    
+    bool silent = true;
+    for (size_t i = 0; i < count && silent; ++i) {
+        silent = quantised[i] == 0;
+    }
+    if (silent) {
+        appendSilence(numFrames);
+    } else {
+        appendAudible(quantised, numFrames);
+    }
+}
+
+void AudioStem::copyFrames(uint64_t startFrame, size_t numFrames, int16_t* out) const
+{
+    memset(out, 0, numFrames * channels * sizeof(int16_t));
+    
+    uint64_t endFrame = startFrame + numFrames;
+    
+    // First segment that ends after startFrame.
+    auto it = upper_bound(segments.begin(), segments.end(), startFrame, [](uint64_t frame, const Segment& s) {
+        return frame < s.startFrame + s.numFrames;
+    });
+    
+    for (; it != segments.end() && it->startFrame < endFrame; ++it) {
+        uint64_t from = max(startFrame, it->startFrame);
+        uint64_t to = min(endFrame, it->startFrame + it->numFrames);
+        memcpy(out + (from - startFrame) * channels,
+               samples.data() + it->sampleOffset + (from - it->startFrame) * channels,
+               (size_t)(to - from) * channels * sizeof(int16_t));
+    }
+}
+
+bool AudioStem::hasAudibleFrames(uint64_t startFrame, size_t numFrames) const
+{
+    auto it = upper_bound(segments.begin(), segments.end(), startFrame, [](uint64_t frame, const Segment& s) {
+        return frame < s.startFrame + s.numFrames;
+    });
+    return it != segments.end() && it->startFrame < startFrame + numFrames;
+}
+
+void AudioStem::copyLoopFrames(uint64_t loopFrames, uint64_t startFrame, size_t numFrames, int16_t* out) const
+{
+    int16_t overlap[appendChunkFrames * 2];
+    for (size_t done = 0; done < numFrames; ) {
+        uint64_t position = (startFrame + done) % loopFrames;
+        size_t count = (size_t)min((uint64_t)(numFrames - done), loopFrames - position);
+        int16_t* pass = out + done * channels;
+        copyFrames(position, count, pass);
+        
+        // Later passes over the same span of the loop, mixed in with clipping.
+        for (uint64_t later = position + loopFrames; later < lengthFrames; later += loopFrames) {
+            for (size_t i = 0; i < count; i += appendChunkFrames) {
+                size_t n = min(appendChunkFrames, count - i);
+                if (!hasAudibleFrames(later + i, n)) {
+                    continue;
+                }
+                copyFrames(later + i, n, overlap);
+                for (size_t j = 0; j < n * channels; ++j) {
+                    int sum = pass[i * channels + j] + overlap[j];
+                    pass[i * channels + j] = (int16_t)min(max(sum, -32768), 32767);
+                }
+            }
+        }
+        done += count;
+    }
+}
+
+bool AudioStem::hasAudibleLoopFrames(uint64_t loopFrames, uint64_t startFrame, size_t numFrames) const
+{
+    for (size_t done = 0; done < numFrames; ) {
+        uint64_t position = (startFrame + done) % loopFrames;
+        size_t count = (size_t)min((uint64_t)(numFrames - done), loopFrames - position);
+        for (uint64_t pass = position; pass < lengthFrames; pass += loopFrames) {
+            if (hasAudibleFrames(pass, count)) {
+                return true;
+            }
+        }
+        done += count;
+    }
+    return false;
+}
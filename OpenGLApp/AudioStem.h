@@ -0,0 +1,78 @@
+//
+//  AudioStem.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__AudioStem__
+#define __OpenGLApp__AudioStem__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AudioFormat.h"
+
+namespace OpenGLApp {
+    
+    // The rendered audio of one track, held in memory as interleaved signed 16-bit PCM:
+    // the layout alBufferData takes as AL_FORMAT_MONO16 / AL_FORMAT_STEREO16.
+    //
+    // Only the audible parts are stored. Each segment is a span of the track with its samples
+    // back to back in `samples`; everything between segments is digital silence. Gaps shorter
+    // than half a second are filled in rather than split, so segments stay reasonably long.
+    struct AudioStem
+    {
+        struct Segment
+        {
+            uint64_t startFrame;
+            size_t numFrames;
+            size_t sampleOffset;
+        };
+        
+        double sampleRate = 0;
+        unsigned int channels = 1;
+        uint64_t lengthFrames = 0;
+        std::vector<Segment> segments;
+        std::vector<int16_t> samples;
+        
+        void clear();
+        
+        AudioFormat getFormat() const;
+        
+        // Length of the track, silence included.
+        uint64_t getNumFrames() const;
+        double getDurationSeconds() const;
+        
+        // What is actually held in memory.
+        size_t getStoredFrames() const;
+        size_t getSizeBytes() const;
+        
+        // Appends a block of float stereo, downmixing it when the stem is mono. Blocks that
+        // quantise to silence only extend the length.
+        void appendStereo(const float* left, const float* right, size_t numFrames);
+        
+        // Appends a block rendered in mono straight into a mono stem.
+        void appendMono(const float* mono, size_t numFrames);
+        void appendSilence(uint64_t numFrames);
+        
+        // Copies frames [startFrame, startFrame + numFrames) to out, writing zeros between segments.
+        void copyFrames(uint64_t startFrame, size_t numFrames, int16_t* out) const;
+        
+        // Whether any segment overlaps frames [startFrame, startFrame + numFrames).
+        bool hasAudibleFrames(uint64_t startFrame, size_t numFrames) const;
+        
+        // The same, for the stem repeating every loopFrames frames: reads wrap at the loop point,
+        // a shorter stem is silent up to it, and whatever a longer one holds past it (release
+        // tails) rings on over the start of the next pass. startFrame may be anywhere.
+        void copyLoopFrames(uint64_t loopFrames, uint64_t startFrame, size_t numFrames, int16_t* out) const;
+        bool hasAudibleLoopFrames(uint64_t loopFrames, uint64_t startFrame, size_t numFrames) const;
+    private:
+        void appendAudible(const int16_t* data, size_t numFrames);
+        void appendInterleaved(const float* data, size_t numFrames);
+    };
+}
+
+#endif /* defined(__OpenGLApp__AudioStem__) */
@@ -0,0 +1,955 @@
+//
+//  Benchmarks.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "Benchmarks.h"
+#include "AudioDecoder.h"
+#include "MeshData.h"
+#include "TempoMap.h"
+#include "MidiProcessor.h"
+#include "RenderCache.h"
+#include "Resampler.h"
+#include "SpatialMixer.h"
+#include "SpscRing.h"
+#include "VertexLayout.h"
+#include "WavetableSynth.h"
+
+#include <jdksmidi/world.h>
+#include <jdksmidi/track.h>
+#include <jdksmidi/multitrack.h>
+#include <jdksmidi/filereadmultitrack.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    typedef chrono::steady_clock Clock;
+    
+    double secondsSince(Clock::time_point start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+    
+    size_t getPeakResidentBytes()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+    }
+    
+    size_t getCurrentResidentBytes()
+    {
+#if defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+            return 0;
+        }
+        return (size_t)info.resident_size;
+#else
+        unsigned long size = 0, resident = 0;
+        FILE* fp = fopen("/proc/self/statm", "r");
+        if (fp) {
+            if (fscanf(fp, "%lu %lu", &size, &resident) != 2) {
+                resident = 0;
+            }
+            fclose(fp);
+        }
+        return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+    
+    // The lookup splitTracks used to do: walk the tempo list from the start for every query.
+    uint64_t linearTickToMicroseconds(const TempoMap& map, uint64_t tick)
+    {
+        size_t i = 0;
+        while (i + 1 < map.getNumSegments() && map.getSegment(i + 1).startTick <= tick) {
+            ++i;
+        }
+        const TempoMap::Segment& s = map.getSegment(i);
+        return s.startMicroseconds + ((tick - s.startTick) * s.microsecondsPerBeat) / map.getTicksPerBeat();
+    }
+    
+    void benchmarkTempoLookups(const char* label, const TempoMap& map, const vector<vector<uint64_t>>& trackTicks)
+    {
+        size_t numLookups = 0;
+        for (auto& ticks : trackTicks) {
+            numLookups += ticks.size();
+        }
+        if (numLookups == 0) {
+            printf("%s: no events\n", label);
+            return;
+        }
+        
+        uint64_t linearSum = 0, searchSum = 0, cursorSum = 0;
+        
+        auto start = Clock::now();
+        for (auto& ticks : trackTicks) {
+            for (auto tick : ticks) {
+                linearSum += linearTickToMicroseconds(map, tick);
+            }
+        }
+        double linearTime = secondsSince(start);
+        
+        start = Clock::now();
+        for (auto& ticks : trackTicks) {
+            for (auto tick : ticks) {
+                searchSum += map.tickToMicroseconds(tick);
+            }
+        }
+        double searchTime = secondsSince(start);
+        
+        start = Clock::now();
+        for (auto& ticks : trackTicks) {
+            TempoMap::Cursor cursor(map);
+            for (auto tick : ticks) {
+                cursorSum += cursor.tickToMicroseconds(tick);
+            }
+        }
+        double cursorTime = secondsSince(start);
+        
+        printf("%s: %zu tracks, %zu tempo segments, %zu lookups\n", label, trackTicks.size(), map.getNumSegments(), numLookups);
+        printf("  linear scan    %10.2f ns/lookup\n", linearTime * 1e9 / numLookups);
+        printf("  binary search  %10.2f ns/lookup\n", searchTime * 1e9 / numLookups);
+        printf("  merge cursor   %10.2f ns/lookup\n", cursorTime * 1e9 / numLookups);
+        if (linearSum != searchSum || searchSum != cursorSum) {
+            printf("  MISMATCH: lookups disagree (%llu / %llu / %llu)\n",
+                   (unsigned long long)linearSum, (unsigned long long)searchSum, (unsigned long long)cursorSum);
+        }
+    }
+    
+    bool loadMultiTrack(const char* path, jdksmidi::MIDIMultiTrack& tracks)
+    {
+        jdksmidi::MIDIFileReadStreamFile stream(path);
+        if (!stream.IsValid()) {
+            return false;
+        }
+        jdksmidi::MIDIFileReadMultiTrack loader(&tracks);
+        jdksmidi::MIDIFileRead reader(&stream, &loader);
+        tracks.ClearAndResize(reader.ReadNumTracks());
+        return reader.Parse();
+    }
+    
+    int benchmarkTempoMap(int argc, const char * argv[])
+    {
+        vector<string> files;
+        for (int i = 1; i < argc; ++i) {
+            files.push_back(argv[i]);
+        }
+        if (files.empty()) {
+            files.push_back("berlioz.mid");
+        }
+        
+        for (auto& file : files) {
+            jdksmidi::MIDIMultiTrack tracks(1);
+            if (!loadMultiTrack(file.c_str(), tracks)) {
+                fprintf(stderr, "Couldn't read %s\n", file.c_str());
+                return 1;
+            }
+            
+            const int buildIterations = 1000;
+            TempoMap map;
+            auto start = Clock::now();
+            for (int i = 0; i < buildIterations; ++i) {
+                map = TempoMap::fromTrack(*tracks.GetTrack(0), tracks.GetClksPerBeat());
+            }
+            printf("%s: built tempo map in %.2f us\n", file.c_str(), secondsSince(start) * 1e6 / buildIterations);
+            
+            vector<vector<uint64_t>> trackTicks;
+            for (int t = 0; t < tracks.GetNumTracks(); ++t) {
+                const jdksmidi::MIDITrack& track = *tracks.GetTrack(t);
+                trackTicks.push_back(vector<uint64_t>());
+                for (int e = 0; e < track.GetNumEvents(); ++e) {
+                    trackTicks.back().push_back(track.GetEvent(e)->GetTime());
+                }
+            }
+            benchmarkTempoLookups(file.c_str(), map, trackTicks);
+        }
+        
+        // Synthetic worst case: many tracks against a conductor track full of tempo ramps.
+        const int numTracks = 200;
+        const int numTempoChanges = 5000;
+        const int eventsPerTrack = 2000;
+        const uint64_t ticksPerTempoChange = 24;
+        const uint64_t songLength = numTempoChanges * ticksPerTempoChange;
+        
+        TempoMap synthetic(480);
+        for (int i = 0; i < numTempoChanges; ++i) {
+            synthetic.addTempoChange(i * ticksPerTempoChange, 300000 + (i % 97) * 4000, i);
+        }
+        
+        vector<vector<uint64_t>> syntheticTicks(numTracks);
+        uint32_t seed = 12345;
+        for (int t = 0; t < numTracks; ++t) {
+            uint64_t tick = 0;
+            for (int e = 0; e < eventsPerTrack; ++e) {
+                seed = seed * 1664525u + 1013904223u;
+                tick += (seed >> 16) % (2 * songLength / eventsPerTrack);
+                syntheticTicks[t].push_back(tick);
+            }
+        }
+        benchmarkTempoLookups("synthetic", synthetic, syntheticTicks);
+        
+        return 0;
+    }
+    
+    // Splits and renders a MIDI file with the built-in synth, so it runs headless anywhere.
+    // Renders once with stereo stems and once with the mono stems positional playback uses,
+    // to show what rendering mono directly saves in time and stem size.
+    int benchmarkRender(int argc, const char * argv[])
+    {
+        const char* file = argc > 1 ? argv[1] : "berlioz.mid";
+        unsigned int numWorkers = argc > 2 ? (unsigned int)atoi(argv[2]) : 0;
+        
+        for (unsigned int channels = 2; channels >= 1; --channels) {
+            MidiProcessor processor(file);
+            if (!processor.isValid()) {
+                fprintf(stderr, "Couldn't read %s\n", file);
+                return 1;
+            }
+            processor.setRenderBackend(MidiProcessor::RenderBackend::BuiltinSynth);
+            processor.setNumConversionWorkers(numWorkers);
+            processor.setStemChannels(channels);
+            
+            auto start = Clock::now();
+            processor.splitTracks();
+            double splitTime = secondsSince(start);
+            
+            start = Clock::now();
+            processor.convertTracks();
+            double renderTime = secondsSince(start);
+            
+            double renderedSeconds = 0;
+            for (double seconds : processor.getTrackRenderedSeconds()) {
+                renderedSeconds += seconds;
+            }
+            // With the tracks on several workers, the render takes about as long as the
+            // slowest; the sum over the render time is the speedup the workers gave.
+            double trackTime = 0, slowestTrackTime = 0;
+            for (double seconds : processor.getTrackConversionTimes()) {
+                trackTime += seconds;
+                slowestTrackTime = max(slowestTrackTime, seconds);
+            }
+            size_t stemBytes = 0;
+            for (auto& stem : processor.getTrackStems()) {
+                stemBytes += stem.getSizeBytes();
+            }
+            
+            printf("%s (%s stems): %d tracks, split %.3f s, render %.3f s\n", file, channels == 1 ? "mono" : "stereo",
+                   processor.getNumTracks(), splitTime, renderTime);
+            printf("  %.1f s of audio, %.1fx realtime, %.1f MB of stems\n", renderedSeconds,
+                   renderTime > 0 ? renderedSeconds / renderTime : 0.0, stemBytes / (1024.0 * 1024.0));
+            printf("  tracks took %.3f s between them, the slowest %.3f s: %.1fx from the workers\n", trackTime,
+                   slowestTrackTime, renderTime > 0 ? trackTime / renderTime : 0.0);
+        }
+        return 0;
+    }
+    
+    // Converts a file twice through an empty render cache: the first launch renders and fills
+    // it, the second should only split the file and read the stems back.
+    int benchmarkRenderCache(int argc, const char * argv[])
+    {
+        const char* file = argc > 1 ? argv[1] : "mozart.mid";
+        char directory[] = "/tmp/OpenGLApp-cache-XXXXXX";
+        if (mkdtemp(directory) == NULL) {
+            fprintf(stderr, "Couldn't create a cache directory\n");
+            return 1;
+        }
+        
+        double times[2];
+        vector<AudioStem> stems[2];
+        for (int run = 0; run < 2; ++run) {
+            MidiProcessor processor(file);
+            if (!processor.isValid()) {
+                fprintf(stderr, "Couldn't read %s\n", file);
+                return 1;
+            }
+            processor.setRenderBackend(MidiProcessor::RenderBackend::BuiltinSynth);
+            processor.setRenderCacheDirectory(directory);
+            
+            auto start = Clock::now();
+            processor.splitTracks();
+            processor.convertTracks();
+            times[run] = secondsSince(start);
+            stems[run] = processor.getTrackStems();
+        }
+        
+        bool identical = stems[0].size() == stems[1].size();
+        for (size_t i = 0; identical && i < stems[0].size(); ++i) {
+            identical = stems[0][i].lengthFrames == stems[1][i].lengthFrames && stems[0][i].samples == stems[1][i].samples;
+        }
+        
+        // A zero budget evicts everything, leaving just the directory to remove.
+        RenderCache(directory, 0).evict();
+        rmdir(directory);
+        
+        printf("%s: cold %.3f s, warm %.3f s (%.1fx faster), stems %s\n", file, times[0], times[1],
+               times[1] > 0 ? times[0] / times[1] : 0.0, identical ? "identical" : "DIFFER");
+        return identical ? 0 : 1;
+    }
+    
+    // Renders and exports the stems of each file, then decodes all of them back with a fresh
+    // allocation per file and with one pooled arena, reporting throughput and how far resident
+    // memory rises above where it was before decoding.
+    int benchmarkDecode(int argc, const char * argv[])
+    {
+        vector<string> files;
+        for (int i = 1; i < argc; ++i) {
+            files.push_back(argv[i]);
+        }
+        if (files.empty()) {
+            files = { "mozart.mid", "berlioz.mid", "awesome.mid" };
+        }
+        const int rounds = 3;
+        
+        vector<string> stemFiles;
+        for (auto& file : files) {
+            MidiProcessor processor(file);
+            if (!processor.isValid()) {
+                fprintf(stderr, "Couldn't read %s\n", file.c_str());
+                return 1;
+            }
+            processor.setRenderBackend(MidiProcessor::RenderBackend::BuiltinSynth);
+            processor.setExportWavFiles(true);
+            processor.splitTracks();
+            processor.convertTracks();
+            for (auto& name : processor.getConvertedTrackNames()) {
+                stemFiles.push_back(name);
+            }
+        }
+        
+        int result = 0;
+        for (int pooled = 0; pooled < 2 && result == 0; ++pooled) {
+            size_t baseline = getCurrentResidentBytes();
+            size_t peak = baseline;
+            size_t decodedBytes = 0;
+            double bestTime = 0;
+            
+            for (int round = 0; round < rounds && result == 0; ++round) {
+                PcmArena pooledArena;
+                decodedBytes = 0;
+                auto start = Clock::now();
+                for (auto& stemFile : stemFiles) {
+                    PcmArena fileArena;
+                    DecodedAudio audio;
+                    if (!decodeAudioFile(stemFile, pooled ? pooledArena : fileArena, audio, AudioFormat())) {
+                        result = 1;
+                        break;
+                    }
+                    decodedBytes += audio.getSizeBytes();
+                    peak = max(peak, getCurrentResidentBytes());
+                }
+                double time = secondsSince(start);
+                bestTime = round == 0 ? time : min(bestTime, time);
+            }
+            
+            printf("%-8s: %zu files, %.1f MB of PCM in %.3f s, %.1f MB/s, resident +%.1f MB at peak\n",
+                   pooled ? "pooled" : "per-file", stemFiles.size(), decodedBytes / (1024.0 * 1024.0), bestTime,
+                   bestTime > 0 ? decodedBytes / (1024.0 * 1024.0) / bestTime : 0.0, (peak - baseline) / (1024.0 * 1024.0));
+        }
+        printf("peak RSS of the whole run (rendering included): %.1f MB\n", getPeakResidentBytes() / (1024.0 * 1024.0));
+        
+        for (auto& stemFile : stemFiles) {
+            remove(stemFile.c_str());
+        }
+        return result;
+    }
+    
+    // What it costs to get a track into the playback format, per minute of audio. Before the
+    // pipeline had one format, stems were rendered at 16 kHz stereo and then resampled to
+    // 44.1 kHz, downmixed and requantised on load; now a stem already is the playback format
+    // and loading it is a copy. The old chain is timed with the polyphase resampler at each
+    // quality and instruction set, next to the SNR of a converted 1 kHz tone at that quality.
+    int benchmarkResample(int argc, const char * argv[])
+    {
+        double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+        double renderRate = argc > 2 ? atof(argv[2]) : 16000.0;
+        double loadRate = argc > 3 ? atof(argv[3]) : 44100.0;
+        const int rounds = 3;
+        if (!(seconds > 0) || !(renderRate > 0) || !(loadRate > 0)) {
+            fprintf(stderr, "Usage: resample [seconds] [render rate] [load rate]\n");
+            return 1;
+        }
+        
+        // A few partials under a slow tremolo: broadband enough to exercise every tap.
+        size_t inputFrames = (size_t)(seconds * renderRate);
+        vector<int16_t> stereo(inputFrames * 2), mono(inputFrames);
+        for (size_t i = 0; i < inputFrames; ++i) {
+            double t = i / renderRate;
+            double envelope = 0.5 + 0.4 * sin(2.0 * M_PI * 0.5 * t);
+            double left = envelope * (0.4 * sin(2.0 * M_PI * 220.0 * t) + 0.2 * sin(2.0 * M_PI * 1760.0 * t));
+            double right = envelope * (0.4 * sin(2.0 * M_PI * 330.0 * t) + 0.1 * sin(2.0 * M_PI * 3520.0 * t));
+            stereo[2 * i] = (int16_t)lrint(left * 32767.0);
+            stereo[2 * i + 1] = (int16_t)lrint(right * 32767.0);
+            mono[i] = (int16_t)(((int)stereo[2 * i] + stereo[2 * i + 1]) / 2);
+        }
+        double perMinute = 60.0 / seconds;
+        
+        vector<int16_t> copied(inputFrames);
+        double copyTime = 0;
+        for (int round = 0; round < rounds; ++round) {
+            auto start = Clock::now();
+            copy(mono.begin(), mono.end(), copied.begin());
+            double time = secondsSince(start);
+            copyTime = round == 0 ? time : min(copyTime, time);
+        }
+        printf("%.0f s of audio rendered at %.0f Hz, loaded at %.0f Hz\n", seconds, renderRate, loadRate);
+        printf("  canonical (no conversion)  %8.3f ms/min of audio\n", copyTime * 1000.0 * perMinute);
+        
+        vector<SimdLevel> levels;
+        SimdLevel allLevels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+        for (SimdLevel level : allLevels) {
+            if (isSimdLevelSupported(level)) {
+                levels.push_back(level);
+            }
+        }
+        
+        ResamplerQuality qualities[] = { ResamplerQuality::Low, ResamplerQuality::Medium, ResamplerQuality::High };
+        for (ResamplerQuality quality : qualities) {
+            Resampler resampler(renderRate, loadRate, quality);
+            size_t outputFrames = resampler.getOutputFrames(inputFrames);
+            vector<int16_t> resampled(outputFrames * 2), loaded(outputFrames);
+            
+            // Quality check: a 1 kHz tone against the ideal tone at the output rate, away from the edges.
+            size_t toneFrames = (size_t)renderRate;
+            size_t toneOutputFrames = resampler.getOutputFrames(toneFrames);
+            vector<float> tone(toneFrames), toneOut(toneOutputFrames);
+            double effectiveRate = renderRate * resampler.getUpFactor() / resampler.getDownFactor();
+            for (size_t i = 0; i < toneFrames; ++i) {
+                tone[i] = (float)(0.5 * sin(2.0 * M_PI * 1000.0 * i / renderRate));
+            }
+            resampler.processChannel(tone.data(), toneFrames, toneOut.data());
+            double signal = 0, noise = 0;
+            for (size_t i = toneOutputFrames / 4; i < toneOutputFrames * 3 / 4; ++i) {
+                double ideal = 0.5 * sin(2.0 * M_PI * 1000.0 * i / effectiveRate);
+                signal += ideal * ideal;
+                noise += (toneOut[i] - ideal) * (toneOut[i] - ideal);
+            }
+            
+            for (SimdLevel level : levels) {
+                resampler.setSimdLevel(level);
+                double bestTime = 0;
+                for (int round = 0; round < rounds; ++round) {
+                    auto start = Clock::now();
+                    resampler.process(stereo.data(), inputFrames, 2, resampled.data());
+                    for (size_t i = 0; i < outputFrames; ++i) {
+                        loaded[i] = (int16_t)(((int)resampled[2 * i] + resampled[2 * i + 1]) / 2);
+                    }
+                    double time = secondsSince(start);
+                    bestTime = round == 0 ? time : min(bestTime, time);
+                }
+                printf("  %-6s %2u taps %-7s  %8.3f ms/min of audio  %7.1f M frames/s  %6.1fx the copy  SNR %.1f dB\n",
+                       getResamplerQualityName(quality), resampler.getTapsPerPhase(), getSimdLevelName(level),
+                       bestTime * 1000.0 * perMinute, outputFrames / bestTime / 1e6,
+                       copyTime > 0 ? bestTime / copyTime : 0.0, 10.0 * log10(signal / max(noise, 1e-30)));
+            }
+        }
+        return 0;
+    }
+    
+    // Renders every track of a file as a separate stem once per instruction set and reports
+    // how many voice-frames per second the mixing kernel gets through.
+    int benchmarkVoiceMixing(int argc, const char * argv[])
+    {
+        const char* file = argc > 1 ? argv[1] : "mozart.mid";
+        double sampleRate = argc > 2 ? atof(argv[2]) : 44100.0;
+        const size_t blockSize = 512;
+        const double tailSeconds = 2.0;
+        
+        jdksmidi::MIDIMultiTrack tracks(1);
+        if (!loadMultiTrack(file, tracks)) {
+            fprintf(stderr, "Couldn't read %s\n", file);
+            return 1;
+        }
+        TempoMap tempoMap = TempoMap::fromTrack(*tracks.GetTrack(0), tracks.GetClksPerBeat());
+        
+        vector<SimdLevel> levels;
+        SimdLevel allLevels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+        for (SimdLevel level : allLevels) {
+            if (isSimdLevelSupported(level)) {
+                levels.push_back(level);
+            } else {
+                printf("%s: not supported on this build/CPU, skipped\n", getSimdLevelName(level));
+            }
+        }
+        
+        WavetableBank bank = WavetableBank::createGeneralMidi();
+        vector<double> mixTimes(levels.size(), 0.0);
+        vector<float> maxDifference(levels.size(), 0.0f);
+        uint64_t voiceFrames = 0, renderedFrames = 0;
+        int numStems = 0;
+        
+        for (int t = 0; t < tracks.GetNumTracks(); ++t) {
+            const jdksmidi::MIDITrack& track = *tracks.GetTrack(t);
+            vector<SynthEvent> events;
+            TempoMap::Cursor cursor(tempoMap);
+            for (int e = 0; e < track.GetNumEvents(); ++e) {
+                const jdksmidi::MIDITimedBigMessage* msg = track.GetEvent(e);
+                if (msg->IsNoOp() || !msg->IsChannelMsg()) {
+                    continue;
+                }
+                uint64_t frame = (uint64_t)llround(cursor.tickToMicroseconds(msg->GetTime()) * sampleRate / 1000000.0);
+                SynthEvent event = { frame, msg->GetStatus(), msg->GetByte1(), msg->GetByte2() };
+                events.push_back(event);
+            }
+            if (events.empty()) {
+                continue;
+            }
+            ++numStems;
+            
+            uint64_t totalFrames = events.back().frame + (uint64_t)(tailSeconds * sampleRate);
+            vector<float> reference;
+            vector<float> left(blockSize), right(blockSize);
+            
+            for (size_t l = 0; l < levels.size(); ++l) {
+                WavetableSynth synth(bank, sampleRate);
+                synth.setSimdLevel(levels[l]);
+                size_t nextEvent = 0;
+                
+                for (uint64_t frame = 0; frame < totalFrames; frame += blockSize) {
+                    auto start = Clock::now();
+                    synth.process(events, nextEvent, left.data(), right.data(), blockSize);
+                    mixTimes[l] += secondsSince(start);
+                    
+                    // The first level is the reference; later ones are compared against it.
+                    if (l == 0) {
+                        reference.insert(reference.end(), left.begin(), left.end());
+                    } else {
+                        for (size_t i = 0; i < blockSize; ++i) {
+                            maxDifference[l] = max(maxDifference[l], fabsf(left[i] - reference[frame + i]));
+                        }
+                    }
+                }
+                
+                if (l == 0) {
+                    voiceFrames += synth.getMixedVoiceFrames();
+                    renderedFrames += synth.getCurrentFrame();
+                }
+            }
+        }
+        
+        printf("%s: %d stems, %.1f s of audio at %.0f Hz, %.1f voices on average\n", file, numStems,
+               renderedFrames / sampleRate, sampleRate, renderedFrames > 0 ? (double)voiceFrames / renderedFrames : 0.0);
+        for (size_t l = 0; l < levels.size(); ++l) {
+            printf("  %-7s %8.1f M voice-frames/s  %6.1fx realtime", getSimdLevelName(levels[l]),
+                   voiceFrames / mixTimes[l] / 1e6, renderedFrames / sampleRate / mixTimes[l]);
+            if (l > 0) {
+                printf("  speedup %.2fx  max diff %.2g", mixTimes[0] / mixTimes[l], maxDifference[l]);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+    
+    // Renders a MIDI file's tracks, then mixes ever more sources through the spatial mixer,
+    // reusing the stems round-robin spread over a grid, as many more tracks would be. Times
+    // every instruction set on the same sources.
+    int benchmarkSpatialMixer(int argc, const char * argv[])
+    {
+        const char* file = argc > 1 ? argv[1] : "berlioz.mid";
+        size_t maxSources = min(argc > 2 ? (size_t)atoi(argv[2]) : 512, SpatialMixer::maxSources);
+        const double mixSeconds = 10.0;
+        
+        MidiProcessor processor(file);
+        if (!processor.isValid()) {
+            fprintf(stderr, "Couldn't read %s\n", file);
+            return 1;
+        }
+        processor.setRenderBackend(MidiProcessor::RenderBackend::BuiltinSynth);
+        processor.splitTracks();
+        processor.convertTracks();
+        
+        vector<const AudioStem*> stems;
+        for (auto& stem : processor.getTrackStems()) {
+            if (stem.getNumFrames() > 0) {
+                stems.push_back(&stem);
+            }
+        }
+        if (stems.empty()) {
+            fprintf(stderr, "%s has no audible tracks\n", file);
+            return 1;
+        }
+        AudioFormat format = stems[0]->getFormat();
+        uint64_t loopFrames = 0;
+        for (const AudioStem* stem : stems) {
+            loopFrames = max(loopFrames, stem->getNumFrames());
+        }
+        size_t numFrames = (size_t)(mixSeconds * format.sampleRate);
+        vector<int16_t> output(numFrames * 2);
+        
+        vector<SimdLevel> levels;
+        SimdLevel allLevels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+        for (SimdLevel level : allLevels) {
+            if (isSimdLevelSupported(level)) {
+                levels.push_back(level);
+            }
+        }
+        
+        printf("%s: %zu stems, mixing %.0f s at %.0f Hz\n", file, stems.size(), mixSeconds, format.sampleRate);
+        for (size_t numSources = stems.size(); ; numSources = min(numSources * 2, maxSources)) {
+            printf("  %4zu sources:", numSources);
+            for (SimdLevel level : levels) {
+                SpatialMixer mixer(format, loopFrames);
+                mixer.setSimdLevel(level);
+                for (size_t i = 0; i < numSources; ++i) {
+                    mixer.addSource(*stems[i % stems.size()], (i % 16) * 25.0f, 0.0f, (i / 16) * 25.0f);
+                }
+                
+                auto start = Clock::now();
+                mixer.render(output.data(), numFrames);
+                double mixTime = secondsSince(start);
+                
+                uint64_t mixed = mixer.getMixedSourceFrames();
+                uint64_t skipped = mixer.getSkippedSourceFrames();
+                printf("  %s %.2f ns/source-frame %.0fx realtime", getSimdLevelName(level),
+                       mixTime * 1e9 / (mixed + skipped), mixSeconds / mixTime);
+                if (level == levels.back()) {
+                    printf("  (%.0f%% skipped as silence)", 100.0 * skipped / max(mixed + skipped, (uint64_t)1));
+                }
+            }
+            printf("\n");
+            if (numSources >= maxSources) {
+                break;
+            }
+        }
+        return 0;
+    }
+    
+    // Sends count sequence numbers through a ring of the given capacity, in chunks of up to
+    // maxChunk (1 uses push/pop), and checks they all arrive once and in order.
+    bool stressSpscRing(size_t capacity, size_t maxChunk, uint64_t count)
+    {
+        SpscRing<uint64_t> ring(capacity);
+        atomic<bool> failed(false);
+        thread producer([&] {
+            vector<uint64_t> chunk(maxChunk);
+            uint64_t next = 0;
+            unsigned int seed = 1;
+            while (next < count && !failed) {
+                // A cheap LCG for chunk sizes, so the two ends keep meeting at different places.
+                seed = seed * 1103515245u + 12345u;
+                size_t size = (size_t)min((uint64_t)(seed >> 16) % maxChunk + 1, count - next);
+                for (size_t i = 0; i < size; ++i) {
+                    chunk[i] = next + i;
+                }
+                size_t sent = maxChunk == 1 ? (ring.push(chunk[0]) ? 1 : 0) : ring.write(chunk.data(), size);
+                next += sent;
+                if (sent == 0) {
+                    this_thread::yield();
+                }
+            }
+        });
+        
+        vector<uint64_t> chunk(maxChunk);
+        uint64_t expected = 0;
+        unsigned int seed = 7;
+        while (expected < count && !failed) {
+            seed = seed * 1103515245u + 12345u;
+            size_t size = (size_t)((seed >> 16) % maxChunk + 1);
+            size_t received = maxChunk == 1 ? (ring.pop(chunk[0]) ? 1 : 0) : ring.read(chunk.data(), size);
+            for (size_t i = 0; i < received; ++i) {
+                if (chunk[i] != expected++) {
+                    failed = true;
+                }
+            }
+            if (received == 0) {
+                this_thread::yield();
+            }
+        }
+        producer.join();
+        return !failed && ring.getReadAvailable() == 0;
+    }
+    
+    // What the rings replace: a deque behind a mutex.
+    template <typename T>
+    class MutexQueue
+    {
+    public:
+        size_t write(const T* items, size_t count)
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queue.insert(queue.end(), items, items + count);
+            return count;
+        }
+        
+        size_t read(T* items, size_t count)
+        {
+            lock_guard<mutex> lock(queueMutex);
+            count = min(count, queue.size());
+            copy(queue.begin(), queue.begin() + count, items);
+            queue.erase(queue.begin(), queue.begin() + count);
+            return count;
+        }
+    private:
+        mutex queueMutex;
+        deque<T> queue;
+    };
+    
+    // Streams count items through queue in chunks of chunkSize and returns the items per second.
+    template <typename Queue, typename T>
+    double measureQueueThroughput(Queue& queue, size_t chunkSize, uint64_t count)
+    {
+        auto start = Clock::now();
+        thread producer([&] {
+            vector<T> chunk(chunkSize, (T)1);
+            for (uint64_t sent = 0; sent < count; ) {
+                size_t written = queue.write(chunk.data(), (size_t)min((uint64_t)chunkSize, count - sent));
+                sent += written;
+                if (written == 0) {
+                    this_thread::yield();
+                }
+            }
+        });
+        vector<T> chunk(chunkSize);
+        for (uint64_t received = 0; received < count; ) {
+            size_t read = queue.read(chunk.data(), chunkSize);
+            received += read;
+            if (read == 0) {
+                this_thread::yield();
+            }
+        }
+        producer.join();
+        return count / secondsSince(start);
+    }
+    
+    // Spins briefly for the other thread, then yields so a single core still makes progress.
+    void popWaiting(SpscRing<uint64_t>& ring, uint64_t& value)
+    {
+        for (int spins = 0; !ring.pop(value); ++spins) {
+            if (spins > 1000) {
+                this_thread::yield();
+            }
+        }
+    }
+    
+    // Stress-tests the SPSC ring at awkward capacities and chunk sizes, then measures its
+    // throughput against a locked deque, as PCM blocks and as single commands, and the
+    // one-way latency of a command from a round trip between two threads.
+    int benchmarkSpscRing(int argc, const char * argv[])
+    {
+        uint64_t stressItems = argc > 1 ? (uint64_t)atoll(argv[1]) : 4000000;
+        bool allPassed = true;
+        
+        printf("Stress: %llu items per case\n", (unsigned long long)stressItems);
+        size_t capacities[] = { 1, 2, 7, 64, 4096 };
+        size_t chunks[] = { 1, 3, 64, 1000 };
+        for (size_t capacity : capacities) {
+            printf("  capacity %4zu:", capacity);
+            for (size_t chunk : chunks) {
+                bool passed = stressSpscRing(capacity, chunk, stressItems);
+                allPassed = allPassed && passed;
+                printf("  chunk %4zu %s", chunk, passed ? "ok" : "FAILED");
+            }
+            printf("\n");
+        }
+        
+        const uint64_t pcmSamples = 200000000;
+        const size_t pcmChunk = SpatialMixer::blockFrames * 2;
+        SpscRing<int16_t> pcmRing(pcmChunk * 8);
+        MutexQueue<int16_t> pcmQueue;
+        double ringRate = measureQueueThroughput<SpscRing<int16_t>, int16_t>(pcmRing, pcmChunk, pcmSamples);
+        double queueRate = measureQueueThroughput<MutexQueue<int16_t>, int16_t>(pcmQueue, pcmChunk, pcmSamples);
+        printf("PCM, %zu-sample blocks: ring %.0f M samples/s, locked deque %.0f M samples/s\n", pcmChunk, ringRate / 1e6, queueRate / 1e6);
+        
+        const uint64_t numCommands = 20000000;
+        SpscRing<uint64_t> commandRing(4096);
+        MutexQueue<uint64_t> commandQueue;
+        ringRate = measureQueueThroughput<SpscRing<uint64_t>, uint64_t>(commandRing, 1, numCommands);
+        queueRate = measureQueueThroughput<MutexQueue<uint64_t>, uint64_t>(commandQueue, 1, numCommands);
+        printf("Commands, one at a time: ring %.1f M/s, locked deque %.1f M/s\n", ringRate / 1e6, queueRate / 1e6);
+        
+        // Ping-pong: each side spins on its ring, so with a core each this is the handover cost alone.
+        const int numRoundTrips = 200000;
+        SpscRing<uint64_t> ping(64), pong(64);
+        thread echo([&] {
+            uint64_t value;
+            for (int i = 0; i < numRoundTrips; ++i) {
+                popWaiting(ping, value);
+                pong.push(value);
+            }
+        });
+        vector<double> latencies(numRoundTrips);
+        for (int i = 0; i < numRoundTrips; ++i) {
+            auto start = Clock::now();
+            uint64_t value = (uint64_t)i;
+            ping.push(value);
+            popWaiting(pong, value);
+            latencies[i] = chrono::duration<double, nano>(Clock::now() - start).count() / 2.0;
+        }
+        echo.join();
+        sort(latencies.begin(), latencies.end());
+        printf("Latency, one way: median %.0f ns, 99th percentile %.0f ns, worst %.0f ns\n",
+               latencies[numRoundTrips / 2], latencies[numRoundTrips * 99 / 100], latencies.back());
+               
+        return allPassed ? 0 : 1;
+    }
+    
+    // A UV sphere of the given number of rings and segments, off-centre and stretched so its
+    // bounds aren't a unit cube, welded and ordered as load_mesh() would leave it.
+    MeshData makeSphereMesh(unsigned int rings, unsigned int segments)
+    {
+        MeshData mesh;
+        const double pi = 3.14159265358979323846;
+        for (unsigned int ring = 0; ring <= rings; ++ring) {
+            double latitude = pi * ring / rings;
+            for (unsigned int segment = 0; segment <= segments; ++segment) {
+                double longitude = 2.0 * pi * segment / segments;
+                float normal[3] = { (float)(sin(latitude) * cos(longitude)), (float)cos(latitude), (float)(sin(latitude) * sin(longitude)) };
+                mesh.positions.insert(mesh.positions.end(), { 3.0f * normal[0] + 10.0f, 1.5f * normal[1] + 1.5f, 3.0f * normal[2] - 4.0f });
+                mesh.normals.insert(mesh.normals.end(), normal, normal + 3);
+                mesh.texcoords.insert(mesh.texcoords.end(), { (float)segment / segments, (float)ring / rings });
+            }
+        }
+        for (unsigned int ring = 0; ring < rings; ++ring) {
+            for (unsigned int segment = 0; segment < segments; ++segment) {
+                uint32_t a = ring * (segments + 1) + segment, b = a + 1, c = a + segments + 1, d = c + 1;
+                mesh.indices.insert(mesh.indices.end(), { a, c, b, b, c, d });
+            }
+        }
+        weldVertices(mesh);
+        optimizeVertexCache(mesh);
+        optimizeVertexFetch(mesh);
+        return mesh;
+    }
+    
+    // Packs one mesh in every vertex layout and compares their size, the vertex bytes a draw
+    // fetches (one vertex per post-transform cache miss), the time to pack and to read back
+    // every vertex in index order, and the worst error quantisation introduces. The read time
+    // is the CPU's; the GPU converts these formats in its fetch hardware for nothing.
+    int benchmarkVertexLayouts(int argc, const char * argv[])
+    {
+        unsigned int rings = argc > 1 ? (unsigned int)max(atoi(argv[1]), 2) : 256;
+        const int passes = 20;
+        
+        MeshData mesh = makeSphereMesh(rings, rings * 2);
+        double acmr = computeAcmr(mesh);
+        printf("Sphere: %zu vertices, %zu triangles, ACMR %.3f, %u-bit indices\n",
+               mesh.getNumVertices(), mesh.getNumTriangles(), acmr, mesh.getIndexBytes() * 8);
+               
+        VertexFormats layouts[] = {
+            { PositionFormat::Float, NormalFormat::Float, TexcoordFormat::Float },
+            { PositionFormat::Float, NormalFormat::Int2101010, TexcoordFormat::Float },
+            { PositionFormat::Float, NormalFormat::Int2101010, TexcoordFormat::Half },
+            { PositionFormat::Float, NormalFormat::Int2101010, TexcoordFormat::Unorm16 },
+            { PositionFormat::Unorm16, NormalFormat::Int2101010, TexcoordFormat::Half },
+            { PositionFormat::Unorm16, NormalFormat::Int2101010, TexcoordFormat::Unorm16 },
+        };
+        const char* positionNames[] = { "float", "unorm16" };
+        const char* normalNames[] = { "float", "2_10_10_10" };
+        const char* texcoordNames[] = { "float", "half", "unorm16" };
+        
+        printf("%-10s %-8s %-11s %-8s %6s %9s %11s %9s %11s %10s %10s %10s\n", "name", "position", "normal", "texcoord",
+               "bytes", "buffer KB", "KB per draw", "pack ms", "read ns/vx", "pos error", "nrm error", "uv error");
+        for (const VertexFormats& formats : layouts) {
+            VertexLayout layout(mesh, formats);
+            
+            vector<uint8_t> vertices;
+            auto start = Clock::now();
+            for (int pass = 0; pass < passes; ++pass) {
+                vertices = layout.pack(mesh);
+            }
+            double packSeconds = secondsSince(start) / passes;
+            
+            float position[3], normal[3], texcoord[2];
+            float checksum = 0.0f;
+            start = Clock::now();
+            for (int pass = 0; pass < passes; ++pass) {
+                for (uint32_t index : mesh.indices) {
+                    layout.unpack(vertices.data(), index, position, normal, texcoord);
+                    checksum += position[0] + normal[1] + texcoord[0];
+                }
+            }
+            double readSeconds = secondsSince(start) / passes;
+            // Stored so the reads can't be optimised away.
+            volatile float readChecksum = checksum;
+            (void)readChecksum;
+            
+            double positionError = 0.0, normalError = 0.0, texcoordError = 0.0;
+            for (size_t v = 0; v < mesh.getNumVertices(); ++v) {
+                layout.unpack(vertices.data(), v, position, normal, texcoord);
+                for (int i = 0; i < 3; ++i) {
+                    positionError = max(positionError, (double)fabs(position[i] - mesh.positions[v * 3 + i]));
+                    normalError = max(normalError, (double)fabs(normal[i] - mesh.normals[v * 3 + i]));
+                }
+                for (int i = 0; i < 2; ++i) {
+                    texcoordError = max(texcoordError, (double)fabs(texcoord[i] - mesh.texcoords[v * 2 + i]));
+                }
+            }
+            
+            double drawBytes = acmr * mesh.getNumTriangles() * layout.getStride();
+            printf("%-10s %-8s %-11s %-8s %6zu %9.0f %11.0f %9.2f %11.2f %10.2e %10.2e %10.2e\n", getVertexFormatsName(formats),
+                   positionNames[(int)formats.position], normalNames[(int)formats.normal], texcoordNames[(int)formats.texcoord],
+                   layout.getStride(), vertices.size() / 1024.0, drawBytes / 1024.0, packSeconds * 1e3,
+                   readSeconds * 1e9 / mesh.indices.size(), positionError, normalError, texcoordError);
+        }
+        return 0;
+    }
+}
+
+int OpenGLApp::runBenchmark(int argc, const char * argv[])
+{
+    if (argc < 1) {
+        fprintf(stderr, "Usage: OpenGLApp --benchmark <tempomap|render|cache|decode|resample|mixing|spatial|spsc|layouts> [args...]\n");
+        return 1;
+    }
+    
+    if (strcmp(argv[0], "tempomap") == 0) {
+        return benchmarkTempoMap(argc, argv);
+    }
+    if (strcmp(argv[0], "render") == 0) {
+        return benchmarkRender(argc, argv);
+    }
+    if (strcmp(argv[0], "cache") == 0) {
+        return benchmarkRenderCache(argc, argv);
+    }
+    if (strcmp(argv[0], "decode") == 0) {
+        return benchmarkDecode(argc, argv);
+    }
+    if (strcmp(argv[0], "resample") == 0) {
+        return benchmarkResample(argc, argv);
+    }
+    if (strcmp(argv[0], "mixing") == 0) {
+        return benchmarkVoiceMixing(argc, argv);
+    }
+    if (strcmp(argv[0], "spatial") == 0) {
+        return benchmarkSpatialMixer(argc, argv);
+    }
+    if (strcmp(argv[0], "spsc") == 0) {
+        return benchmarkSpscRing(argc, argv);
+    }
+    if (strcmp(argv[0], "layouts") == 0) {
+        return benchmarkVertexLayouts(argc, argv);
+    }
+    
+    fprintf(stderr, "Unknown benchmark: %s\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,19 @@
+//
+//  Benchmarks.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__Benchmarks__
+#define __OpenGLApp__Benchmarks__
+
+namespace OpenGLApp {
+    
+    // Entry point for `OpenGLApp --benchmark <name> [args...]`. argv[0] is the benchmark
+    // name. Returns the process exit code.
+    int runBenchmark(int argc, const char * argv[]);
+}
+
+#endif /* defined(__OpenGLApp__Benchmarks__) */
@@ -0,0 +1,217 @@
+//
+//  GLState.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "GLState.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace OpenGLApp;
+
+GLState::GLState() : callsThisFrame(0)
+{
+    // GL's initial state, which the tracker starts out agreeing with.
+    depthFuncKnown = clearColorKnown = programKnown = vertexArrayKnown = activeTextureKnown = true;
+    depthFunc = GL_LESS;
+    fill(clearColor, clearColor + 4, 0.0f);
+    program = NULL;
+    vertexArray = 0;
+    activeTexture = GL_TEXTURE0;
+    
+    stats.frames = 0;
+    stats.totalCalls = 0;
+    stats.callsLastFrame = 0;
+    stats.maxCallsPerFrame = 0;
+    stats.stateChanges = 0;
+    stats.redundantCallsSkipped = 0;
+}
+
+void GLState::invalidate()
+{
+    enabledCapabilities.clear();
+    depthFuncKnown = clearColorKnown = programKnown = vertexArrayKnown = activeTextureKnown = false;
+    boundTextures.clear();
+    boundBuffers.clear();
+}
+
+void GLState::setEnabled(GLenum capability, bool enabled)
+{
+    auto it = enabledCapabilities.find(capability);
+    if (it != enabledCapabilities.end() && it->second == enabled) {
+        countSkipped();
+        return;
+    }
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+    enabledCapabilities[capability] = enabled;
+    countChange();
+}
+
+void GLState::setDepthFunc(GLenum func)
+{
+    if (depthFuncKnown && depthFunc == func) {
+        countSkipped();
+        return;
+    }
+    glDepthFunc(func);
+    depthFunc = func;
+    depthFuncKnown = true;
+    countChange();
+}
+
+void GLState::setClearColor(float red, float green, float blue, float alpha)
+{
+    float color[4] = { red, green, blue, alpha };
+    if (clearColorKnown && equal(color, color + 4, clearColor)) {
+        countSkipped();
+        return;
+    }
+    glClearColor(red, green, blue, alpha);
+    copy(color, color + 4, clearColor);
+    clearColorKnown = true;
+    countChange();
+}
+
+void GLState::useProgram(ShaderProgram& newProgram)
+{
+    if (programKnown && program == &newProgram) {
+        countSkipped();
+        return;
+    }
+    glUseProgram(newProgram.getId());
+    program = &newProgram;
+    programKnown = true;
+    countChange();
+}
+
+void GLState::bindVertexArray(GLuint newVertexArray)
+{
+    if (vertexArrayKnown && vertexArray == newVertexArray) {
+        countSkipped();
+        return;
+    }
+    glBindVertexArray(newVertexArray);
+    // The element buffer binding belongs to the vertex array, so it changes with it.
+    boundBuffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+    vertexArray = newVertexArray;
+    vertexArrayKnown = true;
+    countChange();
+}
+
+void GLState::setActiveTexture(GLenum unit)
+{
+    if (activeTextureKnown && activeTexture == unit) {
+        countSkipped();
+        return;
+    }
+    glActiveTexture(unit);
+    activeTexture = unit;
+    activeTextureKnown = true;
+    countChange();
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    // Bindings are per unit, so an unknown unit means an unknown binding.
+    if (activeTextureKnown) {
+        auto it = boundTextures.find(make_pair(activeTexture, target));
+        if (it != boundTextures.end() && it->second == texture) {
+            countSkipped();
+            return;
+        }
+    }
+    glBindTexture(target, texture);
+    if (activeTextureKnown) {
+        boundTextures[make_pair(activeTexture, target)] = texture;
+    }
+    countChange();
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    auto it = boundBuffers.find(target);
+    if (it != boundBuffers.end() && it->second == buffer) {
+        countSkipped();
+        return;
+    }
+    glBindBuffer(target, buffer);
+    boundBuffers[target] = buffer;
+    countChange();
+}
+
+void GLState::bufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    ++callsThisFrame;
+}
+
+void GLState::bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
+{
+    glBufferSubData(target, offset, size, data);
+    ++callsThisFrame;
+}
+
+void GLState::setUniformMatrix4(GLint location, const float* matrix)
+{
+    if (!program || !programKnown || !program->updateUniformValue(location, matrix, 16)) {
+        countSkipped();
+        return;
+    }
+    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
+    countChange();
+}
+
+void GLState::setUniform3(GLint location, const float* vector)
+{
+    if (!program || !programKnown || !program->updateUniformValue(location, vector, 3)) {
+        countSkipped();
+        return;
+    }
+    glUniform3fv(location, 1, vector);
+    countChange();
+}
+
+void GLState::clear(GLbitfield mask)
+{
+    glClear(mask);
+    ++callsThisFrame;
+}
+
+void GLState::drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, GLsizei instances)
+{
+    glDrawElementsInstanced(mode, count, type, NULL, instances);
+    ++callsThisFrame;
+}
+
+void GLState::endFrame()
+{
+    ++stats.frames;
+    stats.totalCalls += callsThisFrame;
+    stats.callsLastFrame = callsThisFrame;
+    stats.maxCallsPerFrame = max(stats.maxCallsPerFrame, callsThisFrame);
+    callsThisFrame = 0;
+}
+
+GLState::Stats GLState::getStats() const
+{
+    return stats;
+}
+
+void GLState::countChange()
+{
+    ++callsThisFrame;
+    ++stats.stateChanges;
+}
+
+void GLState::countSkipped()
+{
+    ++stats.redundantCallsSkipped;
+}
@@ -0,0 +1,101 @@
+//
+//  GLState.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__GLState__
+#define __OpenGLApp__GLState__
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <map>
+#include <utility>
+
+#include "ShaderProgram.h"
+
+namespace OpenGLApp {
+    
+    // The render loop's view of the GL state machine, as AudioState is for OpenAL. Each
+    // setter compares against what it last set and only calls GL when the value really
+    // changes; uniforms are compared against the value the program last had uploaded. Draws
+    // and clears always go through.
+    //
+    // Every GL call made through it is counted, per frame and in total, along with the calls
+    // it didn't need to make; per-frame buffer uploads go through it too, so the count is the
+    // whole of the frame's GL traffic. Code that sets GL state directly (loading meshes and
+    // textures, pointing attributes at buffers) isn't counted, and must be followed by
+    // invalidate() if the tracker is to be trusted afterwards.
+    class GLState
+    {
+    public:
+        struct Stats
+        {
+            uint64_t frames;
+            uint64_t totalCalls;
+            uint64_t callsLastFrame;
+            uint64_t maxCallsPerFrame;
+            uint64_t stateChanges;
+            uint64_t redundantCallsSkipped;
+        };
+        
+        // Needs the GL context to be current. Starts out assuming GL's initial state.
+        GLState();
+        
+        // Forgets everything it knows, so the next setting of each value goes to GL.
+        void invalidate();
+        
+        void setEnabled(GLenum capability, bool enabled);
+        void setDepthFunc(GLenum func);
+        void setClearColor(float red, float green, float blue, float alpha);
+        void useProgram(ShaderProgram& program);
+        void bindVertexArray(GLuint vertexArray);
+        void setActiveTexture(GLenum unit);
+        void bindTexture(GLenum target, GLuint texture);
+        void bindBuffer(GLenum target, GLuint buffer);
+        
+        // Fill the buffer bound to target. Always sent, like draws.
+        void bufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage);
+        void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data);
+        
+        // Uniforms of the program in use, skipped when it already holds the same values.
+        void setUniformMatrix4(GLint location, const float* matrix);
+        void setUniform3(GLint location, const float* vector);
+        
+        void clear(GLbitfield mask);
+        // Draws count indices of type from the bound vertex array's element buffer.
+        void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, GLsizei instances);
+        
+        // Closes the frame's call count.
+        void endFrame();
+        
+        Stats getStats() const;
+    private:
+        // Whether each tracked value is known at all: after invalidate() none is.
+        std::map<GLenum, bool> enabledCapabilities;
+        bool depthFuncKnown;
+        GLenum depthFunc;
+        bool clearColorKnown;
+        float clearColor[4];
+        ShaderProgram* program;
+        bool programKnown;
+        bool vertexArrayKnown;
+        GLuint vertexArray;
+        bool activeTextureKnown;
+        GLenum activeTexture;
+        std::map<std::pair<GLenum, GLenum>, GLuint> boundTextures;
+        std::map<GLenum, GLuint> boundBuffers;
+        
+        uint64_t callsThisFrame;
+        Stats stats;
+        
+        // Counts one call that changed state, or one that was skipped.
+        void countChange();
+        void countSkipped();
+    };
+}
+
+#endif /* defined(__OpenGLApp__GLState__) */
@@ -0,0 +1,101 @@
+//
+//  InstanceBuffer.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "InstanceBuffer.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace OpenGLApp;
+
+InstanceBuffer::InstanceBuffer(unsigned int components) :
+    components(max(components, 1u)), buffer(0), allocatedInstances(0), firstDirty(0), endDirty(0)
+{
+    glGenBuffers(1, &buffer);
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void InstanceBuffer::resize(size_t numInstances)
+{
+    size_t oldInstances = getNumInstances();
+    values.resize(numInstances * components, 0.0f);
+    if (numInstances > oldInstances) {
+        markDirty(oldInstances, numInstances);
+    }
+    endDirty = min(endDirty, numInstances);
+    firstDirty = min(firstDirty, endDirty);
+}
+
+size_t InstanceBuffer::getNumInstances() const
+{
+    return values.size() / components;
+}
+
+void InstanceBuffer::set(size_t instance, const float* newValues)
+{
+    float* current = &values.at(instance * components);
+    if (!equal(newValues, newValues + components, current)) {
+        copy(newValues, newValues + components, current);
+        markDirty(instance, instance + 1);
+    }
+}
+
+size_t InstanceBuffer::upload(GLState& glState)
+{
+    size_t numInstances = getNumInstances();
+    size_t instanceBytes = components * sizeof(float);
+    
+    if (numInstances > allocatedInstances) {
+        // Room to grow, so adding tracks one batch at a time doesn't reallocate every batch.
+        allocatedInstances = max(numInstances, allocatedInstances * 2);
+        glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glState.bufferData(GL_ARRAY_BUFFER, allocatedInstances * instanceBytes, NULL, GL_DYNAMIC_DRAW);
+        firstDirty = 0;
+        endDirty = numInstances;
+    }
+    if (firstDirty >= endDirty) {
+        return 0;
+    }
+    
+    size_t bytes = (endDirty - firstDirty) * instanceBytes;
+    glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glState.bufferSubData(GL_ARRAY_BUFFER, firstDirty * instanceBytes, bytes, &values[firstDirty * components]);
+    firstDirty = endDirty = 0;
+    return bytes;
+}
+
+void InstanceBuffer::bindAttribute(GLint location) const
+{
+    if (location < 0) {
+        return;
+    }
+    GLsizei stride = (GLsizei)(components * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column * 4 < components; ++column) {
+        GLuint columnLocation = (GLuint)location + column;
+        GLint size = (GLint)min(4u, components - column * 4);
+        glEnableVertexAttribArray(columnLocation);
+        glVertexAttribPointer(columnLocation, size, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)(column * 4 * sizeof(float)));
+        glVertexAttribDivisor(columnLocation, 1);
+    }
+}
+
+void InstanceBuffer::markDirty(size_t first, size_t end)
+{
+    if (firstDirty >= endDirty) {
+        firstDirty = first;
+        endDirty = end;
+    } else {
+        firstDirty = min(firstDirty, first);
+        endDirty = max(endDirty, end);
+    }
+}
@@ -0,0 +1,60 @@
+//
+//  InstanceBuffer.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__InstanceBuffer__
+#define __OpenGLApp__InstanceBuffer__
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "GLState.h"
+
+namespace OpenGLApp {
+    
+    // One per-instance vertex attribute for an instanced draw: a float, a vector or a 4-column
+    // matrix per instance. A copy is kept on this side so set() can tell whether anything
+    // actually changed; upload() then sends only the span between the first and last changed
+    // instances, and nothing at all on a frame where nothing moved.
+    class InstanceBuffer
+    {
+    public:
+        // components floats per instance: 3 for a vec3, 16 for a mat4.
+        explicit InstanceBuffer(unsigned int components);
+        ~InstanceBuffer();
+        
+        // Instances past the old count start as zeros and are sent at the next upload().
+        void resize(size_t numInstances);
+        size_t getNumInstances() const;
+        
+        void set(size_t instance, const float* values);
+        
+        // Sends the changed span through glState, reallocating the GL buffer when it has grown.
+        // Returns the bytes sent.
+        size_t upload(GLState& glState);
+        
+        // Points the attribute at location at this buffer, stepping once per instance. A
+        // matrix takes one location per column, from location up. Needs the VAO bound.
+        void bindAttribute(GLint location) const;
+    private:
+        unsigned int components;
+        std::vector<float> values;
+        GLuint buffer;
+        size_t allocatedInstances;
+        size_t firstDirty;
+        size_t endDirty;
+        
+        InstanceBuffer(const InstanceBuffer&);
+        InstanceBuffer& operator=(const InstanceBuffer&);
+        
+        void markDirty(size_t first, size_t end);
+    };
+}
+
+#endif /* defined(__OpenGLApp__InstanceBuffer__) */
@@ -0,0 +1,378 @@
+//
+//  MeshCache.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "RenderCache.h"
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    const char meshFileMagic[4] = { 'O', 'G', 'M', 'S' };
+    // Bump whenever the file layout changes, or what importing and compiling a mesh does to
+    // it, so files written before read as stale.
+    const uint32_t meshFileVersion = 2;
+    const char* meshFileExtension = ".mesh";
+    // Vertex and index data start on this boundary in the file, and so in the mapping.
+    const uint64_t meshFileDataAlignment = 16;
+    
+    // Written in native byte order: the cache never leaves the machine that made it. The
+    // submesh table follows the header, then the vertex data, then the index data.
+    struct MeshFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceModifiedNanos;
+        uint32_t positionFormat;
+        uint32_t normalFormat;
+        uint32_t texcoordFormat;
+        uint32_t hasNormals;
+        uint32_t hasTexcoords;
+        uint32_t stride;
+        uint32_t indexBytes;
+        uint32_t numSubmeshes;
+        float lowest[3];
+        float highest[3];
+        uint64_t numVertices;
+        uint64_t numIndices;
+        uint64_t vertexDataOffset;
+        uint64_t indexDataOffset;
+    };
+    
+    struct MeshFileSubmesh
+    {
+        uint64_t firstIndex;
+        uint64_t numIndices;
+        uint32_t material;
+        uint32_t reserved;
+    };
+    
+    std::atomic<unsigned int> tempFileCounter(0);
+    
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + meshFileDataAlignment - 1) / meshFileDataAlignment * meshFileDataAlignment;
+    }
+    
+    // To the nanosecond where the file system keeps it, so an edit made within the same
+    // second as the last one still reads as a change.
+    int64_t getModifiedNanos(const struct stat& info)
+    {
+#ifdef __APPLE__
+        const struct timespec& modified = info.st_mtimespec;
+#else
+        const struct timespec& modified = info.st_mtim;
+#endif
+        return (int64_t)modified.tv_sec * 1000000000 + (int64_t)modified.tv_nsec;
+    }
+    
+    bool isSameFormats(const MeshFileHeader& header, const VertexFormats& formats)
+    {
+        return header.positionFormat == (uint32_t)formats.position
+            && header.normalFormat == (uint32_t)formats.normal
+            && header.texcoordFormat == (uint32_t)formats.texcoord;
+    }
+    
+    // Checks everything the header says against the file and the indices against the
+    // vertices, since a bad index would have the GPU read past the vertex buffer.
+    bool isValidMeshFile(const MeshFileHeader& header, const uint8_t* file, uint64_t fileSize, const VertexLayout& layout)
+    {
+        if (header.stride != layout.getStride()
+            || (header.indexBytes != 2 && header.indexBytes != 4)
+            || header.numVertices > fileSize || header.numIndices > fileSize || header.numSubmeshes > fileSize
+            || header.numIndices % 3 != 0
+            || (header.indexBytes == 2 && header.numVertices > 0x10000)) {
+            return false;
+        }
+        uint64_t submeshEnd = sizeof(MeshFileHeader) + header.numSubmeshes * sizeof(MeshFileSubmesh);
+        if (header.vertexDataOffset != alignOffset(submeshEnd)
+            || header.indexDataOffset != alignOffset(header.vertexDataOffset + header.numVertices * header.stride)
+            || header.indexDataOffset + header.numIndices * header.indexBytes != fileSize) {
+            return false;
+        }
+        
+        const MeshFileSubmesh* submeshes = (const MeshFileSubmesh*)(file + sizeof(MeshFileHeader));
+        for (uint32_t i = 0; i < header.numSubmeshes; ++i) {
+            if (submeshes[i].firstIndex > header.numIndices || submeshes[i].numIndices > header.numIndices - submeshes[i].firstIndex) {
+                return false;
+            }
+        }
+        
+        const uint8_t* indices = file + header.indexDataOffset;
+        uint64_t highestIndex = 0;
+        if (header.indexBytes == 2) {
+            for (uint64_t i = 0; i < header.numIndices; ++i) {
+                highestIndex = max(highestIndex, (uint64_t)((const uint16_t*)indices)[i]);
+            }
+        } else {
+            for (uint64_t i = 0; i < header.numIndices; ++i) {
+                highestIndex = max(highestIndex, (uint64_t)((const uint32_t*)indices)[i]);
+            }
+        }
+        return header.numIndices == 0 || highestIndex < header.numVertices;
+    }
+    
+    bool writePadding(FILE* fp, uint64_t& offset)
+    {
+        static const uint8_t zeros[meshFileDataAlignment] = { 0 };
+        size_t padding = (size_t)(alignOffset(offset) - offset);
+        offset += padding;
+        return fwrite(zeros, 1, padding, fp) == padding;
+    }
+}
+
+CompiledMesh::CompiledMesh(const MeshData& mesh, const VertexFormats& formats) :
+    layout(mesh, formats), submeshes(mesh.submeshes), numVertices(mesh.getNumVertices()),
+    numIndices(mesh.indices.size()), indexBytes(mesh.getIndexBytes()), mapping(NULL), mappingBytes(0)
+{
+    mesh.getBounds(lowest, highest);
+    packedVertices = layout.pack(mesh);
+    packedIndices = mesh.packIndices();
+    vertexData = packedVertices.data();
+    indexData = packedIndices.data();
+}
+
+CompiledMesh::CompiledMesh(const VertexLayout& layout) :
+    layout(layout), numVertices(0), numIndices(0), indexBytes(2), mapping(NULL), mappingBytes(0), vertexData(NULL), indexData(NULL)
+{
+    fill(lowest, lowest + 3, 0.0f);
+    fill(highest, highest + 3, 0.0f);
+}
+
+CompiledMesh::~CompiledMesh()
+{
+    if (mapping) {
+        munmap(mapping, mappingBytes);
+    }
+}
+
+const VertexLayout& CompiledMesh::getLayout() const
+{
+    return layout;
+}
+
+void CompiledMesh::getBounds(float lowestOut[3], float highestOut[3]) const
+{
+    copy(lowest, lowest + 3, lowestOut);
+    copy(highest, highest + 3, highestOut);
+}
+
+const vector<MeshData::Submesh>& CompiledMesh::getSubmeshes() const
+{
+    return submeshes;
+}
+
+size_t CompiledMesh::getNumVertices() const
+{
+    return numVertices;
+}
+
+size_t CompiledMesh::getNumIndices() const
+{
+    return numIndices;
+}
+
+unsigned int CompiledMesh::getIndexBytes() const
+{
+    return indexBytes;
+}
+
+const uint8_t* CompiledMesh::getVertexData() const
+{
+    return vertexData;
+}
+
+const uint8_t* CompiledMesh::getIndexData() const
+{
+    return indexData;
+}
+
+bool CompiledMesh::isMapped() const
+{
+    return mapping != NULL;
+}
+
+std::string MeshCache::getDefaultDirectory()
+{
+    string stems = RenderCache::getDefaultDirectory();
+    return stems.empty() ? stems : stems.substr(0, stems.rfind('/')) + "/meshes";
+}
+
+MeshCache::MeshCache(const std::string& directory) : directory(directory)
+{
+    if (directory.empty()) {
+        throw runtime_error("No mesh cache directory given");
+    }
+    makeDirectories(directory);
+}
+
+const std::string& MeshCache::getDirectory() const
+{
+    return directory;
+}
+
+std::string MeshCache::getPathForSource(const std::string& sourceFile, const VertexFormats& formats) const
+{
+    // Keyed on the source's name, not its contents, so a changed source maps to the same
+    // file and its compiled form replaces the stale one rather than piling up beside it.
+    RenderCacheKey key;
+    key.add(sourceFile);
+    key.add((uint64_t)formats.position);
+    key.add((uint64_t)formats.normal);
+    key.add((uint64_t)formats.texcoord);
+    return directory + "/" + key.toString() + meshFileExtension;
+}
+
+CompiledMesh* MeshCache::load(const std::string& sourceFile, const VertexFormats& formats)
+{
+    struct stat source, info;
+    string path = getPathForSource(sourceFile, formats);
+    int fd = -1;
+    if (stat(sourceFile.c_str(), &source) != 0 || (fd = open(path.c_str(), O_RDONLY)) < 0) {
+        ++stats.misses;
+        return NULL;
+    }
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (uint64_t)info.st_size >= sizeof(MeshFileHeader)) {
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file open for as long as it needs it.
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        unlink(path.c_str());
+        ++stats.misses;
+        return NULL;
+    }
+    
+    size_t fileSize = (size_t)info.st_size;
+    const uint8_t* file = (const uint8_t*)mapping;
+    MeshFileHeader header;
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, meshFileMagic, sizeof(meshFileMagic)) != 0
+        || header.version != meshFileVersion
+        || header.sourceSize != (uint64_t)source.st_size
+        || header.sourceModifiedNanos != getModifiedNanos(source)
+        || !isSameFormats(header, formats)) {
+        // Left for store() to replace.
+        munmap(mapping, fileSize);
+        ++stats.stale;
+        return NULL;
+    }
+    
+    VertexLayout layout(formats, header.hasNormals != 0, header.hasTexcoords != 0, header.lowest, header.highest);
+    if (!isValidMeshFile(header, file, fileSize, layout)) {
+        munmap(mapping, fileSize);
+        unlink(path.c_str());
+        ++stats.misses;
+        return NULL;
+    }
+    
+    CompiledMesh* mesh = new CompiledMesh(layout);
+    copy(header.lowest, header.lowest + 3, mesh->lowest);
+    copy(header.highest, header.highest + 3, mesh->highest);
+    const MeshFileSubmesh* submeshes = (const MeshFileSubmesh*)(file + sizeof(MeshFileHeader));
+    for (uint32_t i = 0; i < header.numSubmeshes; ++i) {
+        MeshData::Submesh submesh = { (size_t)submeshes[i].firstIndex, (size_t)submeshes[i].numIndices, submeshes[i].material };
+        mesh->submeshes.push_back(submesh);
+    }
+    mesh->numVertices = (size_t)header.numVertices;
+    mesh->numIndices = (size_t)header.numIndices;
+    mesh->indexBytes = header.indexBytes;
+    mesh->mapping = mapping;
+    mesh->mappingBytes = fileSize;
+    mesh->vertexData = file + header.vertexDataOffset;
+    mesh->indexData = file + header.indexDataOffset;
+    
+    ++stats.hits;
+    stats.bytesMapped += fileSize;
+    return mesh;
+}
+
+bool MeshCache::store(const std::string& sourceFile, const CompiledMesh& mesh)
+{
+    struct stat source;
+    if (stat(sourceFile.c_str(), &source) != 0) {
+        return false;
+    }
+    const VertexLayout& layout = mesh.getLayout();
+    string path = getPathForSource(sourceFile, layout.getFormats());
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.%u.tmp", (long)getpid(), tempFileCounter++);
+    string tempPath = path + suffix;
+    
+    FILE* fp = fopen(tempPath.c_str(), "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshFileMagic, sizeof(meshFileMagic));
+    header.version = meshFileVersion;
+    header.sourceSize = (uint64_t)source.st_size;
+    header.sourceModifiedNanos = getModifiedNanos(source);
+    header.positionFormat = (uint32_t)layout.getFormats().position;
+    header.normalFormat = (uint32_t)layout.getFormats().normal;
+    header.texcoordFormat = (uint32_t)layout.getFormats().texcoord;
+    header.hasNormals = layout.hasAttribute(VertexLayout::Normal);
+    header.hasTexcoords = layout.hasAttribute(VertexLayout::Texcoord);
+    header.stride = (uint32_t)layout.getStride();
+    header.indexBytes = mesh.getIndexBytes();
+    header.numSubmeshes = (uint32_t)mesh.getSubmeshes().size();
+    mesh.getBounds(header.lowest, header.highest);
+    header.numVertices = mesh.getNumVertices();
+    header.numIndices = mesh.getNumIndices();
+    header.vertexDataOffset = alignOffset(sizeof(header) + header.numSubmeshes * sizeof(MeshFileSubmesh));
+    header.indexDataOffset = alignOffset(header.vertexDataOffset + header.numVertices * header.stride);
+    
+    vector<MeshFileSubmesh> submeshes;
+    for (const MeshData::Submesh& submesh : mesh.getSubmeshes()) {
+        MeshFileSubmesh fileSubmesh = { submesh.firstIndex, submesh.numIndices, submesh.material, 0 };
+        submeshes.push_back(fileSubmesh);
+    }
+    
+    size_t vertexBytes = mesh.getNumVertices() * layout.getStride();
+    size_t indexBytes = mesh.getNumIndices() * mesh.getIndexBytes();
+    uint64_t offset = sizeof(header) + submeshes.size() * sizeof(MeshFileSubmesh);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(submeshes.data(), sizeof(MeshFileSubmesh), submeshes.size(), fp) == submeshes.size()
+        && writePadding(fp, offset)
+        && fwrite(mesh.getVertexData(), 1, vertexBytes, fp) == vertexBytes;
+    offset += vertexBytes;
+    ok = ok && writePadding(fp, offset)
+        && fwrite(mesh.getIndexData(), 1, indexBytes, fp) == indexBytes;
+    ok = (fclose(fp) == 0) && ok;
+    
+    // rename() replaces the target atomically, so a reader sees the old file or the new one.
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    ++stats.stores;
+    stats.bytesWritten += offset + indexBytes;
+    return true;
+}
+
+MeshCache::Stats MeshCache::getStats() const
+{
+    return stats;
+}
@@ -0,0 +1,114 @@
+//
+//  MeshCache.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__MeshCache__
+#define __OpenGLApp__MeshCache__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MeshData.h"
+#include "VertexLayout.h"
+
+namespace OpenGLApp {
+    
+    // A mesh in the form the GPU takes it: interleaved vertices in a VertexLayout and packed
+    // indices, ready to hand to glBufferData() as they are. Either packed here from a
+    // MeshData or mapped straight from a MeshCache file, in which case the data stays in the
+    // page cache and is only read when it's uploaded.
+    class CompiledMesh
+    {
+    public:
+        CompiledMesh(const MeshData& mesh, const VertexFormats& formats);
+        ~CompiledMesh();
+        
+        const VertexLayout& getLayout() const;
+        void getBounds(float lowest[3], float highest[3]) const;
+        const std::vector<MeshData::Submesh>& getSubmeshes() const;
+        
+        size_t getNumVertices() const;
+        size_t getNumIndices() const;
+        // 2 or 4.
+        unsigned int getIndexBytes() const;
+        
+        // getNumVertices() * getLayout().getStride() bytes.
+        const uint8_t* getVertexData() const;
+        // getNumIndices() * getIndexBytes() bytes.
+        const uint8_t* getIndexData() const;
+        
+        bool isMapped() const;
+    private:
+        friend class MeshCache;
+        
+        VertexLayout layout;
+        float lowest[3];
+        float highest[3];
+        std::vector<MeshData::Submesh> submeshes;
+        size_t numVertices;
+        size_t numIndices;
+        unsigned int indexBytes;
+        
+        std::vector<uint8_t> packedVertices;
+        std::vector<uint8_t> packedIndices;
+        void* mapping;
+        size_t mappingBytes;
+        const uint8_t* vertexData;
+        const uint8_t* indexData;
+        
+        // For MeshCache::load(), which fills in the rest from the file it maps.
+        explicit CompiledMesh(const VertexLayout& layout);
+        CompiledMesh(const CompiledMesh&);
+        CompiledMesh& operator=(const CompiledMesh&);
+    };
+    
+    // Compiled meshes on disk, one file per source mesh and set of vertex formats, so a launch
+    // after the first maps them instead of parsing the source through Assimp. Each file
+    // records the size and modification time of the source it came from; once the source
+    // changes the file is stale, and the next store() replaces it. Files are written under a
+    // temporary name and renamed into place, as RenderCache's are.
+    //
+    // Only used from the main thread while the scene loads, so there's no locking.
+    class MeshCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t stale = 0;
+            uint64_t stores = 0;
+            uint64_t bytesMapped = 0;
+            uint64_t bytesWritten = 0;
+        };
+        
+        // A meshes directory alongside RenderCache's stems one. Empty if there's no home
+        // directory to put it in.
+        static std::string getDefaultDirectory();
+        
+        explicit MeshCache(const std::string& directory);
+        
+        const std::string& getDirectory() const;
+        
+        // The compiled form of sourceFile in formats, mapped from its file, or NULL if there
+        // isn't one from since the source last changed. Unreadable files are deleted. The
+        // caller owns the result.
+        CompiledMesh* load(const std::string& sourceFile, const VertexFormats& formats);
+        bool store(const std::string& sourceFile, const CompiledMesh& mesh);
+        
+        Stats getStats() const;
+    private:
+        std::string directory;
+        Stats stats;
+        
+        std::string getPathForSource(const std::string& sourceFile, const VertexFormats& formats) const;
+    };
+}
+
+#endif /* defined(__OpenGLApp__MeshCache__) */
@@ -0,0 +1,308 @@
+//
+//  MeshData.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "MeshData.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // Forsyth's tuning, from "Linear-Speed Vertex Cache Optimisation". The scoring models an
+    // LRU cache bigger than the FIFO the result is measured against, which is what he found
+    // works best across hardware.
+    const int scoringCacheSize = 32;
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+    
+    // How much a vertex wants to be used next: more the more recently it was used, and more
+    // the fewer triangles still need it, so that lone triangles aren't left behind.
+    float scoreVertex(int cachePosition, uint32_t remainingTriangles)
+    {
+        if (remainingTriangles == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // The triangle just drawn; scored a little lower so the next one doesn't
+                // always go straight back over the same edge.
+                score = lastTriangleScore;
+            } else {
+                float scale = 1.0f / (scoringCacheSize - 3);
+                score = pow(1.0f - (cachePosition - 3) * scale, cacheDecayPower);
+            }
+        }
+        return score + valenceBoostScale * pow((float)remainingTriangles, -valenceBoostPower);
+    }
+    
+    // Orders vertices by their attributes, bit for bit, so equal ones end up side by side.
+    struct VertexLess
+    {
+        const MeshData& mesh;
+        
+        bool operator()(uint32_t a, uint32_t b) const
+        {
+            int order = memcmp(&mesh.positions[a * 3], &mesh.positions[b * 3], 3 * sizeof(float));
+            if (order == 0 && !mesh.normals.empty()) {
+                order = memcmp(&mesh.normals[a * 3], &mesh.normals[b * 3], 3 * sizeof(float));
+            }
+            if (order == 0 && !mesh.texcoords.empty()) {
+                order = memcmp(&mesh.texcoords[a * 2], &mesh.texcoords[b * 2], 2 * sizeof(float));
+            }
+            return order < 0;
+        }
+    };
+    
+    // Rebuilds the vertex arrays so new vertex remap[i] is old vertex i, dropping those whose
+    // remap is ~0, and renumbers the indices to match.
+    void remapVertices(MeshData& mesh, const vector<uint32_t>& remap, size_t numNewVertices)
+    {
+        const uint32_t unused = ~0u;
+        vector<float> positions(numNewVertices * 3);
+        vector<float> normals(mesh.normals.empty() ? 0 : numNewVertices * 3);
+        vector<float> texcoords(mesh.texcoords.empty() ? 0 : numNewVertices * 2);
+        for (size_t i = 0; i < remap.size(); ++i) {
+            if (remap[i] == unused) {
+                continue;
+            }
+            copy(&mesh.positions[i * 3], &mesh.positions[i * 3] + 3, &positions[remap[i] * 3]);
+            if (!normals.empty()) {
+                copy(&mesh.normals[i * 3], &mesh.normals[i * 3] + 3, &normals[remap[i] * 3]);
+            }
+            if (!texcoords.empty()) {
+                copy(&mesh.texcoords[i * 2], &mesh.texcoords[i * 2] + 2, &texcoords[remap[i] * 2]);
+            }
+        }
+        mesh.positions.swap(positions);
+        mesh.normals.swap(normals);
+        mesh.texcoords.swap(texcoords);
+        for (uint32_t& index : mesh.indices) {
+            index = remap[index];
+        }
+    }
+    
+    // Forsyth's algorithm over one run of triangles, writing the new order to optimized.
+    void optimizeTriangleOrder(const uint32_t* indices, size_t numTriangles, size_t numVertices, uint32_t* optimized)
+    {
+        // Each vertex's triangles, packed one vertex after another. The first remaining[v] of
+        // a vertex's entries are the triangles not yet emitted.
+        vector<uint32_t> remaining(numVertices, 0);
+        for (size_t i = 0; i < numTriangles * 3; ++i) {
+            ++remaining[indices[i]];
+        }
+        vector<uint32_t> firstTriangle(numVertices + 1, 0);
+        for (size_t v = 0; v < numVertices; ++v) {
+            firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+        }
+        vector<uint32_t> vertexTriangles(numTriangles * 3);
+        vector<uint32_t> filled(numVertices, 0);
+        for (size_t t = 0; t < numTriangles; ++t) {
+            for (int corner = 0; corner < 3; ++corner) {
+                uint32_t v = indices[t * 3 + corner];
+                vertexTriangles[firstTriangle[v] + filled[v]++] = (uint32_t)t;
+            }
+        }
+        
+        vector<float> vertexScore(numVertices);
+        for (size_t v = 0; v < numVertices; ++v) {
+            vertexScore[v] = scoreVertex(-1, remaining[v]);
+        }
+        vector<bool> emitted(numTriangles, false);
+        vector<uint32_t> cache, newCache;
+        cache.reserve(scoringCacheSize + 3);
+        newCache.reserve(scoringCacheSize + 3);
+        
+        size_t nextUnemitted = 0;
+        long best = -1;
+        for (size_t count = 0; count < numTriangles; ++count) {
+            if (best < 0) {
+                // Nothing in the cache has triangles left: carry on with the next one in the
+                // original order, which keeps the whole thing linear.
+                while (emitted[nextUnemitted]) {
+                    ++nextUnemitted;
+                }
+                best = (long)nextUnemitted;
+            }
+            emitted[best] = true;
+            const uint32_t* triangle = &indices[best * 3];
+            copy(triangle, triangle + 3, optimized + count * 3);
+            
+            // Take the triangle off its vertices' lists.
+            for (int corner = 0; corner < 3; ++corner) {
+                uint32_t v = triangle[corner];
+                uint32_t* list = &vertexTriangles[firstTriangle[v]];
+                uint32_t* last = list + remaining[v] - 1;
+                *find(list, last, (uint32_t)best) = *last;
+                *last = (uint32_t)best;
+                --remaining[v];
+            }
+            
+            // The triangle's vertices go to the front of the cache; whatever is pushed off the
+            // end is no longer cached.
+            newCache.assign(triangle, triangle + 3);
+            for (uint32_t v : cache) {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                    newCache.push_back(v);
+                }
+            }
+            for (size_t i = scoringCacheSize; i < newCache.size(); ++i) {
+                vertexScore[newCache[i]] = scoreVertex(-1, remaining[newCache[i]]);
+            }
+            newCache.resize(min(newCache.size(), (size_t)scoringCacheSize));
+            cache.swap(newCache);
+            for (size_t i = 0; i < cache.size(); ++i) {
+                vertexScore[cache[i]] = scoreVertex((int)i, remaining[cache[i]]);
+            }
+            
+            // Only triangles touching the cache can have had their score change, so the next
+            // one is the best of those.
+            best = -1;
+            float bestScore = 0.0f;
+            for (uint32_t v : cache) {
+                for (uint32_t i = 0; i < remaining[v]; ++i) {
+                    uint32_t t = vertexTriangles[firstTriangle[v] + i];
+                    float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    if (best < 0 || score > bestScore) {
+                        best = (long)t;
+                        bestScore = score;
+                    }
+                }
+            }
+        }
+    }
+}
+
+size_t MeshData::getNumVertices() const
+{
+    return positions.size() / 3;
+}
+
+size_t MeshData::getNumTriangles() const
+{
+    return indices.size() / 3;
+}
+
+void MeshData::getBounds(float lowest[3], float highest[3]) const
+{
+    fill(lowest, lowest + 3, 0.0f);
+    fill(highest, highest + 3, 0.0f);
+    for (size_t v = 0; v < getNumVertices(); ++v) {
+        for (int axis = 0; axis < 3; ++axis) {
+            float value = positions[v * 3 + axis];
+            lowest[axis] = v == 0 ? value : min(lowest[axis], value);
+            highest[axis] = v == 0 ? value : max(highest[axis], value);
+        }
+    }
+}
+
+unsigned int MeshData::getIndexBytes() const
+{
+    return getNumVertices() <= 0x10000 ? 2 : 4;
+}
+
+vector<uint8_t> MeshData::packIndices() const
+{
+    unsigned int indexBytes = getIndexBytes();
+    vector<uint8_t> packed(indices.size() * indexBytes);
+    if (indexBytes == 4) {
+        if (!indices.empty()) {
+            memcpy(&packed[0], &indices[0], packed.size());
+        }
+        return packed;
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint16_t index = (uint16_t)indices[i];
+        memcpy(&packed[i * 2], &index, sizeof(index));
+    }
+    return packed;
+}
+
+void OpenGLApp::weldVertices(MeshData& mesh)
+{
+    size_t numVertices = mesh.getNumVertices();
+    vector<uint32_t> sorted(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        sorted[i] = (uint32_t)i;
+    }
+    VertexLess less = { mesh };
+    // Stable, so the first of each run of equal vertices is the one that appeared first.
+    stable_sort(sorted.begin(), sorted.end(), less);
+    
+    // Every vertex points at the first copy of itself, then the first copies are numbered
+    // in their original order.
+    vector<uint32_t> survivor(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        bool isFirst = i == 0 || less(sorted[i - 1], sorted[i]);
+        survivor[sorted[i]] = isFirst ? sorted[i] : survivor[sorted[i - 1]];
+    }
+    vector<uint32_t> remap(numVertices, ~0u);
+    uint32_t numWelded = 0;
+    for (size_t i = 0; i < numVertices; ++i) {
+        if (survivor[i] == i) {
+            remap[i] = numWelded++;
+        }
+    }
+    for (size_t i = 0; i < numVertices; ++i) {
+        remap[i] = remap[survivor[i]];
+    }
+    
+    // remapVertices() copies each survivor as many times as it has duplicates; they're all
+    // the same, so it doesn't matter which copy lands last.
+    remapVertices(mesh, remap, numWelded);
+}
+
+void OpenGLApp::optimizeVertexCache(MeshData& mesh)
+{
+    vector<uint32_t> optimized(mesh.indices.size());
+    if (mesh.submeshes.empty()) {
+        optimizeTriangleOrder(mesh.indices.data(), mesh.getNumTriangles(), mesh.getNumVertices(), optimized.data());
+    }
+    for (const MeshData::Submesh& submesh : mesh.submeshes) {
+        optimizeTriangleOrder(&mesh.indices[submesh.firstIndex], submesh.numIndices / 3, mesh.getNumVertices(), &optimized[submesh.firstIndex]);
+    }
+    mesh.indices.swap(optimized);
+}
+
+void OpenGLApp::optimizeVertexFetch(MeshData& mesh)
+{
+    size_t numVertices = mesh.getNumVertices();
+    vector<uint32_t> remap(numVertices, ~0u);
+    uint32_t numUsed = 0;
+    for (uint32_t index : mesh.indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = numUsed++;
+        }
+    }
+    remapVertices(mesh, remap, numUsed);
+}
+
+double OpenGLApp::computeAcmr(const MeshData& mesh, unsigned int cacheSize)
+{
+    size_t numTriangles = mesh.getNumTriangles();
+    if (numTriangles == 0) {
+        return 0.0;
+    }
+    // A vertex is still in the FIFO while fewer than cacheSize misses have come after the
+    // one that put it there.
+    vector<uint64_t> missWhenCached(mesh.getNumVertices(), 0);
+    uint64_t misses = 0;
+    for (size_t i = 0; i < numTriangles * 3; ++i) {
+        uint32_t v = mesh.indices[i];
+        if (missWhenCached[v] == 0 || misses - missWhenCached[v] >= cacheSize) {
+            ++misses;
+            missWhenCached[v] = misses;
+        }
+    }
+    return (double)misses / numTriangles;
+}
@@ -0,0 +1,72 @@
+//
+//  MeshData.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__MeshData__
+#define __OpenGLApp__MeshData__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OpenGLApp {
+    
+    // An indexed triangle mesh as it comes out of the importer, one float array per attribute.
+    // normals and texcoords are either empty or have an entry for every vertex.
+    struct MeshData
+    {
+        // The run of indices that came from one mesh of the source file. All of them share
+        // the one set of vertices.
+        struct Submesh
+        {
+            size_t firstIndex;
+            size_t numIndices;
+            unsigned int material;
+        };
+        
+        std::vector<float> positions;   // 3 per vertex
+        std::vector<float> normals;     // 3 per vertex
+        std::vector<float> texcoords;   // 2 per vertex
+        std::vector<uint32_t> indices;  // 3 per triangle
+        std::vector<Submesh> submeshes; // empty means all the indices are one
+        
+        size_t getNumVertices() const;
+        size_t getNumTriangles() const;
+        
+        // The smallest box around the positions; all zeros for an empty mesh.
+        void getBounds(float lowest[3], float highest[3]) const;
+        
+        // 2 when every index fits in 16 bits, so the index buffer can be half the size; else 4.
+        unsigned int getIndexBytes() const;
+        
+        // The indices at getIndexBytes() each, ready for an element buffer.
+        std::vector<uint8_t> packIndices() const;
+    };
+    
+    // What the vertex cache optimisation is measured and tuned against: a FIFO of this many
+    // transformed vertices, about what GPUs since the DX10 generation keep.
+    const unsigned int vertexCacheSize = 16;
+    
+    // Merges vertices whose position, normal and texcoord are bit-for-bit the same and points
+    // the indices at the survivors, which keep the order they first appeared in.
+    void weldVertices(MeshData& mesh);
+    
+    // Reorders the triangles so each reuses as many vertices as it can from those the last
+    // few transformed (Forsyth's linear-speed algorithm). Only the triangle order changes,
+    // and only within each submesh.
+    void optimizeVertexCache(MeshData& mesh);
+    
+    // Renumbers the vertices in the order the triangles first use them, so vertex fetch walks
+    // the buffers forwards. Run it after optimizeVertexCache().
+    void optimizeVertexFetch(MeshData& mesh);
+    
+    // Average cache miss ratio: vertices transformed per triangle drawn through a FIFO of
+    // cacheSize vertices. 3 is no reuse at all; a well-ordered regular grid approaches 0.5.
+    double computeAcmr(const MeshData& mesh, unsigned int cacheSize = vertexCacheSize);
+}
+
+#endif /* defined(__OpenGLApp__MeshData__) */
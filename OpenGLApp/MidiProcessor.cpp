@@ -7,14 +7,97 @@
 //
 
 #include "MidiProcessor.h"
+#include "WavFile.h"
+#include "WorkerPool.h"
 
+#include <chrono>
+#include <cmath>
 #include <exception>
+#include <iomanip>
+#include <memory>
 
 using namespace jdksmidi;
 using namespace std;
 using namespace OpenGLApp;
 
-MidiProcessor::MidiProcessor(string inputFilename) : inStream(MIDIFileReadStreamFile(inputFilename.c_str())), inFilename(inputFilename)
+namespace {
+    // Output below this level (about -80 dBFS) counts as the end of a release tail.
+    const float tailSilenceLevel = 1e-4f;
+    
+    // Bump whenever a change to the renderers would make existing cache entries sound different.
+    const uint64_t renderCacheVersion = 2;
+    
+    // A block from the synth, rendered in mono when right is null.
+    void appendBlock(AudioStem& stem, const float* left, const float* right, size_t numFrames)
+    {
+        if (right) {
+            stem.appendStereo(left, right, numFrames);
+        } else {
+            stem.appendMono(left, numFrames);
+        }
+    }
+    
+    // Feeds an event exactly as it goes into a split track into that track's cache key.
+    void addEventToKey(RenderCacheKey& key, const MIDITimedBigMessage& msg)
+    {
+        key.add((uint64_t)msg.GetTime());
+        unsigned char bytes[4] = { msg.GetStatus(), msg.GetByte1(), msg.GetByte2(), msg.GetByte3() };
+        key.add(bytes, sizeof(bytes));
+        const MIDISystemExclusive* sysex = msg.GetSysEx();
+        if (sysex) {
+            key.add((uint64_t)sysex->GetLength());
+            key.add(sysex->GetBuf(), sysex->GetLength());
+        }
+    }
+    
+    // Collects a written SMF in memory. MIDIFileWrite seeks back to patch the track
+    // length once the track is finished, so writes may land inside the buffer too.
+    class MIDIFileWriteStreamMemory : public MIDIFileWriteStream
+    {
+    public:
+        MIDIFileWriteStreamMemory(std::vector<unsigned char>& buffer) : buffer(buffer), pos(0)
+        {
+            buffer.clear();
+        }
+        
+        long Seek(long offset, int whence)
+        {
+            long newPos;
+            switch (whence) {
+                case SEEK_SET:
+                    newPos = offset;
+                    break;
+                case SEEK_CUR:
+                    newPos = pos + offset;
+                    break;
+                case SEEK_END:
+                    newPos = (long)buffer.size() + offset;
+                    break;
+                default:
+                    return -1;
+            }
+            if (newPos < 0) {
+                return -1;
+            }
+            pos = newPos;
+            return 0;
+        }
+        
+        int WriteChar(int c)
+        {
+            if ((size_t)pos >= buffer.size()) {
+                buffer.resize(pos + 1);
+            }
+            buffer[pos++] = (unsigned char)c;
+            return c;
+        }
+    private:
+        std::vector<unsigned char>& buffer;
+        long pos;
+    };
+}
+
+MidiProcessor::MidiProcessor(string inputFilename) : inStream(MIDIFileReadStreamFile(inputFilename.c_str())), inFilename(inputFilename), conversionCancelled(false)
 {
 }
 
@@ -23,6 +106,7 @@ bool MidiProcessor::isValid()
     return this->inStream.IsValid();
 }
 
+#if OPENGLAPP_HAS_AUDIOTOOLBOX
 OSStatus MidiProcessor::GetSynthFromGraph(AUGraph &inGraph, AudioUnit &outSynth)
 {
     UInt32 numNodes;
@@ -45,10 +129,56 @@ OSStatus MidiProcessor::GetSynthFromGraph(AUGraph &inGraph, AudioUnit &outSynth)
 fail:
     return -1;
 }
+#endif
+
+const TempoMap& MidiProcessor::getTempoMap()
+{
+    return tempoMap;
+}
+
+MidiProcessor::~MidiProcessor()
+{
+    if (conversionThread.joinable()) {
+        conversionThread.join();
+    }
+}
 
 int MidiProcessor::getNumTracks()
 {
-    return convertedFilenames.size();
+    return trackFilenames.size();
+}
+
+const std::vector<AudioStem>& MidiProcessor::getTrackStems()
+{
+    return trackStems;
+}
+
+void MidiProcessor::setStemFormat(const AudioFormat& format)
+{
+    if (!format.isValid()) {
+        throw runtime_error("Stems must be mono or stereo at a sample rate between 1 and 192 kHz");
+    }
+    stemFormat = format;
+}
+
+const AudioFormat& MidiProcessor::getStemFormat()
+{
+    return stemFormat;
+}
+
+void MidiProcessor::setStemChannels(unsigned int channels)
+{
+    setStemFormat(AudioFormat(stemFormat.sampleRate, channels));
+}
+
+void MidiProcessor::setExportWavFiles(bool exportFiles)
+{
+    exportWavFiles = exportFiles;
+}
+
+void MidiProcessor::setMixdownPath(const std::string& path)
+{
+    mixdownPath = path;
 }
 
 std::vector<std::string> MidiProcessor::getConvertedTrackNames()
@@ -56,6 +186,56 @@ std::vector<std::string> MidiProcessor::getConvertedTrackNames()
     return convertedFilenames;
 }
 
+void MidiProcessor::setSplitInMemory(bool inMemory)
+{
+    splitInMemory = inMemory;
+}
+
+void MidiProcessor::setNumConversionWorkers(unsigned int numWorkers)
+{
+    numConversionWorkers = numWorkers;
+}
+
+std::vector<double> MidiProcessor::getTrackConversionTimes()
+{
+    return trackConversionTimes;
+}
+
+std::vector<double> MidiProcessor::getTrackRenderedSeconds()
+{
+    return trackRenderedSeconds;
+}
+
+void MidiProcessor::setRenderBackend(RenderBackend backend)
+{
+#if !OPENGLAPP_HAS_AUDIOTOOLBOX
+    if (backend == RenderBackend::AudioToolbox) {
+        throw runtime_error("The AudioToolbox render backend is not available on this platform");
+    }
+#endif
+    renderBackend = backend;
+}
+
+MidiProcessor::RenderBackend MidiProcessor::getRenderBackend()
+{
+    return renderBackend;
+}
+
+void MidiProcessor::setRenderCacheDirectory(const std::string& directory, uint64_t maxBytes)
+{
+    if (directory.empty()) {
+        renderCache.reset();
+    } else {
+        renderCache.reset(new RenderCache(directory, maxBytes));
+    }
+}
+
+const RenderCache* MidiProcessor::getRenderCache()
+{
+    return renderCache.get();
+}
+
+#if OPENGLAPP_HAS_AUDIOTOOLBOX
 OSStatus MidiProcessor::SetUpGraph(AUGraph &inGraph, UInt32 numFrames, Float64 &sampleRate)
 {
     OSStatus res = noErr;
@@ -130,37 +310,27 @@ home:
     return res;
 }
 
-void MidiProcessor::WriteConvertedOutputFile(std::string outputFilePath, OSType dataFormat, Float64 sampleRate, MusicTimeStamp sequenceLength, AUGraph inputGraph, UInt32 numFrames, MusicPlayer player)
+OSStatus MidiProcessor::LoadMusicSequence(const std::vector<unsigned char>& smfData, MusicSequence &seq, MusicSequenceLoadFlags loadFlags)
 {
-    OSStatus res = 0;
-    UInt32 size;
+    OSStatus res = noErr;
+    CFDataRef data = NULL;
     
-    CAStreamBasicDescription outputFormat;
-    outputFormat.mChannelsPerFrame = 2;
-    outputFormat.mSampleRate = sampleRate;
-    outputFormat.mFormatID = dataFormat;
+    FailIf((res = NewMusicSequence(&seq)), home, "NewMusicSequence");
     
-    AudioFileTypeID destFileType;
-    CAAudioFileFormats::Instance()->InferFileFormatFromFilename(outputFilePath.c_str(), destFileType);
+    // The bytes stay owned by trackData, so wrap them without copying.
+    data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, smfData.data(), smfData.size(), kCFAllocatorNull);
     
-    outputFormat.mBytesPerPacket = outputFormat.mChannelsPerFrame * 2;
-    outputFormat.mFramesPerPacket = 1;
-    outputFormat.mBytesPerFrame = outputFormat.mBytesPerPacket;
-    outputFormat.mBitsPerChannel = 16;
+    FailIf((res = MusicSequenceFileLoadData(seq, data, kMusicSequenceFile_MIDIType, loadFlags)), home, "MusicSequenceFileLoadData");
     
-    if (destFileType == kAudioFileWAVEType) {
-        outputFormat.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
-    } else {
-        outputFormat.mFormatFlags = kLinearPCMFormatFlagIsBigEndian
-        | kLinearPCMFormatFlagIsSignedInteger
-        | kLinearPCMFormatFlagIsPacked;
-    }
-    
-    CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8*)outputFilePath.c_str(), outputFilePath.length(), false);
-    
-    ExtAudioFileRef outfile;
-    res = ExtAudioFileCreateWithURL(url, destFileType, &outputFormat, NULL, kAudioFileFlags_EraseFile, &outfile);
-    if (url) CFRelease(url);
+home:
+    if (data) CFRelease(data);
+    return res;
+}
+
+UInt64 MidiProcessor::RenderGraphToStem(AUGraph inputGraph, UInt64 endFrame, UInt64 maxTailFrames, UInt32 numFrames, AudioStem& stem)
+{
+    OSStatus res = 0;
+    UInt32 size;
     
     AudioUnit outputUnit = NULL;
     UInt32 nodeCount;
@@ -185,53 +355,92 @@ void MidiProcessor::WriteConvertedOutputFile(std::string outputFilePath, OSType
         size = sizeof(clientFormat);
         
         FailIf((res = AudioUnitGetProperty(outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &clientFormat, &size)), fail, "AudioUnitGetProperty: kAudioUnitProperty_StreamFormat");
-        size = sizeof(clientFormat);
-        FailIf((res = ExtAudioFileSetProperty(outfile, kExtAudioFileProperty_ClientDataFormat, size, &clientFormat)), fail, "ExtAudioFileSetProperty: kExtAudioFileProperty_ClientDataFormat");
+        
+        // The generic output unit renders the canonical AU format: 32-bit float, normally deinterleaved.
+        FailIf((res = (!(clientFormat.mFormatFlags & kAudioFormatFlagIsFloat) || clientFormat.mBitsPerChannel != 32)), fail, "Unexpected output unit stream format");
+        // SetUpGraph() asked for the stem rate; anything else would need a conversion we don't do.
+        FailIf((res = (clientFormat.mSampleRate != stem.sampleRate)), fail, "Output unit isn't rendering at the stem sample rate");
         {
-            MusicTimeStamp currentTime;
             AUOutputBL outputBuffer (clientFormat, numFrames);
             AudioTimeStamp tStamp;
             memset(&tStamp, 0, sizeof(AudioTimeStamp));
             tStamp.mFlags = kAudioTimeStampSampleTimeValid;
-            do {
-                outputBuffer.Prepare();
-                AudioUnitRenderActionFlags actionFlags = 0;
-                FailIf((res = AudioUnitRender(outputUnit, &actionFlags, &tStamp, 0, numFrames, outputBuffer.ABL())), fail, "AudioUnitRender");
+            
+            UInt32 channels = clientFormat.NumberChannels();
+            UInt32 rightChannel = channels > 1 ? 1 : 0;
+            vector<float> left(numFrames), right(numFrames);
+            
+            // The body runs to exactly endFrame, which the tempo map gives us up front; after that,
+            // blocks are kept only while the synth is still audibly releasing notes.
+            UInt64 frame = 0;
+            UInt64 tailEnd = endFrame + maxTailFrames;
+            while (frame < tailEnd) {
+                UInt32 blockFrames = (UInt32)min((UInt64)numFrames, (frame < endFrame ? endFrame : tailEnd) - frame);
                 
-                tStamp.mSampleTime += numFrames;
+                outputBuffer.Prepare(blockFrames);
+                AudioUnitRenderActionFlags actionFlags = 0;
+                FailIf((res = AudioUnitRender(outputUnit, &actionFlags, &tStamp, 0, blockFrames, outputBuffer.ABL())), fail, "AudioUnitRender");
+                tStamp.mSampleTime += blockFrames;
                 
-                FailIf((res = ExtAudioFileWrite(outfile, numFrames, outputBuffer.ABL())), fail, "ExtAudioFileWrite");
+                const AudioBufferList* abl = outputBuffer.ABL();
+                const float* blockLeft;
+                const float* blockRight;
+                if (clientFormat.IsInterleaved()) {
+                    const float* data = (const float*)abl->mBuffers[0].mData;
+                    for (UInt32 i = 0; i < blockFrames; ++i) {
+                        left[i] = data[i * channels];
+                        right[i] = data[i * channels + rightChannel];
+                    }
+                    blockLeft = left.data();
+                    blockRight = right.data();
+                } else {
+                    blockLeft = (const float*)abl->mBuffers[0].mData;
+                    blockRight = (const float*)abl->mBuffers[rightChannel].mData;
+                }
                 
-                FailIf((res = MusicPlayerGetTime(player, &currentTime)), fail, "MusicPlayerGetTime");
-            } while (currentTime < sequenceLength);
+                if (frame >= endFrame) {
+                    float peak = 0.0f;
+                    for (UInt32 i = 0; i < blockFrames; ++i) {
+                        peak = max(peak, max(fabsf(blockLeft[i]), fabsf(blockRight[i])));
+                    }
+                    if (peak < tailSilenceLevel) {
+                        break;
+                    }
+                    stem.appendStereo(blockLeft, blockRight, blockFrames);
+                } else {
+                    stem.appendStereo(blockLeft, blockRight, blockFrames);
+                }
+                frame += blockFrames;
+            }
         }
     }
     
-    ExtAudioFileDispose(outfile);
-    
-    return;
+    return stem.getNumFrames();
     
 fail:
     printf("Problem: %ld\n", (long)res);
     exit(1);
 }
 
-void MidiProcessor::convertTrack(std::string filepath)
+double MidiProcessor::convertTrackWithAudioToolbox(size_t trackIndex, const AudioFormat& format, AudioStem& stem)
 {
     OSStatus res;
     MusicSequence seq;
     
     Float32 maxCPULoad = .8;
     
-    FailIf((res = LoadMusicSequence(filepath, seq, 0)), fail, "LoadMusicSequence");
+    const std::string& filepath = trackFilenames[trackIndex];
+    
+    if (trackData[trackIndex].empty()) {
+        FailIf((res = LoadMusicSequence(filepath, seq, 0)), fail, "LoadMusicSequence");
+    } else {
+        FailIf((res = LoadMusicSequence(trackData[trackIndex], seq, 0)), fail, "LoadMusicSequence");
+    }
     
     {
         AUGraph graph = 0;
         AudioUnit synth = 0;
         
-        OSType dataFormat = 0;
-        StrToOSType("lpcm", dataFormat);
-        
         FailIf((res = MusicSequenceGetAUGraph(seq, &graph)), fail, "MusicSequenceGetAUGraph");
         
         FailIf((res = AUGraphOpen(graph)), fail, "AUGraphOpen");
@@ -246,21 +455,12 @@ void MidiProcessor::convertTrack(std::string filepath)
             FailIf((res = AudioUnitSetProperty(synth, kAudioUnitProperty_OfflineRender, kAudioUnitScope_Global, 0, &val, sizeof(val))), fail, "AudioUnitySetProperty: kAudioUnitProperty_OfflineRender");
         }
         
-        FailIf((res = SetUpGraph(graph, numFrames, sampleRate)), fail, "SetUpGraph");
+        FailIf((res = SetUpGraph(graph, numFrames, stemFormat.sampleRate)), fail, "SetUpGraph");
         
         MusicPlayer player;
         FailIf((res = NewMusicPlayer(&player)), fail, "NewMusicPlayer");
         FailIf((res = MusicPlayerSetSequence(player, seq)), fail, "MusicPlayerSetSequence");
         
-        MusicTimeStamp sequenceLength = 0;
-        
-        MusicTrack track;
-        UInt32 propSize = sizeof(MusicTimeStamp);
-        FailIf((res = MusicSequenceGetIndTrack(seq, 0, &track)), fail, "MusicSequenceGetIndTrack");
-        FailIf((res = MusicTrackGetProperty(track, kSequenceTrackProperty_TrackLength,
-                                            &sequenceLength, &propSize)), fail, "MusicTrackProperty: kSequenceTrackProperty_TrackLength");
-        sequenceLength += 8;
-        
         FailIf((res = MusicPlayerSetTime(player, 0)), fail, "MusicPlayerSetTime");
         FailIf((res = MusicPlayerPreroll(player)), fail, "MusicPlayerPreroll");
         
@@ -268,41 +468,377 @@ void MidiProcessor::convertTrack(std::string filepath)
         
         FailIf((res = MusicPlayerStart(player)), fail, "MusicPlayerStart");
         
-        std::string outputFilePath = GetOutputFilePath(filepath);
+        UInt64 endFrame = getTrackEndFrame(trackIndex);
+        prepareStem(stem, format, endFrame);
         
-        WriteConvertedOutputFile(outputFilePath, dataFormat, sampleRate, sequenceLength, graph, numFrames, player);
+        // The DLS synth only renders stereo; a mono stem is downmixed a block at a time as it comes out.
+        UInt64 framesRendered = RenderGraphToStem(graph, endFrame, (UInt64)(maxReleaseTailSeconds * format.sampleRate), numFrames, stem);
         
         FailIf((res = MusicPlayerStop(player)), fail, "MusicPlayerStop");
         
         FailIf((res = DisposeMusicPlayer(player)), fail, "DisposeMusicPlayer");
         FailIf((res = DisposeMusicSequence(seq)), fail, "DisposeMusicSequence");
         
-        convertedFilenames.push_back(outputFilePath);
-        
+        return framesRendered / format.sampleRate;
     }
     
-    
-    return;
-    
-    
 fail:
     printf("Error = %ld\n", (long)res);
     exit(1);
 }
 
+#endif
+
+void MidiProcessor::convertTrack(size_t trackIndex)
+{
+    trackRenderedSeconds[trackIndex] = renderTrack(trackIndex, stemFormat, trackStems[trackIndex]);
+}
+
+double MidiProcessor::renderTrack(size_t trackIndex, const AudioFormat& format, AudioStem& stem)
+{
+    if (renderBackend == RenderBackend::BuiltinSynth) {
+        return convertTrackWithSynth(trackIndex, format, stem);
+    }
+#if OPENGLAPP_HAS_AUDIOTOOLBOX
+    return convertTrackWithAudioToolbox(trackIndex, format, stem);
+#else
+    throw runtime_error("The AudioToolbox render backend is not available on this platform");
+#endif
+}
+
+double MidiProcessor::convertTrackWithSynth(size_t trackIndex, const AudioFormat& format, AudioStem& stem)
+{
+    const auto& events = trackEvents[trackIndex];
+    
+    // Ticks to sample frames through the shared tempo map; events are already in time order.
+    vector<SynthEvent> synthEvents;
+    synthEvents.reserve(events.size());
+    TempoMap::Cursor tempoCursor(tempoMap);
+    for (auto& event : events) {
+        SynthEvent synthEvent;
+        synthEvent.frame = (uint64_t)llround(tempoCursor.tickToMicroseconds(event.tick) * format.sampleRate / 1000000.0);
+        synthEvent.status = event.status;
+        synthEvent.data1 = event.data1;
+        synthEvent.data2 = event.data2;
+        synthEvents.push_back(synthEvent);
+    }
+    
+    uint64_t endFrame = getTrackEndFrame(trackIndex);
+    prepareStem(stem, format, endFrame);
+    
+    // A mono stem is rendered in mono: the synth mixes each voice once and the right channel
+    // is never written, read or downmixed.
+    WavetableSynth synth(*synthBank, format.sampleRate);
+    bool stereo = format.channels == 2;
+    vector<float> left(numFrames), right(stereo ? numFrames : 0);
+    float* rightData = stereo ? right.data() : NULL;
+    size_t nextEvent = 0;
+    
+    // Render the body up to the track's last event. Whenever nothing is sounding, jump
+    // straight to the next event: those frames are silence and need no synthesis at all.
+    uint64_t frame = 0;
+    while (frame < endFrame) {
+        synth.applyEvents(synthEvents, nextEvent);
+        if (synth.getNumActiveVoices() == 0) {
+            uint64_t nextEventFrame = nextEvent < synthEvents.size() ? synthEvents[nextEvent].frame : endFrame;
+            uint64_t silentFrames = min(nextEventFrame, endFrame) - frame;
+            if (silentFrames > 0) {
+                synth.skipFrames(silentFrames);
+                stem.appendSilence(silentFrames);
+                frame += silentFrames;
+                continue;
+            }
+        }
+        size_t blockFrames = (size_t)min((uint64_t)numFrames, endFrame - frame);
+        synth.process(synthEvents, nextEvent, left.data(), rightData, blockFrames);
+        appendBlock(stem, left.data(), rightData, blockFrames);
+        frame += blockFrames;
+    }
+    
+    // ...then exactly as much release tail as the voices still sounding need.
+    synth.applyEvents(synthEvents, nextEvent);
+    uint64_t tailFrames = min(synth.getTailFrames(), (uint64_t)(maxReleaseTailSeconds * format.sampleRate));
+    for (uint64_t tailFrame = 0; tailFrame < tailFrames; tailFrame += numFrames) {
+        size_t blockFrames = (size_t)min((uint64_t)numFrames, tailFrames - tailFrame);
+        synth.process(synthEvents, nextEvent, left.data(), rightData, blockFrames);
+        appendBlock(stem, left.data(), rightData, blockFrames);
+    }
+    
+    return synth.getCurrentFrame() / format.sampleRate;
+}
+
+uint64_t MidiProcessor::getTrackEndFrame(size_t trackIndex)
+{
+    return tempoMap.tickToSample(trackEndTicks[trackIndex], stemFormat.sampleRate);
+}
+
+uint64_t MidiProcessor::getSongEndFrame()
+{
+    uint64_t endTick = 0;
+    for (uint64_t tick : trackEndTicks) {
+        endTick = max(endTick, tick);
+    }
+    return tempoMap.tickToSample(endTick, stemFormat.sampleRate);
+}
+
+void MidiProcessor::prepareStem(AudioStem& stem, const AudioFormat& format, uint64_t endFrame)
+{
+    stem.sampleRate = format.sampleRate;
+    stem.channels = format.channels;
+    
+    // Reserve room for the whole track plus the longest possible tail so the stem is allocated
+    // once. Only the audible segments are written; the rest of a large reservation is never
+    // touched and so never becomes resident.
+    stem.clear();
+    stem.samples.reserve((size_t)(endFrame + (uint64_t)(maxReleaseTailSeconds * format.sampleRate)) * format.channels);
+}
+
+RenderCacheKey MidiProcessor::getTrackCacheKey(size_t trackIndex)
+{
+    RenderCacheKey key = trackEventKeys[trackIndex];
+    key.add(renderCacheVersion);
+    key.add((uint64_t)renderBackend);
+    key.add(renderBackend == RenderBackend::BuiltinSynth ? synthBank->getName() : string("AudioToolbox DLS"));
+    key.add(stemFormat.sampleRate);
+    key.add((uint64_t)numFrames);
+    key.add((uint64_t)stemFormat.channels);
+    key.add(maxReleaseTailSeconds);
+    return key;
+}
+
+string MidiProcessor::exportTrack(size_t trackIndex)
+{
+    const AudioStem& stem = trackStems[trackIndex];
+    std::string outputFilePath = GetOutputFilePath(trackFilenames[trackIndex]);
+    
+    // The file is the full-length track, silence included.
+    vector<int16_t> pcm((size_t)stem.getNumFrames() * stem.channels);
+    stem.copyFrames(0, (size_t)stem.getNumFrames(), pcm.data());
+    if (!writeWavFile(outputFilePath, pcm.data(), (size_t)stem.getNumFrames(), stem.channels, (unsigned int)stem.sampleRate)) {
+        throw runtime_error("Couldn't write rendered track: " + outputFilePath);
+    }
+    return outputFilePath;
+}
+
+void MidiProcessor::exportMixdown()
+{
+    auto startTime = chrono::steady_clock::now();
+    auto numTracks = trackStems.size();
+    
+    // Stereo stems already hold the mix; mono ones have lost the panning, so render again.
+    AudioFormat mixFormat(stemFormat.sampleRate, 2);
+    vector<AudioStem> stereoStems;
+    if (stemFormat.channels != 2) {
+        stereoStems.resize(numTracks);
+        WorkerPool pool(numConversionWorkers);
+        pool.run(numTracks, [this, &mixFormat, &stereoStems](size_t i) {
+            if (!conversionCancelled) {
+                renderTrack(i, mixFormat, stereoStems[i]);
+            }
+        });
+        if (conversionCancelled) {
+            return;
+        }
+    }
+    const vector<AudioStem>& stems = stereoStems.empty() ? trackStems : stereoStems;
+    
+    uint64_t lengthFrames = 0;
+    for (auto& stem : stems) {
+        lengthFrames = max(lengthFrames, stem.getNumFrames());
+    }
+    
+    // Summed in float, then quantised once, so quiet tracks don't lose bits to each other.
+    vector<float> mix((size_t)lengthFrames * 2, 0.0f);
+    vector<int16_t> chunk(numFrames * 2);
+    for (auto& stem : stems) {
+        for (uint64_t frame = 0; frame < stem.getNumFrames(); frame += numFrames) {
+            size_t count = (size_t)min((uint64_t)numFrames, stem.getNumFrames() - frame);
+            stem.copyFrames(frame, count, chunk.data());
+            float* out = mix.data() + frame * 2;
+            for (size_t i = 0; i < count * 2; ++i) {
+                out[i] += chunk[i] * (1.0f / 32767.0f);
+            }
+        }
+    }
+    
+    vector<int16_t> pcm(mix.size());
+    floatToInt16(mix.data(), pcm.data(), mix.size());
+    if (!writeWavFile(mixdownPath, pcm.data(), (size_t)lengthFrames, 2, (unsigned int)mixFormat.sampleRate)) {
+        throw runtime_error("Couldn't write mixdown: " + mixdownPath);
+    }
+    std::cout << "Wrote stereo mixdown of " << numTracks << " tracks to " << mixdownPath << " in "
+              << chrono::duration<double>(chrono::steady_clock::now() - startTime).count() << "s" << std::endl;
+}
+
 void MidiProcessor::convertTracks()
+{
+    prepareConversion();
+    runConversion();
+}
+
+void MidiProcessor::startConvertingTracks()
+{
+    prepareConversion();
+    conversionThread = std::thread([this] {
+        try {
+            runConversion();
+        } catch (...) {
+            lock_guard<mutex> lock(convertedTracksMutex);
+            conversionError = current_exception();
+        }
+    });
+}
+
+bool MidiProcessor::popConvertedTrack(size_t& trackIndex)
+{
+    lock_guard<mutex> lock(convertedTracksMutex);
+    if (conversionError) {
+        exception_ptr error = conversionError;
+        conversionError = nullptr;
+        rethrow_exception(error);
+    }
+    if (convertedTracks.empty()) {
+        return false;
+    }
+    trackIndex = convertedTracks.front();
+    convertedTracks.pop_front();
+    return true;
+}
+
+void MidiProcessor::waitForConversion()
+{
+    if (conversionThread.joinable()) {
+        conversionThread.join();
+    }
+    lock_guard<mutex> lock(convertedTracksMutex);
+    if (conversionError) {
+        exception_ptr error = conversionError;
+        conversionError = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void MidiProcessor::cancelConversion()
+{
+    conversionCancelled = true;
+    if (conversionThread.joinable()) {
+        conversionThread.join();
+    }
+}
+
+void MidiProcessor::prepareConversion()
 {
     if (trackFilenames.size() == 0) {
         throw runtime_error("No track filenames on record. Did you forget to call splitTracks()?");
     }
     
-    std::cout << "Starting conversion of tracks..." << std::endl;
+    // A background conversion that's still going owns every per-track vector below.
+    if (conversionThread.joinable()) {
+        conversionThread.join();
+    }
+    
+    if (renderBackend == RenderBackend::BuiltinSynth && !synthBank) {
+            synthBank.reset(new WavetableBank(WavetableBank::createGeneralMidi()));
+    }
+    
+    // Everything the workers write into is sized up front, so a stem never moves once a
+    // reader has been told it's ready.
+    auto numTracks = trackFilenames.size();
+    convertedFilenames.assign(numTracks, string());
+    trackStems.assign(numTracks, AudioStem());
+    trackConversionTimes.assign(numTracks, 0.0);
+    trackRenderedSeconds.assign(numTracks, 0.0);
+    
+    conversionCancelled = false;
+    lock_guard<mutex> lock(convertedTracksMutex);
+    convertedTracks.clear();
+    conversionError = nullptr;
+}
+
+void MidiProcessor::runConversion()
+{
+    WorkerPool pool(numConversionWorkers);
+    
+    std::cout << "Starting conversion of tracks on " << pool.getNumWorkers() << " worker(s)..." << std::endl;
     
-    for(auto filepath : trackFilenames) {
-        convertTrack(filepath);
+    auto numTracks = trackFilenames.size();
+    vector<char> trackFromCache(numTracks, 0);
+    RenderCache::Stats cacheStatsBefore;
+    if (renderCache) {
+        cacheStatsBefore = renderCache->getStats();
     }
     
-    std::cout << "Finished converting " << trackFilenames.size() << " track files to WAVs!" << std::endl;
+    auto startTime = chrono::steady_clock::now();
+    
+    pool.run(numTracks, [this, &trackFromCache](size_t i) {
+        if (conversionCancelled) {
+            return;
+        }
+        auto trackStartTime = chrono::steady_clock::now();
+        RenderCacheKey key;
+        if (renderCache) {
+            key = getTrackCacheKey(i);
+            trackFromCache[i] = renderCache->load(key, trackStems[i]);
+        }
+        if (trackFromCache[i]) {
+            trackRenderedSeconds[i] = trackStems[i].getDurationSeconds();
+        } else {
+            convertTrack(i);
+            if (renderCache && !renderCache->store(key, trackStems[i])) {
+                std::cerr << "Couldn't write track " << (i + 1) << " to the render cache" << std::endl;
+            }
+        }
+        if (exportWavFiles) {
+            convertedFilenames[i] = exportTrack(i);
+        }
+        trackConversionTimes[i] = chrono::duration<double>(chrono::steady_clock::now() - trackStartTime).count();
+        
+        lock_guard<mutex> lock(convertedTracksMutex);
+        convertedTracks.push_back(i);
+    });
+    
+    double wallTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    double totalTrackTime = 0;
+    double totalRenderedSeconds = 0;
+    uint64_t totalFrames = 0, storedFrames = 0;
+    size_t storedBytes = 0;
+    
+    // Realtime factor: seconds of audio produced per second of wall time spent producing it.
+    auto oldFlags = std::cout.flags();
+    auto oldPrecision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < numTracks; ++i) {
+        std::cout << "  track " << (i + 1) << ": " << trackConversionTimes[i] << "s";
+        if (trackFromCache[i]) {
+            std::cout << " (cached)";
+        } else if (trackConversionTimes[i] > 0) {
+            std::cout << " (" << trackRenderedSeconds[i] / trackConversionTimes[i] << "x realtime)";
+        }
+        std::cout << ", " << trackStems[i].segments.size() << " segment(s)" << std::endl;
+        totalTrackTime += trackConversionTimes[i];
+        totalRenderedSeconds += trackRenderedSeconds[i];
+        totalFrames += trackStems[i].getNumFrames();
+        storedFrames += trackStems[i].getStoredFrames();
+        storedBytes += trackStems[i].getSizeBytes();
+    }
+    std::cout << "Finished rendering " << numTracks << " tracks in " << wallTime << "s"
+              << " (" << totalTrackTime << "s of track time, " << (wallTime > 0 ? totalTrackTime / wallTime : 0.0) << "x speedup, "
+              << (wallTime > 0 ? totalRenderedSeconds / wallTime : 0.0) << "x realtime)" << std::endl;
+    std::cout << "Stems store " << (totalFrames > 0 ? 100.0 * storedFrames / totalFrames : 0.0) << "% of their length ("
+              << storedBytes / (1024.0 * 1024.0) << " MB); the rest is silence" << std::endl;
+    if (renderCache) {
+        renderCache->evict();
+        RenderCache::Stats cacheStats = renderCache->getStats();
+        std::cout << "Render cache: " << (cacheStats.hits - cacheStatsBefore.hits) << " hit(s), "
+                  << (cacheStats.misses - cacheStatsBefore.misses) << " miss(es), "
+                  << (cacheStats.evictions - cacheStatsBefore.evictions) << " eviction(s), "
+                  << renderCache->getSizeBytes() / (1024.0 * 1024.0) << " MB in " << renderCache->getDirectory() << std::endl;
+    }
+    std::cout.flags(oldFlags);
+    std::cout.precision(oldPrecision);
+    if (!mixdownPath.empty() && !conversionCancelled) {
+        exportMixdown();
+    }
 }
 
 void MidiProcessor::splitTracks()
@@ -312,6 +848,16 @@ void MidiProcessor::splitTracks()
         throw runtime_error("Input MIDI file not valid");
     }
     
+    if (conversionThread.joinable()) {
+        conversionThread.join();
+    }
+    
+    trackFilenames.clear();
+    trackData.clear();
+    trackEvents.clear();
+    trackEndTicks.clear();
+    trackEventKeys.clear();
+    
     MIDIMultiTrack tracks(1);
     
     MIDIFileReadMultiTrack track_loader(&tracks);
@@ -326,20 +872,34 @@ void MidiProcessor::splitTracks()
     }
     
     MIDITrack& firstTrack = *tracks.GetTrack(0);
-    int tempoTrackIndex = 0;
-    int numTempoEvents = firstTrack.GetNumEvents();
+    
+    // Track 0 is the conductor track; its tempo changes are collected once and merged
+    // into every other track, so each split file still plays back at the right speed.
+    tempoMap = TempoMap::fromTrack(firstTrack, tracks.GetClksPerBeat());
     
     for (int i = 1; i <= num_tracks; ++i)
     {
         MIDITrack& track = *tracks.GetTrack(i - 1);
         auto outFileName = this->getFilenameForTrack(i);
-        MIDIFileWriteStreamFileName out_stream(outFileName.c_str());
         
-        if (!out_stream.IsValid()) {
-            throw runtime_error("Couldn't create output stream for file: " + outFileName);
+        trackData.push_back(std::vector<unsigned char>());
+        trackEvents.push_back(std::vector<TrackEvent>());
+        trackEventKeys.push_back(RenderCacheKey());
+        RenderCacheKey& eventKey = trackEventKeys.back();
+        eventKey.add((uint64_t)tracks.GetClksPerBeat());
+        std::unique_ptr<MIDIFileWriteStream> out_stream;
+        
+        if (splitInMemory) {
+            out_stream.reset(new MIDIFileWriteStreamMemory(trackData.back()));
+        } else {
+            auto file_stream = new MIDIFileWriteStreamFileName(outFileName.c_str());
+            out_stream.reset(file_stream);
+            if (!file_stream->IsValid()) {
+                throw runtime_error("Couldn't create output stream for file: " + outFileName);
+            }
         }
         
-        MIDIFileWrite writer(&out_stream);
+        MIDIFileWrite writer(out_stream.get());
         
         auto numEvents = track.GetNumEvents();
         
@@ -351,9 +911,12 @@ void MidiProcessor::splitTracks()
         
         writer.WriteTrackHeader(0);
         
-        MIDIClockTime msgTime;
+        MIDIClockTime msgTime = 0;
         
         bool wroteInitialNote = false;
+        
+        TempoMap::Cursor tempoCursor(tempoMap);
+        const TempoMap::Segment* tempoSegment;
 
         for (int j = 0; j < numEvents; ++j) {
             auto msg = track.GetEventAddress(j);
@@ -367,53 +930,55 @@ void MidiProcessor::splitTracks()
                 break;
             }
             
-            writer.WriteEvent(*msg);
-            
-            if (writer.ErrorOccurred()) {
-                throw runtime_error("Error occurred while writing events");
-            }
-            
-            if (i > 1) {
-                while (tempoTrackIndex < numTempoEvents) {
-                    auto curTempoEvent = firstTrack.GetEventAddress(tempoTrackIndex);
-                    auto nextEventInCurTrack = track.GetEventAddress(j + 1);
-                    if (curTempoEvent->GetTime() < nextEventInCurTrack->GetTime()) {
-                        // Next event in track occurs after the next tempo event, this is where we need to write it.
-                        writer.WriteEvent(*curTempoEvent);
-                        tempoTrackIndex++;
-                    } else {
-                        break;
-                    }
-                }
-            }
-            
             if (!wroteInitialNote) {
-                auto nextEventInCurTrack = track.GetEventAddress(j + 1);
-                auto nextEventTime = nextEventInCurTrack->GetTime();
-                if (nextEventTime > 0) {
+                if (msgTime > 0) {
                     // Write an initial 'silent' note so tracks don't begin playing immediately if their first actual notes appear later in the sequence.
                     MIDITimedBigMessage m;
                     m.SetTime(0);
                     m.SetNoteOn(1, 60, 1);
                     writer.WriteEvent(m);
+                    addEventToKey(eventKey, m);
                     m.SetNoteOff(1, 60, 127);
                     writer.WriteEvent(m);
+                    addEventToKey(eventKey, m);
                     wroteInitialNote = true;
-                } else if (nextEventInCurTrack->IsNoteOn()) {
+                } else if (msg->IsNoteOn()) {
                     // If we come across a NoteOn event before having written our 'silent' note, then we don't need to write ours.
                     wroteInitialNote = true;
                 }
             }
             
+            if (i > 1) {
+                // Tempo changes up to and including this tick go in before the event itself.
+                while (tempoCursor.nextSegmentAtOrBefore(msgTime, tempoSegment)) {
+                    if (tempoSegment->eventIndex >= 0) {
+                        const MIDITimedBigMessage& tempoEvent = *firstTrack.GetEventAddress(tempoSegment->eventIndex);
+                        writer.WriteEvent(tempoEvent);
+                        addEventToKey(eventKey, tempoEvent);
+                    }
+                }
+            }
+            
+            writer.WriteEvent(*msg);
+            addEventToKey(eventKey, *msg);
+            
+            if (writer.ErrorOccurred()) {
+                throw runtime_error("Error occurred while writing events");
+            }
+            
+            if (msg->IsChannelMsg()) {
+                TrackEvent event = { msgTime, msg->GetStatus(), msg->GetByte1(), msg->GetByte2() };
+                trackEvents.back().push_back(event);
+            }
         }
         
         writer.WriteEndOfTrack(msgTime);
+        eventKey.add((uint64_t)msgTime);
         
         writer.RewriteTrackLength();
         
         trackFilenames.push_back(outFileName);
-        
-        tempoTrackIndex = 0;
+        trackEndTicks.push_back(msgTime);
     }
     
     
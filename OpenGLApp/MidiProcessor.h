@@ -9,8 +9,15 @@
 #ifndef __OpenGLApp__MidiProcessor__
 #define __OpenGLApp__MidiProcessor__
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <jdksmidi/world.h>
@@ -24,6 +31,9 @@
 #include <jdksmidi/filereadmultitrack.h>
 #include <jdksmidi/filewrite.h>
 
+#if defined(__APPLE__)
+#define OPENGLAPP_HAS_AUDIOTOOLBOX 1
+
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreServices/CoreServices.h>
 #include <CoreAudio/CoreAudioTypes.h>
@@ -32,47 +42,173 @@
 
 #include "PublicUtility/AUOutputBL.h"
 #include "PublicUtility/CAStreamBasicDescription.h"
-#include "CAAudioFileFormats.h"
+#else
+#define OPENGLAPP_HAS_AUDIOTOOLBOX 0
+#endif
+
+#include "AudioFormat.h"
+#include "AudioStem.h"
+#include "RenderCache.h"
+#include "TempoMap.h"
+#include "WavetableSynth.h"
 
 namespace OpenGLApp {
     
     class MidiProcessor
     {
     public:
+        // AudioToolbox renders through the system DLS synth and is only available on OS X;
+        // BuiltinSynth is the portable WavetableSynth and works anywhere, headless included.
+        enum class RenderBackend { AudioToolbox, BuiltinSynth };
+        
         MidiProcessor(std::string inputFilename);
+        ~MidiProcessor();
         
         bool isValid();
         void splitTracks();
         void convertTracks();
+        
+        // Number of split tracks, known as soon as splitTracks() has run.
         int getNumTracks();
+        
+        // Converts on a background thread instead, so the caller can get on with opening the
+        // window and audio device. popConvertedTrack() hands back each track as it finishes
+        // (in completion order) and rethrows anything the conversion threw;
+        // waitForConversion() blocks until every track is done.
+        void startConvertingTracks();
+        bool popConvertedTrack(size_t& trackIndex);
+        void waitForConversion();
+        
+        // Skips the tracks no worker has started on yet and waits for the rest, e.g. on quit.
+        void cancelConversion();
+        
+        // Rendered audio for each track, already in the layout playback uploads, so nothing
+        // has to be written out and decoded again. While converting in the background only
+        // stems already returned by popConvertedTrack() may be read.
+        const std::vector<AudioStem>& getTrackStems();
+        
+        // The pipeline format stems are rendered in, which playback then uses unchanged.
+        // Defaults to AudioFormat() (16 kHz mono); set it before converting.
+        void setStemFormat(const AudioFormat& format);
+        const AudioFormat& getStemFormat();
+        
+        // Channels per stem: 1 (the default) for positional OpenAL sources, 2 to keep the stereo image.
+        void setStemChannels(unsigned int channels);
+        
+        // When set, convertTracks() also writes each stem to <name>trackN.wav. Off by default;
+        // getConvertedTrackNames() lists the files written.
+        void setExportWavFiles(bool exportFiles);
         std::vector<std::string> getConvertedTrackNames();
+        
+        // When set, convertTracks() finishes by writing one stereo WAV of every track mixed
+        // together, each panned as in the MIDI file. Mono stems can't carry the panning, so
+        // in that case the tracks are rendered again in stereo just for the mixdown. Empty
+        // (the default) writes none.
+        void setMixdownPath(const std::string& path);
+        
+        // Number of tracks rendered concurrently by convertTracks(). Every job owns its
+        // own MusicSequence, AUGraph and MusicPlayer. 0 means one per hardware thread.
+        void setNumConversionWorkers(unsigned int numWorkers);
+        // Seconds each track took to convert in the last convertTracks(), measured on its worker.
+        std::vector<double> getTrackConversionTimes();
+        
+        // When true (the default) splitTracks() keeps each track as an in-memory SMF buffer
+        // that convertTrack() hands straight to MusicSequenceFileLoadData, instead of writing
+        // a <name>trackN.mid file and reading it back.
+        void setSplitInMemory(bool inMemory);
+        
+        // Tempo map of the conductor track, valid after splitTracks().
+        const TempoMap& getTempoMap();
+        
+        // Frame, at the stem rate, of the last event in any track: where playback loops back to
+        // the start. Valid after splitTracks(), before anything is rendered.
+        uint64_t getSongEndFrame();
+        
+        void setRenderBackend(RenderBackend backend);
+        RenderBackend getRenderBackend();
+        
+        // Length of audio produced for each track by the last convertTracks().
+        std::vector<double> getTrackRenderedSeconds();
+        
+        // Serve stems from (and save them to) a render cache in directory. Entries are keyed by
+        // the split track's events plus everything that affects the render, so an unchanged
+        // track is never rendered twice. An empty directory (the default) turns caching off.
+        void setRenderCacheDirectory(const std::string& directory, uint64_t maxBytes = RenderCache::defaultMaxBytes);
+        const RenderCache* getRenderCache();
     private:
-        const UInt32 numFrames = 512;
-        Float64 sampleRate = 16000;
+        // A channel message from a split track, kept for the built-in synth so it
+        // doesn't have to parse the SMF buffers again.
+        struct TrackEvent
+        {
+            uint64_t tick;
+            unsigned char status;
+            unsigned char data1;
+            unsigned char data2;
+        };
+        
+        // Frames per render call. Nothing is polled between blocks any more, so they can be large.
+        const uint32_t numFrames = 4096;
+        AudioFormat stemFormat;
+        unsigned int numConversionWorkers = 0;
+        bool splitInMemory = true;
+        bool exportWavFiles = false;
+        std::string mixdownPath;
+        RenderBackend renderBackend = OPENGLAPP_HAS_AUDIOTOOLBOX ? RenderBackend::AudioToolbox : RenderBackend::BuiltinSynth;
+        
+        // Longest release tail rendered after a track's last event.
+        const double maxReleaseTailSeconds = 10.0;
         
         std::string inFilename;
         std::vector<std::string> trackFilenames;
+        std::vector<std::vector<unsigned char>> trackData;
         std::vector<std::string> convertedFilenames;
+        std::vector<AudioStem> trackStems;
+        std::vector<double> trackConversionTimes;
+        std::vector<double> trackRenderedSeconds;
+        std::vector<std::vector<TrackEvent>> trackEvents;
+        std::vector<uint64_t> trackEndTicks;
+        std::vector<RenderCacheKey> trackEventKeys;
+        
+        TempoMap tempoMap;
+        std::unique_ptr<WavetableBank> synthBank;
+        std::unique_ptr<RenderCache> renderCache;
+        
+        std::thread conversionThread;
+        std::mutex convertedTracksMutex;
+        std::deque<size_t> convertedTracks;
+        std::exception_ptr conversionError;
+        std::atomic<bool> conversionCancelled;
         
         jdksmidi::MIDIFileReadStreamFile inStream;
         
         std::string getFilenameForTrack(int trackNum);
         std::string GetOutputFilePath(std::string filepath);
-        void convertTrack(std::string filepath);
-        void WriteConvertedOutputFile(std::string outputFilePath,
-                                      OSType dataFormat,
-                                      Float64 sampleRate,
-                                      MusicTimeStamp sequenceLength,
-                                      AUGraph inputGraph,
-                                      UInt32 numFrames,
-                                      MusicPlayer player);
+        void prepareConversion();
+        void runConversion();
+        void convertTrack(size_t trackIndex);
+        double renderTrack(size_t trackIndex, const AudioFormat& format, AudioStem& stem);
+        double convertTrackWithSynth(size_t trackIndex, const AudioFormat& format, AudioStem& stem);
+        std::string exportTrack(size_t trackIndex);
+        void exportMixdown();
+        uint64_t getTrackEndFrame(size_t trackIndex);
+        void prepareStem(AudioStem& stem, const AudioFormat& format, uint64_t endFrame);
+        RenderCacheKey getTrackCacheKey(size_t trackIndex);
+        
+#if OPENGLAPP_HAS_AUDIOTOOLBOX
+        double convertTrackWithAudioToolbox(size_t trackIndex, const AudioFormat& format, AudioStem& stem);
+        UInt64 RenderGraphToStem(AUGraph inputGraph,
+                                 UInt64 endFrame,
+                                 UInt64 maxTailFrames,
+                                 UInt32 numFrames,
+                                 AudioStem& stem);
         
         OSStatus LoadMusicSequence(std::string filePath, MusicSequence& seq, MusicSequenceLoadFlags loadFlags);
+        OSStatus LoadMusicSequence(const std::vector<unsigned char>& smfData, MusicSequence& seq, MusicSequenceLoadFlags loadFlags);
         
         OSStatus GetSynthFromGraph(AUGraph& inGraph, AudioUnit& outSynth);
         
         OSStatus SetUpGraph(AUGraph& inGraph, UInt32 numFrames, Float64& sampleRate);
-        
+#endif
     };
 }
 
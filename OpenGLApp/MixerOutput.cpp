@@ -0,0 +1,163 @@
+//
+//  MixerOutput.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "MixerOutput.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // Buffers are only 32 ms at 16 kHz, so the thread has to look more often than the
+    // streamer's does.
+    const chrono::milliseconds refillInterval(4);
+    
+    // The mixing thread tops the PCM ring up more often still, so it is never the reason a
+    // refill comes up short.
+    const chrono::milliseconds mixInterval(2);
+}
+
+MixerOutput::MixerOutput(SpatialMixer& mixer, size_t bufferFrames, unsigned int numBuffers) :
+    mixer(mixer), bufferFrames(max(bufferFrames, (size_t)SpatialMixer::blockFrames)), source(0),
+    buffers(max(numBuffers, 2u)), underruns(0), lateBuffers(0), pcm(this->bufferFrames * 2),
+    mixScratch(SpatialMixer::blockFrames * 2), running(false)
+{
+    scratch.resize(this->bufferFrames * 2);
+    alGenSources(1, &source);
+    alGenBuffers((ALsizei)buffers.size(), buffers.data());
+    
+    // The mix is already spatialised: play it as is, wherever the listener is.
+    alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+    alSource3f(source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+}
+
+MixerOutput::~MixerOutput()
+{
+    stop();
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alDeleteBuffers((ALsizei)buffers.size(), buffers.data());
+    alDeleteSources(1, &source);
+}
+
+void MixerOutput::start()
+{
+    lock_guard<mutex> lock(runningMutex);
+    if (running) {
+        return;
+    }
+    // Nothing else is rendering yet, so the first buffers can come straight from the mixer.
+    for (ALuint buffer : buffers) {
+        mixer.render(scratch.data(), bufferFrames);
+        alBufferData(buffer, AL_FORMAT_STEREO16, scratch.data(), (ALsizei)(scratch.size() * sizeof(int16_t)),
+                     (ALsizei)mixer.getOutputFormat().sampleRate);
+    }
+    alSourceQueueBuffers(source, (ALsizei)buffers.size(), buffers.data());
+    alSourcePlay(source);
+    mixAhead();
+    
+    running = true;
+    mixThread = thread(&MixerOutput::runEvery, this, mixInterval, &MixerOutput::mixAhead);
+    refillThread = thread(&MixerOutput::runEvery, this, refillInterval, &MixerOutput::refill);
+}
+
+void MixerOutput::stop()
+{
+    {
+        lock_guard<mutex> lock(runningMutex);
+        running = false;
+    }
+    stopCondition.notify_all();
+    if (mixThread.joinable()) {
+        mixThread.join();
+    }
+    if (refillThread.joinable()) {
+        refillThread.join();
+    }
+}
+
+void MixerOutput::runEvery(chrono::milliseconds interval, void (MixerOutput::*work)())
+{
+    // The work runs unlocked: the two threads only meet in the PCM ring.
+    unique_lock<mutex> lock(runningMutex);
+    while (running) {
+        lock.unlock();
+        (this->*work)();
+        lock.lock();
+        stopCondition.wait_for(lock, interval);
+    }
+}
+
+ALuint MixerOutput::getSource() const
+{
+    return source;
+}
+
+uint64_t MixerOutput::getAudiblePosition(uint64_t loopFrames)
+{
+    lock_guard<mutex> lock(queueMutex);
+    uint64_t position = mixer.getPosition();
+    // The sample offset counts from the oldest buffer still queued, played or not.
+    ALint queued = 0, offset = 0;
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+    uint64_t pendingFrames = pcm.getReadAvailable() / 2 + (uint64_t)queued * bufferFrames - (uint64_t)offset;
+    return (position + loopFrames - pendingFrames % loopFrames) % loopFrames;
+}
+
+uint64_t MixerOutput::getUnderruns() const
+{
+    return underruns;
+}
+
+uint64_t MixerOutput::getLateBuffers() const
+{
+    return lateBuffers;
+}
+
+void MixerOutput::mixAhead()
+{
+    while (pcm.getWriteAvailable() >= mixScratch.size()) {
+        mixer.render(mixScratch.data(), SpatialMixer::blockFrames);
+        pcm.write(mixScratch.data(), mixScratch.size());
+    }
+}
+
+void MixerOutput::fillBuffer(ALuint buffer)
+{
+    size_t copied = pcm.read(scratch.data(), scratch.size());
+    if (copied < scratch.size()) {
+        fill(scratch.begin() + copied, scratch.end(), (int16_t)0);
+        ++lateBuffers;
+    }
+    alBufferData(buffer, AL_FORMAT_STEREO16, scratch.data(), (ALsizei)(scratch.size() * sizeof(int16_t)),
+                 (ALsizei)mixer.getOutputFormat().sampleRate);
+}
+
+void MixerOutput::refill()
+{
+    lock_guard<mutex> lock(queueMutex);
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    for (ALint i = 0; i < processed; ++i) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        fillBuffer(buffer);
+        alSourceQueueBuffers(source, 1, &buffer);
+    }
+    
+    ALint state;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state == AL_STOPPED) {
+        ++underruns;
+        alSourcePlay(source);
+    }
+}
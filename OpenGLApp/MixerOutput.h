@@ -0,0 +1,88 @@
+//
+//  MixerOutput.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__MixerOutput__
+#define __OpenGLApp__MixerOutput__
+
+#include <OpenAL/al.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpatialMixer.h"
+#include "SpscRing.h"
+
+namespace OpenGLApp {
+    
+    // Plays a SpatialMixer through one non-positional OpenAL source. As in StemStreamer, a
+    // background thread keeps a small ring of queued buffers topped up as the source
+    // finishes them. The mixing itself happens on a second thread, which renders the mix a
+    // block at a time into a lock-free PCM ring one buffer deep; the OpenAL thread only ever
+    // copies out of it, so a slow block of mixing can't hold up a refill. The rings are
+    // short, so a moved listener is heard within a few tens of milliseconds.
+    class MixerOutput
+    {
+    public:
+        static const size_t defaultBufferFrames = 512;
+        static const unsigned int defaultNumBuffers = 4;
+        
+        // The mixer must outlive the output.
+        MixerOutput(SpatialMixer& mixer, size_t bufferFrames = defaultBufferFrames, unsigned int numBuffers = defaultNumBuffers);
+        ~MixerOutput();
+        
+        // Queues the first buffers and starts the source and both threads.
+        void start();
+        void stop();
+        
+        ALuint getSource() const;
+        
+        // Where the song is at the speaker, rather than where the mixer has rendered up to:
+        // the mixer's position less what is still waiting in the PCM ring and the queued
+        // buffers. Good to within a block, as the mixing thread may be between the two.
+        uint64_t getAudiblePosition(uint64_t loopFrames);
+        
+        // Times the source ran dry before it was refilled and had to be restarted.
+        uint64_t getUnderruns() const;
+        // Buffers queued short, padded with silence, because the mixing had fallen behind.
+        uint64_t getLateBuffers() const;
+    private:
+        SpatialMixer& mixer;
+        size_t bufferFrames;
+        ALuint source;
+        std::vector<ALuint> buffers;
+        std::vector<int16_t> scratch;
+        // Held while refill() has a buffer off the queue, so getAudiblePosition() never
+        // catches the frames in it counted nowhere.
+        std::mutex queueMutex;
+        std::atomic<uint64_t> underruns;
+        std::atomic<uint64_t> lateBuffers;
+        
+        // Interleaved stereo from the mixing thread to the refill thread.
+        SpscRing<int16_t> pcm;
+        std::vector<int16_t> mixScratch;
+        
+        std::thread mixThread;
+        std::thread refillThread;
+        std::mutex runningMutex;
+        std::condition_variable stopCondition;
+        bool running;
+        
+        void runEvery(std::chrono::milliseconds interval, void (MixerOutput::*work)());
+        void mixAhead();
+        void fillBuffer(ALuint buffer);
+        void refill();
+    };
+}
+
+#endif /* defined(__OpenGLApp__MixerOutput__) */
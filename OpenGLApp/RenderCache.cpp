@@ -0,0 +1,345 @@
+//
+//  RenderCache.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "RenderCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    const uint64_t fnvOffsetBasis = 14695981039346656037ull;
+    const uint64_t fnvPrime = 1099511628211ull;
+    
+    const char stemFileMagic[4] = { 'O', 'G', 'S', 'T' };
+    const uint32_t stemFileVersion = 1;
+    const char* stemFileExtension = ".stem";
+    
+    // Written in native byte order: the cache never leaves the machine that made it.
+    struct StemFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        double sampleRate;
+        uint32_t channels;
+        uint32_t reserved;
+        uint64_t lengthFrames;
+        uint64_t numSegments;
+        uint64_t numSamples;
+    };
+    
+    struct StemFileSegment
+    {
+        uint64_t startFrame;
+        uint64_t numFrames;
+        uint64_t sampleOffset;
+    };
+    
+    std::atomic<unsigned int> tempFileCounter(0);
+    
+    bool hasStemExtension(const std::string& name)
+    {
+        size_t length = strlen(stemFileExtension);
+        return name.size() > length && name.compare(name.size() - length, length, stemFileExtension) == 0;
+    }
+    
+    bool readStem(FILE* fp, uint64_t fileSize, AudioStem& stem)
+    {
+        StemFileHeader header;
+        if (fread(&header, sizeof(header), 1, fp) != 1
+            || memcmp(header.magic, stemFileMagic, sizeof(stemFileMagic)) != 0
+            || header.version != stemFileVersion
+            || (header.channels != 1 && header.channels != 2)) {
+            return false;
+        }
+        
+        // Check the counts against the file before allocating anything for them.
+        uint64_t expectedSize = sizeof(header) + header.numSegments * sizeof(StemFileSegment) + header.numSamples * sizeof(int16_t);
+        if (header.numSegments > fileSize || header.numSamples > fileSize || expectedSize != fileSize) {
+            return false;
+        }
+        
+        vector<StemFileSegment> segments((size_t)header.numSegments);
+        stem.clear();
+        stem.sampleRate = header.sampleRate;
+        stem.channels = header.channels;
+        stem.lengthFrames = header.lengthFrames;
+        stem.samples.resize((size_t)header.numSamples);
+        if (fread(segments.data(), sizeof(StemFileSegment), segments.size(), fp) != segments.size()
+            || fread(stem.samples.data(), sizeof(int16_t), stem.samples.size(), fp) != stem.samples.size()) {
+            return false;
+        }
+        
+        stem.segments.reserve(segments.size());
+        for (auto& segment : segments) {
+            if (segment.sampleOffset + segment.numFrames * header.channels > header.numSamples
+                || segment.startFrame + segment.numFrames > header.lengthFrames) {
+                return false;
+            }
+            AudioStem::Segment stemSegment = { segment.startFrame, (size_t)segment.numFrames, (size_t)segment.sampleOffset };
+            stem.segments.push_back(stemSegment);
+        }
+        return true;
+    }
+}
+
+void OpenGLApp::makeDirectories(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        string prefix = path.substr(0, pos);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw runtime_error("Couldn't create cache directory: " + prefix);
+        }
+        if (pos == string::npos) {
+            break;
+        }
+    }
+}
+
+RenderCacheKey::RenderCacheKey() : hash(fnvOffsetBasis)
+{
+}
+
+void RenderCacheKey::add(const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * fnvPrime;
+    }
+}
+
+void RenderCacheKey::add(const std::string& value)
+{
+    // Length first, so ("ab", "c") and ("a", "bc") hash differently.
+    add((uint64_t)value.size());
+    add(value.data(), value.size());
+}
+
+void RenderCacheKey::add(uint64_t value)
+{
+    add(&value, sizeof(value));
+}
+
+void RenderCacheKey::add(double value)
+{
+    add(&value, sizeof(value));
+}
+
+uint64_t RenderCacheKey::getHash() const
+{
+    return hash;
+}
+
+std::string RenderCacheKey::toString() const
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+std::string RenderCache::getDefaultDirectory()
+{
+#if defined(__APPLE__)
+    const char* home = getenv("HOME");
+    return (home && *home) ? string(home) + "/Library/Caches/OpenGLApp/stems" : string();
+#else
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome && *cacheHome) {
+        return string(cacheHome) + "/OpenGLApp/stems";
+    }
+    const char* home = getenv("HOME");
+    return (home && *home) ? string(home) + "/.cache/OpenGLApp/stems" : string();
+#endif
+}
+
+RenderCache::RenderCache(const std::string& directory, uint64_t maxBytes) : directory(directory), maxBytes(maxBytes)
+{
+    if (directory.empty()) {
+        throw runtime_error("No render cache directory given");
+    }
+    makeDirectories(directory);
+}
+
+const std::string& RenderCache::getDirectory() const
+{
+    return directory;
+}
+
+std::string RenderCache::getPathForKey(const RenderCacheKey& key) const
+{
+    return directory + "/" + key.toString() + stemFileExtension;
+}
+
+bool RenderCache::load(const RenderCacheKey& key, AudioStem& stem)
+{
+    string path = getPathForKey(key);
+    struct stat info;
+    FILE* fp = NULL;
+    bool ok = stat(path.c_str(), &info) == 0 && (fp = fopen(path.c_str(), "rb")) != NULL;
+    bool corrupt = false;
+    
+    if (ok) {
+        ok = readStem(fp, (uint64_t)info.st_size, stem);
+        corrupt = !ok;
+        fclose(fp);
+    }
+    
+    if (corrupt) {
+        unlink(path.c_str());
+        stem.clear();
+    } else if (ok) {
+        // Mark it recently used for evict().
+        utime(path.c_str(), NULL);
+    }
+    
+    lock_guard<mutex> lock(statsMutex);
+    if (ok) {
+        ++stats.hits;
+        stats.bytesRead += (uint64_t)info.st_size;
+    } else {
+        ++stats.misses;
+    }
+    return ok;
+}
+
+bool RenderCache::store(const RenderCacheKey& key, const AudioStem& stem)
+{
+    string path = getPathForKey(key);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.%u.tmp", (long)getpid(), tempFileCounter++);
+    string tempPath = path + suffix;
+    
+    FILE* fp = fopen(tempPath.c_str(), "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    
+    StemFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, stemFileMagic, sizeof(stemFileMagic));
+    header.version = stemFileVersion;
+    header.sampleRate = stem.sampleRate;
+    header.channels = stem.channels;
+    header.lengthFrames = stem.lengthFrames;
+    header.numSegments = stem.segments.size();
+    header.numSamples = stem.samples.size();
+    
+    vector<StemFileSegment> segments;
+    segments.reserve(stem.segments.size());
+    for (auto& segment : stem.segments) {
+        StemFileSegment fileSegment = { segment.startFrame, segment.numFrames, segment.sampleOffset };
+        segments.push_back(fileSegment);
+    }
+    
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(segments.data(), sizeof(StemFileSegment), segments.size(), fp) == segments.size()
+        && fwrite(stem.samples.data(), sizeof(int16_t), stem.samples.size(), fp) == stem.samples.size();
+    ok = (fclose(fp) == 0) && ok;
+    
+    // rename() replaces the target atomically, so concurrent readers see the old entry or the new one.
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    lock_guard<mutex> lock(statsMutex);
+    ++stats.stores;
+    stats.bytesWritten += sizeof(header) + segments.size() * sizeof(StemFileSegment) + stem.samples.size() * sizeof(int16_t);
+    return true;
+}
+
+void RenderCache::evict()
+{
+    struct Entry
+    {
+        std::string path;
+        time_t lastUsed;
+        uint64_t size;
+    };
+    
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        return;
+    }
+    
+    vector<Entry> entries;
+    uint64_t totalBytes = 0;
+    while (struct dirent* dirEntry = readdir(dir)) {
+        string name = dirEntry->d_name;
+        if (!hasStemExtension(name)) {
+            continue;
+        }
+        struct stat info;
+        string path = directory + "/" + name;
+        if (stat(path.c_str(), &info) == 0) {
+            Entry entry = { path, info.st_mtime, (uint64_t)info.st_size };
+            entries.push_back(entry);
+            totalBytes += entry.size;
+        }
+    }
+    closedir(dir);
+    
+    if (totalBytes <= maxBytes) {
+        return;
+    }
+    
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    
+    uint64_t numEvicted = 0;
+    for (auto& entry : entries) {
+        if (totalBytes <= maxBytes) {
+            break;
+        }
+        if (unlink(entry.path.c_str()) == 0) {
+            totalBytes -= entry.size;
+            ++numEvicted;
+        }
+    }
+    
+    lock_guard<mutex> lock(statsMutex);
+    stats.evictions += numEvicted;
+}
+
+uint64_t RenderCache::getSizeBytes() const
+{
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        return 0;
+    }
+    uint64_t totalBytes = 0;
+    while (struct dirent* dirEntry = readdir(dir)) {
+        string name = dirEntry->d_name;
+        struct stat info;
+        if (hasStemExtension(name) && stat((directory + "/" + name).c_str(), &info) == 0) {
+            totalBytes += (uint64_t)info.st_size;
+        }
+    }
+    closedir(dir);
+    return totalBytes;
+}
+
+RenderCache::Stats RenderCache::getStats() const
+{
+    lock_guard<mutex> lock(statsMutex);
+    return stats;
+}
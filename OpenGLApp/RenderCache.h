@@ -0,0 +1,91 @@
+//
+//  RenderCache.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__RenderCache__
+#define __OpenGLApp__RenderCache__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "AudioStem.h"
+
+namespace OpenGLApp {
+    
+    // Creates path and any of its parents that are missing. Throws std::runtime_error if one
+    // can't be made.
+    void makeDirectories(const std::string& path);
+    
+    // 64-bit FNV-1a over everything that decides what a track renders to. Values are fed in
+    // field by field, so struct padding never leaks into a key.
+    class RenderCacheKey
+    {
+    public:
+        RenderCacheKey();
+        
+        void add(const void* data, size_t size);
+        void add(const std::string& value);
+        void add(uint64_t value);
+        void add(double value);
+        
+        uint64_t getHash() const;
+        std::string toString() const;
+    private:
+        uint64_t hash;
+    };
+    
+    // Rendered stems on disk, one file per key in a single directory. Files are written to a
+    // temporary name and renamed into place, so a reader (or a second copy of the app) never
+    // sees half a stem. Loads touch the file's modification time and evict() removes the
+    // least recently used files until the directory fits in maxBytes.
+    class RenderCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t stores = 0;
+            uint64_t evictions = 0;
+            uint64_t bytesRead = 0;
+            uint64_t bytesWritten = 0;
+        };
+        
+        static const uint64_t defaultMaxBytes = 1024ull * 1024 * 1024;
+        
+        // ~/Library/Caches/OpenGLApp/stems on OS X, $XDG_CACHE_HOME/OpenGLApp/stems (or
+        // ~/.cache/OpenGLApp/stems) elsewhere. Empty if there's no home directory to put it in.
+        static std::string getDefaultDirectory();
+        
+        RenderCache(const std::string& directory, uint64_t maxBytes = defaultMaxBytes);
+        
+        const std::string& getDirectory() const;
+        
+        // Fills stem from the entry for key. Missing or unreadable entries count as a miss;
+        // unreadable ones are deleted.
+        bool load(const RenderCacheKey& key, AudioStem& stem);
+        bool store(const RenderCacheKey& key, const AudioStem& stem);
+        
+        // Deletes least recently used entries until the cache fits its budget.
+        void evict();
+        
+        uint64_t getSizeBytes() const;
+        Stats getStats() const;
+    private:
+        std::string directory;
+        uint64_t maxBytes;
+        
+        mutable std::mutex statsMutex;
+        Stats stats;
+        
+        std::string getPathForKey(const RenderCacheKey& key) const;
+    };
+}
+
+#endif /* defined(__OpenGLApp__RenderCache__) */
@@ -0,0 +1,300 @@
+//
+//  Resampler.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define OPENGLAPP_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define OPENGLAPP_HAS_SSE2 0
+#endif
+
+// As in VoiceMixKernel.cpp, AVX2 is compiled per function and only used when the CPU has it.
+#if OPENGLAPP_HAS_SSE2 && defined(__GNUC__)
+#define OPENGLAPP_HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define OPENGLAPP_HAS_AVX2 0
+#endif
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // Longest filter allowed when a big downsampling ratio stretches it.
+    const unsigned int maxTapsPerPhase = 256;
+    
+    struct QualitySettings
+    {
+        unsigned int taps;
+        // Passband edge as a fraction of the lower of the two Nyquist frequencies.
+        double cutoff;
+        // Kaiser window shape: higher gives more stopband rejection and a wider transition.
+        double beta;
+    };
+    
+    QualitySettings getQualitySettings(ResamplerQuality quality)
+    {
+        switch (quality) {
+            case ResamplerQuality::Low: {
+                QualitySettings settings = { 8, 0.80, 5.0 };
+                return settings;
+            }
+            case ResamplerQuality::Medium: {
+                QualitySettings settings = { 16, 0.90, 7.0 };
+                return settings;
+            }
+            case ResamplerQuality::High:
+            default: {
+                QualitySettings settings = { 32, 0.94, 9.0 };
+                return settings;
+            }
+        }
+    }
+    
+    // Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+    
+    double sinc(double x)
+    {
+        return fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+    }
+    
+    // The closest up / down to outputRate / inputRate with up no larger than maxUp.
+    void reduceRatio(double inputRate, double outputRate, unsigned int maxUp, unsigned int& up, unsigned int& down)
+    {
+        double ratio = inputRate / outputRate;
+        double bestError = HUGE_VAL;
+        for (unsigned int u = 1; u <= maxUp; ++u) {
+            double d = max(1.0, floor(u * ratio + 0.5));
+            double error = fabs(d / u - ratio);
+            if (error < bestError * (1.0 - 1e-12)) {
+                bestError = error;
+                up = u;
+                down = (unsigned int)d;
+                if (error <= ratio * 1e-12) {
+                    break;
+                }
+            }
+        }
+    }
+    
+    float dotProductScalar(const float* a, const float* b, size_t n)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+
+#if OPENGLAPP_HAS_SSE2
+    float dotProductSSE2(const float* a, const float* b, size_t n)
+    {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        __m128 sum = _mm_add_ps(sum0, sum1);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum) + dotProductScalar(a + i, b + i, n - i);
+    }
+#endif
+
+#if OPENGLAPP_HAS_AVX2
+    __attribute__((target("avx2,fma")))
+    float dotProductAVX2(const float* a, const float* b, size_t n)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+        }
+        for (; i + 8 <= n; i += 8) {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        }
+        __m256 sum8 = _mm256_add_ps(sum0, sum1);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum) + dotProductScalar(a + i, b + i, n - i);
+    }
+#endif
+}
+
+const char* OpenGLApp::getResamplerQualityName(ResamplerQuality quality)
+{
+    switch (quality) {
+        case ResamplerQuality::Low:
+            return "low";
+        case ResamplerQuality::Medium:
+            return "medium";
+        case ResamplerQuality::High:
+            return "high";
+    }
+    return "unknown";
+}
+
+bool OpenGLApp::parseResamplerQuality(const char* name, ResamplerQuality& quality)
+{
+    ResamplerQuality all[] = { ResamplerQuality::Low, ResamplerQuality::Medium, ResamplerQuality::High };
+    for (ResamplerQuality candidate : all) {
+        if (strcmp(name, getResamplerQualityName(candidate)) == 0) {
+            quality = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Resampler::Resampler(double inputRate, double outputRate, ResamplerQuality quality) : upFactor(1), downFactor(1), tapsPerPhase(0)
+{
+    if (!(inputRate > 0) || !(outputRate > 0)) {
+        throw runtime_error("Resampler rates must be positive");
+    }
+    reduceRatio(inputRate, outputRate, maxPhases, upFactor, downFactor);
+    setSimdLevel(detectSimdLevel());
+    if (upFactor == downFactor) {
+        return;
+    }
+    
+    // Band-limit to the lower Nyquist frequency, and keep the same number of zero crossings
+    // under the window when that stretches the impulse response.
+    QualitySettings settings = getQualitySettings(quality);
+    double stretch = max(1.0, (double)downFactor / upFactor);
+    double cutoff = settings.cutoff / stretch;
+    tapsPerPhase = (unsigned int)ceil(settings.taps * stretch);
+    tapsPerPhase = min((tapsPerPhase + 7) / 8 * 8, maxTapsPerPhase);
+    
+    // Phase p produces the output that lies p / upFactor of an input sample past the input
+    // sample tapsPerPhase / 2 - 1 taps into its window.
+    double halfWidth = tapsPerPhase / 2.0;
+    double windowScale = 1.0 / besselI0(settings.beta);
+    phases.resize((size_t)upFactor * tapsPerPhase);
+    for (unsigned int p = 0; p < upFactor; ++p) {
+        float* coefficients = &phases[(size_t)p * tapsPerPhase];
+        double sum = 0.0;
+        for (unsigned int k = 0; k < tapsPerPhase; ++k) {
+            double offset = (double)p / upFactor + halfWidth - 1.0 - k;
+            double x = offset / halfWidth;
+            double window = fabs(x) < 1.0 ? besselI0(settings.beta * sqrt(1.0 - x * x)) * windowScale : 0.0;
+            double tap = cutoff * sinc(cutoff * offset) * window;
+            coefficients[k] = (float)tap;
+            sum += tap;
+        }
+        // Unity gain at DC for every phase, so a constant signal comes out without ripple.
+        for (unsigned int k = 0; k < tapsPerPhase; ++k) {
+            coefficients[k] = (float)(coefficients[k] / sum);
+        }
+    }
+}
+
+void Resampler::setSimdLevel(SimdLevel level)
+{
+    // Fall back to the scalar kernel for anything this build or CPU can't run.
+    simdLevel = isSimdLevelSupported(level) ? level : SimdLevel::Scalar;
+    dotProduct = dotProductScalar;
+#if OPENGLAPP_HAS_AVX2
+    if (simdLevel == SimdLevel::AVX2) {
+        dotProduct = dotProductAVX2;
+    }
+#endif
+#if OPENGLAPP_HAS_SSE2
+    if (simdLevel == SimdLevel::SSE2) {
+        dotProduct = dotProductSSE2;
+    }
+#endif
+}
+
+SimdLevel Resampler::getSimdLevel() const
+{
+    return simdLevel;
+}
+
+unsigned int Resampler::getUpFactor() const
+{
+    return upFactor;
+}
+
+unsigned int Resampler::getDownFactor() const
+{
+    return downFactor;
+}
+
+unsigned int Resampler::getTapsPerPhase() const
+{
+    return tapsPerPhase;
+}
+
+size_t Resampler::getOutputFrames(size_t inputFrames) const
+{
+    return (size_t)(((uint64_t)inputFrames * upFactor + downFactor - 1) / downFactor);
+}
+
+void Resampler::processChannel(const float* input, size_t inputFrames, float* output) const
+{
+    size_t outputFrames = getOutputFrames(inputFrames);
+    if (upFactor == downFactor) {
+        copy(input, input + inputFrames, output);
+        return;
+    }
+    
+    // Pad with a filter's width of silence each side so every window can be read whole.
+    vector<float> padded(inputFrames + 2 * tapsPerPhase, 0.0f);
+    copy(input, input + inputFrames, padded.begin() + tapsPerPhase);
+    const float* window = padded.data() + tapsPerPhase - (tapsPerPhase / 2 - 1);
+    
+    uint64_t position = 0;
+    for (size_t n = 0; n < outputFrames; ++n, position += downFactor) {
+        uint64_t base = position / upFactor;
+        unsigned int phase = (unsigned int)(position - base * upFactor);
+        output[n] = dotProduct(window + base, &phases[(size_t)phase * tapsPerPhase], tapsPerPhase);
+    }
+}
+
+void Resampler::process(const int16_t* input, size_t inputFrames, unsigned int channels, int16_t* output) const
+{
+    size_t outputFrames = getOutputFrames(inputFrames);
+    if (upFactor == downFactor) {
+        copy(input, input + inputFrames * channels, output);
+        return;
+    }
+    
+    vector<float> channelIn(inputFrames);
+    vector<float> channelOut(outputFrames);
+    for (unsigned int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < inputFrames; ++i) {
+            channelIn[i] = input[i * channels + c] * (1.0f / 32768.0f);
+        }
+        processChannel(channelIn.data(), inputFrames, channelOut.data());
+        for (size_t i = 0; i < outputFrames; ++i) {
+            long sample = lrintf(channelOut[i] * 32768.0f);
+            output[i * channels + c] = (int16_t)min(max(sample, -32768L), 32767L);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+//
+//  Resampler.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__Resampler__
+#define __OpenGLApp__Resampler__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoiceMixKernel.h"
+
+namespace OpenGLApp {
+    
+    // Taps per output sample when upsampling; downsampling stretches the filter by the ratio
+    // so the transition band stays the same width relative to the new Nyquist frequency.
+    enum class ResamplerQuality { Low, Medium, High };
+    
+    const char* getResamplerQualityName(ResamplerQuality quality);
+    bool parseResamplerQuality(const char* name, ResamplerQuality& quality);
+    
+    // Sample rate conversion by a fixed rational factor with a polyphase Kaiser-windowed sinc
+    // filter. The ratio of the rates is reduced to upFactor / downFactor, so the common ones
+    // (16000 -> 44100 is 441 / 160) are converted exactly with one filter phase per output
+    // position; ratios with no small fraction get the closest one with at most maxPhases
+    // phases. The inner products run on SSE2/AVX2 kernels picked the same way as the
+    // synth's voice mixing. Equal rates are passed through untouched.
+    class Resampler
+    {
+    public:
+        static const unsigned int maxPhases = 1024;
+        
+        Resampler(double inputRate, double outputRate, ResamplerQuality quality = ResamplerQuality::Medium);
+        
+        void setSimdLevel(SimdLevel level);
+        SimdLevel getSimdLevel() const;
+        
+        unsigned int getUpFactor() const;
+        unsigned int getDownFactor() const;
+        unsigned int getTapsPerPhase() const;
+        size_t getOutputFrames(size_t inputFrames) const;
+        
+        // Converts a whole signal, treating everything outside it as silence. output must have
+        // room for getOutputFrames(inputFrames) samples.
+        void processChannel(const float* input, size_t inputFrames, float* output) const;
+        
+        // Converts interleaved 16-bit PCM channel by channel. output must have room for
+        // getOutputFrames(inputFrames) frames and must not overlap input.
+        void process(const int16_t* input, size_t inputFrames, unsigned int channels, int16_t* output) const;
+    private:
+        typedef float (*DotProductFunction)(const float* a, const float* b, size_t n);
+        
+        unsigned int upFactor;
+        unsigned int downFactor;
+        unsigned int tapsPerPhase;
+        
+        // upFactor phases of tapsPerPhase coefficients each, in the order of the input
+        // samples they multiply.
+        std::vector<float> phases;
+        
+        SimdLevel simdLevel;
+        DotProductFunction dotProduct;
+    };
+}
+
+#endif /* defined(__OpenGLApp__Resampler__) */
@@ -0,0 +1,152 @@
+//
+//  ShaderProgram.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "ShaderProgram.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    string readShaderSource(const string& path)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) {
+            throw runtime_error("Couldn't open shader " + path);
+        }
+        string source;
+        char chunk[4096];
+        size_t bytesRead;
+        while ((bytesRead = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+            source.append(chunk, bytesRead);
+        }
+        fclose(fp);
+        return source;
+    }
+    
+    GLuint compileShader(const string& path, GLenum type)
+    {
+        string source = readShaderSource(path);
+        const GLchar* text = source.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+        
+        GLint success = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar log[1024] = { 0 };
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            glDeleteShader(shader);
+            throw runtime_error("Couldn't compile " + path + ": " + log);
+        }
+        return shader;
+    }
+    
+    // Active uniform and attribute names come back with "[0]" on the end for arrays; the
+    // bare name is what callers ask for.
+    string stripArraySuffix(const GLchar* name)
+    {
+        string stripped(name);
+        size_t bracket = stripped.find('[');
+        return bracket == string::npos ? stripped : stripped.substr(0, bracket);
+    }
+}
+
+ShaderProgram::ShaderProgram(const string& vertexShaderFile, const string& fragmentShaderFile) : program(0)
+{
+    GLuint vertexShader = compileShader(vertexShaderFile, GL_VERTEX_SHADER);
+    GLuint fragmentShader;
+    try {
+        fragmentShader = compileShader(fragmentShaderFile, GL_FRAGMENT_SHADER);
+    } catch (runtime_error&) {
+        glDeleteShader(vertexShader);
+        throw;
+    }
+    
+    program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    // The program keeps what it needs; the shader objects go once it is linked.
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar log[1024] = { 0 };
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        glDeleteProgram(program);
+        throw runtime_error(string("Couldn't link shader program: ") + log);
+    }
+    resolveLocations();
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    glDeleteProgram(program);
+}
+
+GLuint ShaderProgram::getId() const
+{
+    return program;
+}
+
+GLint ShaderProgram::getUniformLocation(const string& name) const
+{
+    auto it = uniformLocations.find(name);
+    return it == uniformLocations.end() ? -1 : it->second;
+}
+
+GLint ShaderProgram::getAttribLocation(const string& name) const
+{
+    auto it = attribLocations.find(name);
+    return it == attribLocations.end() ? -1 : it->second;
+}
+
+bool ShaderProgram::updateUniformValue(GLint location, const float* values, size_t count)
+{
+    if (location < 0) {
+        return false;
+    }
+    vector<float>& current = uniformValues[location];
+    if (current.size() == count && equal(values, values + count, current.begin())) {
+        return false;
+    }
+    current.assign(values, values + count);
+    return true;
+}
+
+void ShaderProgram::resolveLocations()
+{
+    GLint count = 0, maxLength = 0;
+    GLint size;
+    GLenum type;
+    
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    vector<GLchar> name(max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), NULL, &size, &type, name.data());
+        uniformLocations[stripArraySuffix(name.data())] = glGetUniformLocation(program, name.data());
+    }
+    
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.assign(max(maxLength, 1), 0);
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), NULL, &size, &type, name.data());
+        attribLocations[stripArraySuffix(name.data())] = glGetAttribLocation(program, name.data());
+    }
+}
@@ -0,0 +1,54 @@
+//
+//  ShaderProgram.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__ShaderProgram__
+#define __OpenGLApp__ShaderProgram__
+
+#include <GL/glew.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenGLApp {
+    
+    // A linked vertex + fragment shader program. Every active uniform and attribute location
+    // is looked up once, straight after linking, so nothing in the render loop has to ask the
+    // driver for one. The program also remembers the last value uploaded to each uniform,
+    // which is what lets GLState skip uploads that wouldn't change anything.
+    class ShaderProgram
+    {
+    public:
+        // Compiles and links the two shader source files. Throws std::runtime_error with the
+        // driver's log if either fails.
+        ShaderProgram(const std::string& vertexShaderFile, const std::string& fragmentShaderFile);
+        ~ShaderProgram();
+        
+        GLuint getId() const;
+        
+        // -1 for a name the linked program doesn't use, as glGetUniformLocation() would say.
+        GLint getUniformLocation(const std::string& name) const;
+        GLint getAttribLocation(const std::string& name) const;
+        
+        // Records count floats as the uniform's value and says whether that is a change. A
+        // location of -1 never changes.
+        bool updateUniformValue(GLint location, const float* values, size_t count);
+    private:
+        GLuint program;
+        std::map<std::string, GLint> uniformLocations;
+        std::map<std::string, GLint> attribLocations;
+        std::map<GLint, std::vector<float>> uniformValues;
+        
+        ShaderProgram(const ShaderProgram&);
+        ShaderProgram& operator=(const ShaderProgram&);
+        
+        void resolveLocations();
+    };
+}
+
+#endif /* defined(__OpenGLApp__ShaderProgram__) */
@@ -0,0 +1,452 @@
+//
+//  SpatialMixer.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "SpatialMixer.h"
+#include "WavFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define OPENGLAPP_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define OPENGLAPP_HAS_SSE2 0
+#endif
+
+// As in VoiceMixKernel.cpp, AVX2 is compiled per function and only used when the CPU has it.
+#if OPENGLAPP_HAS_SSE2 && defined(__GNUC__)
+#define OPENGLAPP_HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define OPENGLAPP_HAS_AVX2 0
+#endif
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // How far a source hard to one side still reaches the far ear: 1 would be a plain
+    // equal-power pan that silences it completely, which no real head does.
+    const float panSpread = 0.8f;
+    
+    // Attenuation of a source directly behind the listener, easing to none at the sides.
+    const float rearAttenuation = 0.3f;
+    
+    const float sampleScale = 1.0f / 32768.0f;
+    
+    void normalise(float* v)
+    {
+        float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length > 0.0f) {
+            v[0] /= length;
+            v[1] /= length;
+            v[2] /= length;
+        }
+    }
+    
+    // Adds numFrames mono samples into left/right, with the gains stepping linearly from
+    // leftGain/rightGain by leftStep/rightStep every frame.
+    void mixSourceScalar(const int16_t* in, size_t numFrames, float leftGain, float leftStep,
+                         float rightGain, float rightStep, float* left, float* right)
+    {
+        for (size_t i = 0; i < numFrames; ++i) {
+            float sample = in[i] * sampleScale;
+            left[i] += sample * (leftGain + leftStep * i);
+            right[i] += sample * (rightGain + rightStep * i);
+        }
+    }
+
+#if OPENGLAPP_HAS_SSE2
+    void mixSourceSSE2(const int16_t* in, size_t numFrames, float leftGain, float leftStep,
+                       float rightGain, float rightStep, float* left, float* right)
+    {
+        const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 vScale = _mm_set1_ps(sampleScale);
+        __m128 gainsLeft = _mm_add_ps(_mm_set1_ps(leftGain), _mm_mul_ps(laneIndex, _mm_set1_ps(leftStep)));
+        __m128 gainsRight = _mm_add_ps(_mm_set1_ps(rightGain), _mm_mul_ps(laneIndex, _mm_set1_ps(rightStep)));
+        const __m128 stepLeft = _mm_set1_ps(4.0f * leftStep);
+        const __m128 stepRight = _mm_set1_ps(4.0f * rightStep);
+        
+        size_t i = 0;
+        for (; i + 8 <= numFrames; i += 8) {
+            // Sign-extend eight 16-bit samples to two vectors of 32-bit ones.
+            __m128i packed = _mm_loadu_si128((const __m128i*)(in + i));
+            __m128 low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16)), vScale);
+            __m128 high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16)), vScale);
+            
+            _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(low, gainsLeft)));
+            _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(low, gainsRight)));
+            gainsLeft = _mm_add_ps(gainsLeft, stepLeft);
+            gainsRight = _mm_add_ps(gainsRight, stepRight);
+            
+            _mm_storeu_ps(left + i + 4, _mm_add_ps(_mm_loadu_ps(left + i + 4), _mm_mul_ps(high, gainsLeft)));
+            _mm_storeu_ps(right + i + 4, _mm_add_ps(_mm_loadu_ps(right + i + 4), _mm_mul_ps(high, gainsRight)));
+            gainsLeft = _mm_add_ps(gainsLeft, stepLeft);
+            gainsRight = _mm_add_ps(gainsRight, stepRight);
+        }
+        
+        mixSourceScalar(in + i, numFrames - i, leftGain + leftStep * i, leftStep, rightGain + rightStep * i, rightStep, left + i, right + i);
+    }
+#endif
+
+#if OPENGLAPP_HAS_AVX2
+    __attribute__((target("avx2,fma")))
+    void mixSourceAVX2(const int16_t* in, size_t numFrames, float leftGain, float leftStep,
+                       float rightGain, float rightStep, float* left, float* right)
+    {
+        const __m256 laneIndex = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 vScale = _mm256_set1_ps(sampleScale);
+        __m256 gainsLeft = _mm256_fmadd_ps(laneIndex, _mm256_set1_ps(leftStep), _mm256_set1_ps(leftGain));
+        __m256 gainsRight = _mm256_fmadd_ps(laneIndex, _mm256_set1_ps(rightStep), _mm256_set1_ps(rightGain));
+        const __m256 stepLeft = _mm256_set1_ps(8.0f * leftStep);
+        const __m256 stepRight = _mm256_set1_ps(8.0f * rightStep);
+        
+        size_t i = 0;
+        for (; i + 8 <= numFrames; i += 8) {
+            __m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+            __m256 sample = _mm256_mul_ps(_mm256_cvtepi32_ps(wide), vScale);
+            
+            _mm256_storeu_ps(left + i, _mm256_fmadd_ps(sample, gainsLeft, _mm256_loadu_ps(left + i)));
+            _mm256_storeu_ps(right + i, _mm256_fmadd_ps(sample, gainsRight, _mm256_loadu_ps(right + i)));
+            gainsLeft = _mm256_add_ps(gainsLeft, stepLeft);
+            gainsRight = _mm256_add_ps(gainsRight, stepRight);
+        }
+        
+        mixSourceScalar(in + i, numFrames - i, leftGain + leftStep * i, leftStep, rightGain + rightStep * i, rightStep, left + i, right + i);
+    }
+#endif
+}
+
+// Defined here too, as min() takes them by reference.
+const size_t SpatialMixer::blockFrames;
+const size_t SpatialMixer::maxSources;
+const size_t SpatialMixer::commandCapacity;
+
+SpatialListener::SpatialListener()
+{
+    position[0] = position[1] = position[2] = 0.0f;
+    forward[0] = forward[1] = 0.0f;
+    forward[2] = -1.0f;
+    up[0] = up[2] = 0.0f;
+    up[1] = 1.0f;
+}
+
+SpatialMixer::SpatialMixer(const AudioFormat& format, uint64_t loopFrames, float referenceDistance, float maxDistance, float rolloffFactor) :
+    format(format), loopFrames(max(loopFrames, (uint64_t)1)), position(0), playing(true), referenceDistance(referenceDistance), maxDistance(max(maxDistance, referenceDistance)),
+    rolloffFactor(rolloffFactor), masterGain(1.0f), sources(maxSources), numSources(0), commands(commandCapacity),
+    mixedSourceFrames(0), skippedSourceFrames(0), sourceBlock(blockFrames), mixLeft(blockFrames), mixRight(blockFrames)
+{
+    if (format.channels != 1) {
+        throw runtime_error("The spatial mixer places mono sources");
+    }
+    setSimdLevel(detectSimdLevel());
+}
+
+SpatialMixer::Command::Command(Type type) : type(type), source(0), flag(false), position(0)
+{
+    values[0] = values[1] = values[2] = 0.0f;
+}
+
+size_t SpatialMixer::addSource(const AudioStem& stem, float x, float y, float z, bool isVirtual)
+{
+    if (stem.getFormat() != format) {
+        throw runtime_error("Spatial mixer sources must be in the mixer's format");
+    }
+    size_t index = numSources.load(memory_order_relaxed);
+    if (index >= maxSources) {
+        throw runtime_error("The spatial mixer is full");
+    }
+    
+    // The slot is past the end the audio thread reads up to until the count below says otherwise.
+    Source& source = sources[index];
+    source.stem = &stem;
+    source.x = x;
+    source.y = y;
+    source.z = z;
+    source.gain = 1.0f;
+    source.gainLeft = source.gainRight = 0.0f;
+    source.started = false;
+    source.virtualised = isVirtual;
+    numSources.store(index + 1, memory_order_release);
+    return index;
+}
+
+void SpatialMixer::setSourcePosition(size_t source, float x, float y, float z)
+{
+    checkSource(source);
+    Command command(Command::SetSourcePosition);
+    command.source = source;
+    command.values[0] = x;
+    command.values[1] = y;
+    command.values[2] = z;
+    sendCommand(command);
+}
+
+void SpatialMixer::setSourceGain(size_t source, float gain)
+{
+    checkSource(source);
+    Command command(Command::SetSourceGain);
+    command.source = source;
+    command.values[0] = gain;
+    sendCommand(command);
+}
+
+void SpatialMixer::setSourceVirtual(size_t source, bool isVirtual)
+{
+    checkSource(source);
+    Command command(Command::SetSourceVirtual);
+    command.source = source;
+    command.flag = isVirtual;
+    sendCommand(command);
+}
+
+size_t SpatialMixer::getNumSources() const
+{
+    return numSources.load(memory_order_relaxed);
+}
+
+void SpatialMixer::setListener(const SpatialListener& newListener)
+{
+    Command command(Command::SetListener);
+    command.listener = newListener;
+    sendCommand(command);
+}
+
+void SpatialMixer::setMasterGain(float gain)
+{
+    Command command(Command::SetMasterGain);
+    command.values[0] = gain;
+    sendCommand(command);
+}
+
+AudioFormat SpatialMixer::getOutputFormat() const
+{
+    return AudioFormat(format.sampleRate, 2);
+}
+
+void SpatialMixer::setSimdLevel(SimdLevel level)
+{
+    // Fall back to the scalar kernel for anything this build or CPU can't run.
+    simdLevel = isSimdLevelSupported(level) ? level : SimdLevel::Scalar;
+    mixSource = mixSourceScalar;
+#if OPENGLAPP_HAS_AVX2
+    if (simdLevel == SimdLevel::AVX2) {
+        mixSource = mixSourceAVX2;
+    }
+#endif
+#if OPENGLAPP_HAS_SSE2
+    if (simdLevel == SimdLevel::SSE2) {
+        mixSource = mixSourceSSE2;
+    }
+#endif
+}
+
+void SpatialMixer::setState(bool nowPlaying, uint64_t newPosition)
+{
+    Command command(Command::SetState);
+    command.flag = nowPlaying;
+    command.position = newPosition;
+    sendCommand(command);
+}
+
+uint64_t SpatialMixer::getPosition() const
+{
+    return position.load(memory_order_relaxed);
+}
+
+SimdLevel SpatialMixer::getSimdLevel() const
+{
+    return simdLevel;
+}
+
+uint64_t SpatialMixer::getMixedSourceFrames() const
+{
+    return mixedSourceFrames;
+}
+
+uint64_t SpatialMixer::getSkippedSourceFrames() const
+{
+    return skippedSourceFrames;
+}
+
+void SpatialMixer::sendCommand(const Command& command)
+{
+    // Only ever waits on a full ring, which the audio thread empties every block.
+    while (!commands.push(command)) {
+        this_thread::yield();
+    }
+}
+
+void SpatialMixer::checkSource(size_t source) const
+{
+    if (source >= numSources.load(memory_order_relaxed)) {
+        throw out_of_range("No such spatial mixer source");
+    }
+}
+
+void SpatialMixer::applyCommands()
+{
+    Command command;
+    while (commands.pop(command)) {
+        switch (command.type) {
+            case Command::SetSourcePosition: {
+                Source& source = sources[command.source];
+                source.x = command.values[0];
+                source.y = command.values[1];
+                source.z = command.values[2];
+                break;
+            }
+            case Command::SetSourceGain:
+                sources[command.source].gain = command.values[0];
+                break;
+            case Command::SetSourceVirtual: {
+                // Back from virtual, a source fades in over its first block.
+                Source& source = sources[command.source];
+                if (source.virtualised && !command.flag) {
+                    source.gainLeft = source.gainRight = 0.0f;
+                    source.started = true;
+                }
+                source.virtualised = command.flag;
+                break;
+            }
+            case Command::SetListener:
+                listener = command.listener;
+                break;
+            case Command::SetMasterGain:
+                masterGain = command.values[0];
+                break;
+            case Command::SetState:
+                playing = command.flag;
+                position.store(command.position % loopFrames, memory_order_relaxed);
+                break;
+        }
+    }
+}
+
+void SpatialMixer::computeGains(const Source& source, float& left, float& right) const
+{
+    float offset[3] = {
+        source.x - listener.position[0],
+        source.y - listener.position[1],
+        source.z - listener.position[2]
+    };
+    float distance = sqrtf(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+    
+    // AL_INVERSE_DISTANCE_CLAMPED, OpenAL's default model.
+    float clamped = min(max(distance, referenceDistance), maxDistance);
+    float gain = source.gain * masterGain * referenceDistance / (referenceDistance + rolloffFactor * (clamped - referenceDistance));
+    
+    // Direction in the listener's frame: pan from how far right it is, the rear cue from
+    // how far behind.
+    float pan = 0.0f;
+    if (distance > 1e-4f) {
+        float forward[3] = { listener.forward[0], listener.forward[1], listener.forward[2] };
+        float up[3] = { listener.up[0], listener.up[1], listener.up[2] };
+        float rightAxis[3] = {
+            forward[1] * up[2] - forward[2] * up[1],
+            forward[2] * up[0] - forward[0] * up[2],
+            forward[0] * up[1] - forward[1] * up[0]
+        };
+        normalise(forward);
+        normalise(rightAxis);
+        pan = (offset[0] * rightAxis[0] + offset[1] * rightAxis[1] + offset[2] * rightAxis[2]) / distance;
+        float front = (offset[0] * forward[0] + offset[1] * forward[1] + offset[2] * forward[2]) / distance;
+        if (front < 0.0f) {
+            gain *= 1.0f - rearAttenuation * -front;
+        }
+    }
+    
+    float angle = (1.0f + panSpread * max(-1.0f, min(1.0f, pan))) * (float)M_PI / 4.0f;
+    left = gain * cosf(angle);
+    right = gain * sinf(angle);
+}
+
+bool SpatialMixer::readSourceBlock(const Source& source, uint64_t start, size_t numFrames)
+{
+    // A block that is all silence is only looked up, never copied.
+    if (!source.stem->hasAudibleLoopFrames(loopFrames, start, numFrames)) {
+        return false;
+    }
+    source.stem->copyLoopFrames(loopFrames, start, numFrames, sourceBlock.data());
+    return true;
+}
+
+void SpatialMixer::renderBlock(float* stereo, size_t numFrames)
+{
+    applyCommands();
+    if (!playing) {
+        fill(stereo, stereo + numFrames * 2, 0.0f);
+        return;
+    }
+    fill(mixLeft.begin(), mixLeft.begin() + numFrames, 0.0f);
+    fill(mixRight.begin(), mixRight.begin() + numFrames, 0.0f);
+    
+    // Sources added since the commands were applied join next block.
+    size_t count = numSources.load(memory_order_acquire);
+    uint64_t start = position.load(memory_order_relaxed);
+    uint64_t mixed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Source& source = sources[i];
+        if (source.virtualised) {
+            continue;
+        }
+        float left, right;
+        computeGains(source, left, right);
+        if (!source.started) {
+            // No ramp in from silence on the first block: the source starts where it is.
+            source.gainLeft = left;
+            source.gainRight = right;
+            source.started = true;
+        }
+        
+        if (readSourceBlock(source, start, numFrames)) {
+            float steps = (float)numFrames;
+            mixSource(sourceBlock.data(), numFrames, source.gainLeft, (left - source.gainLeft) / steps,
+                      source.gainRight, (right - source.gainRight) / steps, mixLeft.data(), mixRight.data());
+            mixed += numFrames;
+        }
+        source.gainLeft = left;
+        source.gainRight = right;
+    }
+    position.store((start + numFrames) % loopFrames, memory_order_relaxed);
+    mixedSourceFrames += mixed;
+    skippedSourceFrames += count * numFrames - mixed;
+    
+    for (size_t i = 0; i < numFrames; ++i) {
+        stereo[2 * i] = mixLeft[i];
+        stereo[2 * i + 1] = mixRight[i];
+    }
+}
+
+void SpatialMixer::render(float* stereo, size_t numFrames)
+{
+    for (size_t done = 0; done < numFrames; done += blockFrames) {
+        renderBlock(stereo + 2 * done, min(blockFrames, numFrames - done));
+    }
+}
+
+void SpatialMixer::render(int16_t* stereo, size_t numFrames)
+{
+    float block[blockFrames * 2];
+    for (size_t done = 0; done < numFrames; done += blockFrames) {
+        size_t count = min(blockFrames, numFrames - done);
+        renderBlock(block, count);
+        // floatToInt16 clamps, so a loud moment of many sources clips rather than wraps.
+        floatToInt16(block, stereo + 2 * done, count * 2);
+    }
+}
+
+bool SpatialMixer::renderToFile(const std::string& path, uint64_t numFrames)
+{
+    vector<int16_t> pcm((size_t)numFrames * 2);
+    render(pcm.data(), (size_t)numFrames);
+    return writeWavFile(path, pcm.data(), (size_t)numFrames, 2, (unsigned int)format.sampleRate);
+}
@@ -0,0 +1,167 @@
+//
+//  SpatialMixer.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__SpatialMixer__
+#define __OpenGLApp__SpatialMixer__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AudioFormat.h"
+#include "AudioStem.h"
+#include "SpscRing.h"
+#include "VoiceMixKernel.h"
+
+namespace OpenGLApp {
+    
+    // Where the listener is and which way it faces. forward and up need not be normalised.
+    struct SpatialListener
+    {
+        float position[3];
+        float forward[3];
+        float up[3];
+        
+        // At the origin, facing down -z with +y up, as OpenAL's default listener.
+        SpatialListener();
+    };
+    
+    // Mixes every track in software into one stereo stream, so playback needs a single output
+    // source however many tracks there are. Each source is a mono stem placed in the scene,
+    // all of them read at one shared song position that loops at one shared point, so they
+    // can't drift apart. Per block each source gets
+    //   - OpenAL's inverse-distance-clamped attenuation, with the same reference and maximum
+    //     distances the per-track OpenAL sources used, and
+    //   - "HRTF-lite" panning: an equal-power level difference by azimuth that never fully
+    //     silences the far ear, plus a little attenuation for sources behind the listener so
+    //     front and back don't sound the same.
+    // Gains ramp linearly across each block so moving sources and a turning listener don't
+    // click. Blocks of a source that fall in the silence between its stem's segments are
+    // skipped outright, which is what lets hundreds of sparse tracks mix cheaply.
+    //
+    // render() may run on an audio thread while the main thread moves the listener and adds
+    // sources, with no lock between them: changes reach the audio thread through a command
+    // ring and take effect at the start of the next block, and new sources fill slots set
+    // aside at construction. render() never waits and never allocates. Everything but
+    // render() must be called from one thread.
+    class SpatialMixer
+    {
+    public:
+        static const size_t blockFrames = 256;
+        static const size_t maxSources = 4096;
+        // Changes that can be waiting for the audio thread; past that the caller waits.
+        static const size_t commandCapacity = 4096;
+        
+        // Sources must be stems in format, which must be mono; the output is stereo at its rate.
+        // Stems loop every loopFrames frames, as AudioStem::copyLoopFrames() plays them. The
+        // mixer starts playing from frame 0.
+        SpatialMixer(const AudioFormat& format, uint64_t loopFrames, float referenceDistance = 25.0f, float maxDistance = 200.0f, float rolloffFactor = 1.0f);
+        
+        // Adds a source playing stem and returns its index. It joins at the current song
+        // position, in step with the rest, or starts virtual. The stem must outlive the mixer.
+        // Throws once there are maxSources.
+        size_t addSource(const AudioStem& stem, float x, float y, float z, bool isVirtual = false);
+        void setSourcePosition(size_t source, float x, float y, float z);
+        void setSourceGain(size_t source, float gain);
+        size_t getNumSources() const;
+        
+        // A virtual source costs nothing: it isn't mixed, but as every source reads the shared
+        // song position it is still in step when it comes back, fading in over one block.
+        void setSourceVirtual(size_t source, bool isVirtual);
+        
+        void setListener(const SpatialListener& listener);
+        void setMasterGain(float gain);
+        
+        AudioFormat getOutputFormat() const;
+        
+        // While paused the mixer renders silence and the position stands still. setState() is
+        // a Transport listener; getPosition() is where the last block rendered left off.
+        void setState(bool playing, uint64_t position);
+        uint64_t getPosition() const;
+        
+        // Renders numFrames frames of interleaved stereo, moving the song position on by as much.
+        void render(float* stereo, size_t numFrames);
+        void render(int16_t* stereo, size_t numFrames);
+        
+        // Renders numFrames frames to a 16-bit stereo WAV file: the offline mode, which needs
+        // no audio device. Returns false if the file can't be written.
+        bool renderToFile(const std::string& path, uint64_t numFrames);
+        
+        // Instruction set used to mix sources; defaults to detectSimdLevel(). Only set it while
+        // nothing is rendering.
+        void setSimdLevel(SimdLevel level);
+        SimdLevel getSimdLevel() const;
+        
+        // Source-frames actually mixed and skipped as silence or virtual since construction, for
+        // cost figures.
+        uint64_t getMixedSourceFrames() const;
+        uint64_t getSkippedSourceFrames() const;
+    private:
+        struct Source
+        {
+            const AudioStem* stem;
+            float x, y, z;
+            float gain;
+            // Gains reached at the end of the last block, where the next ramp starts from.
+            float gainLeft, gainRight;
+            bool started;
+            bool virtualised;
+        };
+        
+        struct Command
+        {
+            enum Type { SetSourcePosition, SetSourceGain, SetSourceVirtual, SetListener, SetMasterGain, SetState };
+            
+            Type type;
+            size_t source;
+            float values[3];
+            bool flag;
+            uint64_t position;
+            SpatialListener listener;
+            
+            Command(Type type = SetState);
+        };
+        
+        typedef void (*MixFunction)(const int16_t* in, size_t numFrames, float leftGain, float leftStep,
+                                    float rightGain, float rightStep, float* left, float* right);
+                                    
+        AudioFormat format;
+        uint64_t loopFrames;
+        std::atomic<uint64_t> position;
+        bool playing;
+        float referenceDistance;
+        float maxDistance;
+        float rolloffFactor;
+        float masterGain;
+        SpatialListener listener;
+        // Slots for every source there can be; the first numSources are in use.
+        std::vector<Source> sources;
+        std::atomic<size_t> numSources;
+        SpscRing<Command> commands;
+        
+        SimdLevel simdLevel;
+        MixFunction mixSource;
+        std::atomic<uint64_t> mixedSourceFrames;
+        std::atomic<uint64_t> skippedSourceFrames;
+        
+        std::vector<int16_t> sourceBlock;
+        std::vector<float> mixLeft;
+        std::vector<float> mixRight;
+        
+        void sendCommand(const Command& command);
+        void checkSource(size_t source) const;
+        void applyCommands();
+        void computeGains(const Source& source, float& left, float& right) const;
+        bool readSourceBlock(const Source& source, uint64_t start, size_t numFrames);
+        void renderBlock(float* stereo, size_t numFrames);
+    };
+}
+
+#endif /* defined(__OpenGLApp__SpatialMixer__) */
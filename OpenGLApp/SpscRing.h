@@ -0,0 +1,139 @@
+//
+//  SpscRing.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__SpscRing__
+#define __OpenGLApp__SpscRing__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace OpenGLApp {
+    
+    // A fixed-size ring for handing items from exactly one producer thread to exactly one
+    // consumer thread. Every call is wait-free and none allocates: the storage is made once,
+    // up front, so the audio thread can sit on either end. Bulk write()/read() move as many
+    // items as fit in one go, for PCM; push()/pop() move one, for commands.
+    //
+    // The read and write indices only ever count up and are masked into the storage, so full
+    // and empty need no spare slot. Each end keeps its own index and its last look at the
+    // other's on a cache line of their own, and only reloads the other end's index when the
+    // cached one says there is no room, so the two threads rarely touch the same line.
+    template <typename T>
+    class SpscRing
+    {
+    public:
+        static const size_t cacheLineBytes = 64;
+        
+        // The capacity is rounded up to a power of two.
+        explicit SpscRing(size_t minCapacity) :
+            capacity(roundUpToPowerOfTwo(minCapacity)), mask(capacity - 1), items(new T[capacity])
+        {
+            writer.index.store(0, std::memory_order_relaxed);
+            writer.otherIndex = 0;
+            reader.index.store(0, std::memory_order_relaxed);
+            reader.otherIndex = 0;
+        }
+        
+        // Producer only.
+        bool push(const T& item)
+        {
+            return write(&item, 1) == 1;
+        }
+        
+        // Copies up to count items in and returns how many fitted.
+        size_t write(const T* source, size_t count)
+        {
+            size_t tail = writer.index.load(std::memory_order_relaxed);
+            if (capacity - (tail - writer.otherIndex) < count) {
+                writer.otherIndex = reader.index.load(std::memory_order_acquire);
+            }
+            count = std::min(count, capacity - (tail - writer.otherIndex));
+            
+            // In at most two pieces: up to the end of the storage, then from its start.
+            size_t start = tail & mask;
+            size_t first = std::min(count, capacity - start);
+            std::copy(source, source + first, items.get() + start);
+            std::copy(source + first, source + count, items.get());
+            writer.index.store(tail + count, std::memory_order_release);
+            return count;
+        }
+        
+        // Consumer only.
+        bool pop(T& item)
+        {
+            return read(&item, 1) == 1;
+        }
+        
+        // Copies up to count items out and returns how many there were.
+        size_t read(T* destination, size_t count)
+        {
+            size_t head = reader.index.load(std::memory_order_relaxed);
+            if (reader.otherIndex - head < count) {
+                reader.otherIndex = writer.index.load(std::memory_order_acquire);
+            }
+            count = std::min(count, reader.otherIndex - head);
+            
+            size_t start = head & mask;
+            size_t first = std::min(count, capacity - start);
+            std::copy(items.get() + start, items.get() + start + first, destination);
+            std::copy(items.get(), items.get() + (count - first), destination + first);
+            reader.index.store(head + count, std::memory_order_release);
+            return count;
+        }
+        
+        // Snapshots, exact only from the end that would act on them: items the consumer can
+        // read, and room the producer can write into.
+        size_t getReadAvailable() const
+        {
+            return writer.index.load(std::memory_order_acquire) - reader.index.load(std::memory_order_relaxed);
+        }
+        
+        size_t getWriteAvailable() const
+        {
+            return capacity - (writer.index.load(std::memory_order_relaxed) - reader.index.load(std::memory_order_acquire));
+        }
+        
+        size_t getCapacity() const
+        {
+            return capacity;
+        }
+    private:
+        // Padded out to a whole line so one end's index never shares with the other's. The
+        // padding, rather than alignas, keeps this true for rings made with new before C++17.
+        struct End
+        {
+            std::atomic<size_t> index;
+            // The other end's index as this end last read it; only this end touches it.
+            size_t otherIndex;
+            char padding[cacheLineBytes - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+        };
+        
+        static size_t roundUpToPowerOfTwo(size_t value)
+        {
+            size_t result = 1;
+            while (result < value) {
+                result <<= 1;
+            }
+            return result;
+        }
+        
+        const size_t capacity;
+        const size_t mask;
+        std::unique_ptr<T[]> items;
+        char padding[cacheLineBytes];
+        End writer;
+        End reader;
+        
+        SpscRing(const SpscRing&);
+        SpscRing& operator=(const SpscRing&);
+    };
+}
+
+#endif /* defined(__OpenGLApp__SpscRing__) */
@@ -0,0 +1,272 @@
+//
+//  StemStreamer.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "StemStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // How often the refill thread looks for finished buffers. Buffers are never shorter than
+    // minBufferFrames (a quarter of a second at 16 kHz), so this leaves plenty of headroom.
+    const chrono::milliseconds refillInterval(10);
+    const size_t minBufferFrames = 4096;
+    const size_t maxBufferFrames = 65536;
+}
+
+StemStreamer::StemStreamer(size_t maxStreams, uint64_t loopFrames, size_t memoryBudgetBytes, unsigned int buffersPerStream) :
+    maxStreams(max(maxStreams, (size_t)1)), loopFrames(max(loopFrames, (uint64_t)1)), memoryBudgetBytes(memoryBudgetBytes),
+    buffersPerStream(max(buffersPerStream, 2u)), bufferBytes(0), underruns(0), running(false), playing(false)
+{
+}
+
+StemStreamer::~StemStreamer()
+{
+    stop();
+    for (auto& stream : streams) {
+        alSourceStop(stream->source);
+        alSourcei(stream->source, AL_BUFFER, 0);
+        alDeleteBuffers((ALsizei)stream->buffers.size(), stream->buffers.data());
+    }
+}
+
+size_t StemStreamer::getBufferFrames(const AudioStem& stem) const
+{
+    size_t frameBytes = stem.channels * sizeof(int16_t);
+    size_t frames = memoryBudgetBytes / (maxStreams * buffersPerStream * frameBytes);
+    return min(max(frames, minBufferFrames), maxBufferFrames);
+}
+
+void StemStreamer::addStream(ALuint source, const AudioStem& stem)
+{
+    unique_ptr<Stream> stream(new Stream());
+    stream->source = source;
+    stream->stem = &stem;
+    stream->position = 0;
+    stream->bufferFrames = getBufferFrames(stem);
+    stream->buffers.resize(buffersPerStream);
+    stream->scratch.resize(stream->bufferFrames * stem.channels);
+    stream->virtualised = true;
+    
+    // The streamer does the looping, so the source itself must not.
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alSourcei(source, AL_BUFFER, 0);
+    alGenBuffers((ALsizei)stream->buffers.size(), stream->buffers.data());
+    
+    lock_guard<mutex> lock(streamsMutex);
+    bufferBytes += stream->buffers.size() * stream->scratch.size() * sizeof(int16_t);
+    streams.push_back(move(stream));
+}
+
+void StemStreamer::start()
+{
+    lock_guard<mutex> lock(streamsMutex);
+    if (running) {
+        return;
+    }
+    running = true;
+    refillThread = thread([this] {
+        unique_lock<mutex> lock(streamsMutex);
+        while (running) {
+            refillStreams();
+            stopCondition.wait_for(lock, refillInterval);
+        }
+    });
+}
+
+void StemStreamer::stop()
+{
+    {
+        lock_guard<mutex> lock(streamsMutex);
+        running = false;
+    }
+    stopCondition.notify_all();
+    if (refillThread.joinable()) {
+        refillThread.join();
+    }
+}
+
+void StemStreamer::setState(bool nowPlaying, uint64_t position)
+{
+    lock_guard<mutex> lock(streamsMutex);
+    playing = nowPlaying;
+    restartStreams(position);
+}
+
+void StemStreamer::virtualiseStreams(const vector<ALuint>& sources)
+{
+    lock_guard<mutex> lock(streamsMutex);
+    for (auto& stream : streams) {
+        if (!stream->virtualised && find(sources.begin(), sources.end(), stream->source) != sources.end()) {
+            alSourceStop(stream->source);
+            alSourcei(stream->source, AL_BUFFER, 0);
+            stream->virtualised = true;
+        }
+    }
+}
+
+void StemStreamer::devirtualiseStreams(const vector<ALuint>& sources, uint64_t position)
+{
+    lock_guard<mutex> lock(streamsMutex);
+    vector<Stream*> returning;
+    vector<ALuint> physical;
+    const Stream* inStep = NULL;
+    for (auto& stream : streams) {
+        if (!stream->virtualised) {
+            physical.push_back(stream->source);
+            inStep = inStep ? inStep : stream.get();
+        } else if (find(sources.begin(), sources.end(), stream->source) != sources.end()) {
+            returning.push_back(stream.get());
+        }
+    }
+    if (returning.empty()) {
+        return;
+    }
+    
+    // Hold the physical sources so where they are can be read exactly, then start everything
+    // together from there.
+    if (playing && inStep) {
+        alSourcePausev((ALsizei)physical.size(), physical.data());
+        position = getStreamPosition(*inStep);
+    }
+    for (Stream* stream : returning) {
+        stream->virtualised = false;
+        queueStream(*stream, position);
+        physical.push_back(stream->source);
+    }
+    if (playing) {
+        alSourcePlayv((ALsizei)physical.size(), physical.data());
+    }
+}
+
+bool StemStreamer::getPosition(uint64_t& position) const
+{
+    lock_guard<mutex> lock(streamsMutex);
+    for (auto& stream : streams) {
+        if (!stream->virtualised) {
+            position = getStreamPosition(*stream);
+            return true;
+        }
+    }
+    return false;
+}
+
+void StemStreamer::restartStreams(uint64_t position)
+{
+    vector<ALuint> sources;
+    for (auto& stream : streams) {
+        if (stream->virtualised) {
+            continue;
+        }
+        alSourceStop(stream->source);
+        alSourcei(stream->source, AL_BUFFER, 0);
+        queueStream(*stream, position);
+        sources.push_back(stream->source);
+    }
+    if (playing && !sources.empty()) {
+        alSourcePlayv((ALsizei)sources.size(), sources.data());
+    }
+}
+
+void StemStreamer::queueStream(Stream& stream, uint64_t position)
+{
+    stream.position = position % loopFrames;
+    for (ALuint buffer : stream.buffers) {
+        fillBuffer(stream, buffer);
+    }
+    alSourceQueueBuffers(stream.source, (ALsizei)stream.buffers.size(), stream.buffers.data());
+}
+
+uint64_t StemStreamer::getStreamPosition(const Stream& stream) const
+{
+    // The source's offset counts from the oldest buffer still queued, which holds the frames
+    // just before everything queued after it up to stream.position.
+    ALint queued = 0, offset = 0;
+    alGetSourcei(stream.source, AL_BUFFERS_QUEUED, &queued);
+    alGetSourcei(stream.source, AL_SAMPLE_OFFSET, &offset);
+    uint64_t queuedFrames = ((uint64_t)queued * stream.bufferFrames) % loopFrames;
+    return (stream.position + loopFrames - queuedFrames + (uint64_t)offset) % loopFrames;
+}
+
+void StemStreamer::fillBuffer(Stream& stream, ALuint buffer)
+{
+    const AudioStem& stem = *stream.stem;
+    
+    // Fill from the current position, carrying on from the start of the loop at the end of it.
+    stem.copyLoopFrames(loopFrames, stream.position, stream.bufferFrames, stream.scratch.data());
+    stream.position = (stream.position + stream.bufferFrames) % loopFrames;
+    
+    ALenum format = stem.channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    alBufferData(buffer, format, stream.scratch.data(), (ALsizei)(stream.scratch.size() * sizeof(int16_t)), (ALsizei)stem.sampleRate);
+}
+
+void StemStreamer::refillStreams()
+{
+    if (!playing) {
+        return;
+    }
+    const Stream* inStep = NULL;
+    vector<ALuint> stalled;
+    for (auto& stream : streams) {
+        if (stream->virtualised) {
+            continue;
+        }
+        ALint processed = 0;
+        alGetSourcei(stream->source, AL_BUFFERS_PROCESSED, &processed);
+        for (ALint i = 0; i < processed; ++i) {
+            ALuint buffer;
+            alSourceUnqueueBuffers(stream->source, 1, &buffer);
+            fillBuffer(*stream, buffer);
+            alSourceQueueBuffers(stream->source, 1, &buffer);
+        }
+        
+        // A source that played through its whole ring has stopped, and picks up again on the
+        // fresh buffers from where it stopped.
+        ALint state;
+        alGetSourcei(stream->source, AL_SOURCE_STATE, &state);
+        if (state == AL_STOPPED) {
+            stalled.push_back(stream->source);
+        } else if (!inStep) {
+            inStep = stream.get();
+        }
+    }
+    if (stalled.empty()) {
+        return;
+    }
+    underruns += stalled.size();
+    
+    if (!inStep) {
+        // Every source stalled at the same frame, so starting them together keeps them in step.
+        alSourcePlayv((ALsizei)stalled.size(), stalled.data());
+        return;
+    }
+    // Otherwise the stalled ones have fallen behind: hold everyone and restart together from
+    // where the sources that kept going had got to.
+    vector<ALuint> sources;
+    for (auto& stream : streams) {
+        if (!stream->virtualised) {
+            sources.push_back(stream->source);
+        }
+    }
+    alSourcePausev((ALsizei)sources.size(), sources.data());
+    restartStreams(getStreamPosition(*inStep));
+}
+
+size_t StemStreamer::getBufferBytes() const
+{
+    lock_guard<mutex> lock(streamsMutex);
+    return bufferBytes;
+}
+
+uint64_t StemStreamer::getUnderruns() const
+{
+    return underruns;
+}
@@ -0,0 +1,112 @@
+//
+//  StemStreamer.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__StemStreamer__
+#define __OpenGLApp__StemStreamer__
+
+#include <OpenAL/al.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AudioStem.h"
+
+namespace OpenGLApp {
+    
+    // Plays stems through a small ring of queued OpenAL buffers per source instead of
+    // uploading them whole. A background thread unqueues each buffer as the source finishes
+    // it, refills it from the stem and queues it again, wrapping to the start of the stem
+    // inside a buffer so the loop point is seamless. OpenAL never holds more than the
+    // memory budget, however long the piece is.
+    //
+    // Every stream loops at the same point and the streams only ever start together:
+    // setState() refills every ring from one song position and starts all the sources in a
+    // single call. A source that runs dry brings the rest back into step with it rather than
+    // carrying on behind them.
+    class StemStreamer
+    {
+    public:
+        static const size_t defaultMemoryBudgetBytes = 8 * 1024 * 1024;
+        static const unsigned int defaultBuffersPerStream = 4;
+        
+        // The budget is shared out evenly between maxStreams streams. Stems loop every
+        // loopFrames frames, as AudioStem::copyLoopFrames() plays them.
+        StemStreamer(size_t maxStreams, uint64_t loopFrames, size_t memoryBudgetBytes = defaultMemoryBudgetBytes, unsigned int buffersPerStream = defaultBuffersPerStream);
+        ~StemStreamer();
+        
+        // Hands source over to the streamer to play stem through. The stream starts virtual:
+        // nothing is queued on it until devirtualiseStreams(). The stem must outlive the
+        // streamer.
+        void addStream(ALuint source, const AudioStem& stem);
+        
+        // Stops every physical source, refills its ring from position and, if playing, starts
+        // them all together: a Transport listener.
+        void setState(bool playing, uint64_t position);
+        
+        // Virtual streams are stopped with nothing queued and left out of refills; their place
+        // in the song is the group's, so none of it needs keeping. Streams brought back are
+        // queued from where the physical ones have got to and started with them, landing on
+        // the same sample, or from position when no stream is physical.
+        void virtualiseStreams(const std::vector<ALuint>& sources);
+        void devirtualiseStreams(const std::vector<ALuint>& sources, uint64_t position);
+        
+        // Where the physical streams have got to in the song, read back from the first of
+        // them. False when every stream is virtual.
+        bool getPosition(uint64_t& position) const;
+        
+        // Starts and stops the refill thread.
+        void start();
+        void stop();
+        
+        size_t getBufferFrames(const AudioStem& stem) const;
+        size_t getBufferBytes() const;
+        
+        // Times a source ran dry before it was refilled and had to be restarted.
+        uint64_t getUnderruns() const;
+    private:
+        struct Stream
+        {
+            ALuint source;
+            const AudioStem* stem;
+            uint64_t position;
+            size_t bufferFrames;
+            std::vector<ALuint> buffers;
+            std::vector<int16_t> scratch;
+            bool virtualised;
+        };
+        
+        size_t maxStreams;
+        uint64_t loopFrames;
+        size_t memoryBudgetBytes;
+        unsigned int buffersPerStream;
+        
+        std::vector<std::unique_ptr<Stream>> streams;
+        size_t bufferBytes;
+        std::atomic<uint64_t> underruns;
+        
+        std::thread refillThread;
+        mutable std::mutex streamsMutex;
+        std::condition_variable stopCondition;
+        bool running;
+        bool playing;
+        
+        void restartStreams(uint64_t position);
+        void queueStream(Stream& stream, uint64_t position);
+        uint64_t getStreamPosition(const Stream& stream) const;
+        void fillBuffer(Stream& stream, ALuint buffer);
+        void refillStreams();
+    };
+}
+
+#endif /* defined(__OpenGLApp__StemStreamer__) */
@@ -0,0 +1,151 @@
+//
+//  TempoMap.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "TempoMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <jdksmidi/track.h>
+
+using namespace std;
+using namespace OpenGLApp;
+
+TempoMap::TempoMap(unsigned int ticksPerBeat) : ticksPerBeat(ticksPerBeat > 0 ? ticksPerBeat : 480)
+{
+    clear();
+}
+
+TempoMap TempoMap::fromTrack(const jdksmidi::MIDITrack& track, unsigned int ticksPerBeat)
+{
+    TempoMap map(ticksPerBeat);
+    
+    int numEvents = track.GetNumEvents();
+    for (int i = 0; i < numEvents; ++i) {
+        const jdksmidi::MIDITimedBigMessage* msg = track.GetEvent(i);
+        if (msg->IsDataEnd()) {
+            break;
+        }
+        if (!msg->IsNoOp() && msg->IsTempo()) {
+            map.addTempoChange(msg->GetTime(), (uint32_t)msg->GetTempo(), i);
+        }
+    }
+    
+    return map;
+}
+
+void TempoMap::clear()
+{
+    segments.clear();
+    Segment initial = { 0, 0, defaultMicrosecondsPerBeat, -1 };
+    segments.push_back(initial);
+}
+
+void TempoMap::addTempoChange(uint64_t tick, uint32_t microsecondsPerBeat, int eventIndex)
+{
+    if (microsecondsPerBeat == 0) {
+        return;
+    }
+    
+    // Tempo events arrive in track order, so this is normally a push_back; anything
+    // out of order is inserted and the start times after it are recomputed.
+    auto pos = upper_bound(segments.begin(), segments.end(), tick, [](uint64_t t, const Segment& s) {
+        return t < s.startTick;
+    });
+    
+    size_t index;
+    if (pos != segments.begin() && (pos - 1)->startTick == tick) {
+        // A later event at the same tick overrides the earlier one (including the implicit default).
+        index = (pos - 1) - segments.begin();
+        segments[index].microsecondsPerBeat = microsecondsPerBeat;
+        segments[index].eventIndex = eventIndex;
+    } else {
+        Segment segment = { tick, 0, microsecondsPerBeat, eventIndex };
+        auto inserted = segments.insert(pos, segment);
+        index = inserted - segments.begin();
+    }
+    
+    for (size_t i = max((size_t)1, index); i < segments.size(); ++i) {
+        segments[i].startMicroseconds = segmentTickToMicroseconds(segments[i - 1], segments[i].startTick);
+    }
+}
+
+unsigned int TempoMap::getTicksPerBeat() const
+{
+    return ticksPerBeat;
+}
+
+size_t TempoMap::getNumSegments() const
+{
+    return segments.size();
+}
+
+const TempoMap::Segment& TempoMap::getSegment(size_t index) const
+{
+    return segments[index];
+}
+
+size_t TempoMap::findSegment(uint64_t tick) const
+{
+    auto pos = upper_bound(segments.begin(), segments.end(), tick, [](uint64_t t, const Segment& s) {
+        return t < s.startTick;
+    });
+    // segments[0] always starts at tick 0, so pos is never begin().
+    return (pos - segments.begin()) - 1;
+}
+
+uint64_t TempoMap::segmentTickToMicroseconds(const Segment& segment, uint64_t tick) const
+{
+    return segment.startMicroseconds + ((tick - segment.startTick) * segment.microsecondsPerBeat) / ticksPerBeat;
+}
+
+uint64_t TempoMap::tickToMicroseconds(uint64_t tick) const
+{
+    return segmentTickToMicroseconds(segments[findSegment(tick)], tick);
+}
+
+double TempoMap::tickToSeconds(uint64_t tick) const
+{
+    return tickToMicroseconds(tick) / 1000000.0;
+}
+
+uint64_t TempoMap::tickToSample(uint64_t tick, double sampleRate) const
+{
+    return (uint64_t)llround(tickToSeconds(tick) * sampleRate);
+}
+
+TempoMap::Cursor::Cursor(const TempoMap& map) : map(map), index(0), nextUnvisited(0)
+{
+}
+
+void TempoMap::Cursor::reset()
+{
+    index = 0;
+    nextUnvisited = 0;
+}
+
+uint64_t TempoMap::Cursor::tickToMicroseconds(uint64_t tick)
+{
+    // Going backwards is allowed but falls back to a fresh search.
+    if (tick < map.segments[index].startTick) {
+        index = map.findSegment(tick);
+    }
+    while (index + 1 < map.segments.size() && map.segments[index + 1].startTick <= tick) {
+        ++index;
+    }
+    return map.segmentTickToMicroseconds(map.segments[index], tick);
+}
+
+bool TempoMap::Cursor::nextSegmentAtOrBefore(uint64_t tick, const Segment*& segment)
+{
+    if (nextUnvisited >= map.segments.size() || map.segments[nextUnvisited].startTick > tick) {
+        return false;
+    }
+    segment = &map.segments[nextUnvisited++];
+    return true;
+}
@@ -0,0 +1,82 @@
+//
+//  TempoMap.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__TempoMap__
+#define __OpenGLApp__TempoMap__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jdksmidi {
+    class MIDITrack;
+}
+
+namespace OpenGLApp {
+    
+    // Piecewise-constant tempo of a MIDI file, stored as segments sorted by tick with the
+    // absolute time at which each one starts. Built once from the conductor track and
+    // then shared by everything that needs to turn ticks into time.
+    class TempoMap
+    {
+    public:
+        static const uint32_t defaultMicrosecondsPerBeat = 500000; // 120 BPM
+        
+        struct Segment
+        {
+            uint64_t startTick;
+            uint64_t startMicroseconds;
+            uint32_t microsecondsPerBeat;
+            int eventIndex; // index of the tempo event in the source track, -1 for the implicit default
+        };
+        
+        TempoMap(unsigned int ticksPerBeat = 480);
+        
+        // Collects every tempo meta event from the conductor track.
+        static TempoMap fromTrack(const jdksmidi::MIDITrack& track, unsigned int ticksPerBeat);
+        
+        void clear();
+        void addTempoChange(uint64_t tick, uint32_t microsecondsPerBeat, int eventIndex = -1);
+        
+        unsigned int getTicksPerBeat() const;
+        size_t getNumSegments() const;
+        const Segment& getSegment(size_t index) const;
+        
+        // Index of the segment that contains tick (binary search).
+        size_t findSegment(uint64_t tick) const;
+        
+        uint64_t tickToMicroseconds(uint64_t tick) const;
+        double tickToSeconds(uint64_t tick) const;
+        uint64_t tickToSample(uint64_t tick, double sampleRate) const;
+        
+        // Walks the map forwards for callers that convert ticks in ascending order,
+        // e.g. while merging a track's events against the tempo changes.
+        class Cursor
+        {
+        public:
+            Cursor(const TempoMap& map);
+            
+            void reset();
+            uint64_t tickToMicroseconds(uint64_t tick);
+            
+            // Tempo events in [previous position, tick] that haven't been visited yet.
+            bool nextSegmentAtOrBefore(uint64_t tick, const Segment*& segment);
+        private:
+            const TempoMap& map;
+            size_t index;
+            size_t nextUnvisited;
+        };
+    private:
+        unsigned int ticksPerBeat;
+        std::vector<Segment> segments;
+        
+        uint64_t segmentTickToMicroseconds(const Segment& segment, uint64_t tick) const;
+    };
+}
+
+#endif /* defined(__OpenGLApp__TempoMap__) */
@@ -0,0 +1,130 @@
+//
+//  Transport.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "Transport.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    int64_t nowNanos()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+Transport::Transport(double sampleRate, uint64_t loopFrames) :
+    sampleRate(sampleRate), loopFrames(max(loopFrames, (uint64_t)1)), version(0), anchorFrame(0), anchorNanos(nowNanos()), playing(false)
+{
+}
+
+void Transport::setListener(const Listener& newListener)
+{
+    lock_guard<mutex> lock(changeMutex);
+    listener = newListener;
+}
+
+double Transport::getSampleRate() const
+{
+    return sampleRate;
+}
+
+uint64_t Transport::getLoopFrames() const
+{
+    return loopFrames;
+}
+
+void Transport::play()
+{
+    lock_guard<mutex> lock(changeMutex);
+    if (!playing) {
+        setState(true, getPosition());
+        notify();
+    }
+}
+
+void Transport::pause()
+{
+    lock_guard<mutex> lock(changeMutex);
+    if (playing) {
+        setState(false, getPosition());
+        notify();
+    }
+}
+
+void Transport::togglePlaying()
+{
+    lock_guard<mutex> lock(changeMutex);
+    setState(!playing, getPosition());
+    notify();
+}
+
+void Transport::seek(uint64_t frame)
+{
+    lock_guard<mutex> lock(changeMutex);
+    setState(playing, frame % loopFrames);
+    notify();
+}
+
+bool Transport::isPlaying() const
+{
+    return playing;
+}
+
+uint64_t Transport::getPosition() const
+{
+    uint32_t before, after;
+    uint64_t frame;
+    int64_t nanos;
+    bool running;
+    do {
+        before = version.load(memory_order_acquire);
+        frame = anchorFrame.load(memory_order_relaxed);
+        nanos = anchorNanos.load(memory_order_relaxed);
+        running = playing.load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = version.load(memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    
+    if (running) {
+        frame += (uint64_t)(max(nowNanos() - nanos, (int64_t)0) * sampleRate / 1e9);
+    }
+    return frame % loopFrames;
+}
+
+double Transport::getPositionSeconds() const
+{
+    return getPosition() / sampleRate;
+}
+
+void Transport::syncTo(uint64_t position)
+{
+    lock_guard<mutex> lock(changeMutex);
+    setState(playing, position % loopFrames);
+}
+
+void Transport::setState(bool nowPlaying, uint64_t position)
+{
+    uint32_t current = version.load(memory_order_relaxed);
+    version.store(current + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    anchorFrame.store(position, memory_order_relaxed);
+    anchorNanos.store(nowNanos(), memory_order_relaxed);
+    playing.store(nowPlaying, memory_order_relaxed);
+    version.store(current + 2, memory_order_release);
+}
+
+void Transport::notify()
+{
+    if (listener) {
+        listener(playing, anchorFrame);
+    }
+}
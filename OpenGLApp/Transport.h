@@ -0,0 +1,70 @@
+//
+//  Transport.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__Transport__
+#define __OpenGLApp__Transport__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace OpenGLApp {
+    
+    // The one clock every track plays to: a song position in sample frames that runs while
+    // playing and wraps at a loop point shared by all the stems. Play, pause and seek go
+    // through here and are handed to the audio output as a single change, which applies it
+    // to every track at once.
+    //
+    // The position is read without locking, so the renderer can ask for it every frame.
+    class Transport
+    {
+    public:
+        // Called with the new state on every play, pause and seek, while the transport's lock
+        // is held, so two changes can never interleave in the output.
+        typedef std::function<void(bool playing, uint64_t position)> Listener;
+        
+        // Starts paused at frame 0.
+        Transport(double sampleRate, uint64_t loopFrames);
+        
+        void setListener(const Listener& listener);
+        
+        double getSampleRate() const;
+        uint64_t getLoopFrames() const;
+        
+        void play();
+        void pause();
+        void togglePlaying();
+        void seek(uint64_t frame);
+        
+        bool isPlaying() const;
+        uint64_t getPosition() const;
+        double getPositionSeconds() const;
+        
+        // Moves the clock to where the output says the audio really is, without telling the
+        // listener: the audio device's clock, not the system's, is the one the tracks follow.
+        void syncTo(uint64_t position);
+    private:
+        double sampleRate;
+        uint64_t loopFrames;
+        Listener listener;
+        std::mutex changeMutex;
+        
+        // Where the song was at anchorNanos on the steady clock. Written only under
+        // changeMutex, inside an odd version, so readers can retry a torn read instead of locking.
+        std::atomic<uint32_t> version;
+        std::atomic<uint64_t> anchorFrame;
+        std::atomic<int64_t> anchorNanos;
+        std::atomic<bool> playing;
+        
+        void setState(bool playing, uint64_t position);
+        void notify();
+    };
+}
+
+#endif /* defined(__OpenGLApp__Transport__) */
@@ -0,0 +1,324 @@
+//
+//  VertexLayout.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "VertexLayout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    struct NamedFormats
+    {
+        const char* name;
+        VertexFormats formats;
+    };
+    
+    const NamedFormats namedFormats[] = {
+        { "float", { PositionFormat::Float, NormalFormat::Float, TexcoordFormat::Float } },
+        { "compact", { PositionFormat::Float, NormalFormat::Int2101010, TexcoordFormat::Half } },
+        { "quantized", { PositionFormat::Unorm16, NormalFormat::Int2101010, TexcoordFormat::Half } },
+    };
+    
+    uint16_t quantizeUnorm16(float value)
+    {
+        return (uint16_t)lround(min(max(value, 0.0f), 1.0f) * 65535.0f);
+    }
+    
+    // Rounds to the nearest half, ties away from zero; out of range goes to infinity and
+    // below the smallest subnormal to zero.
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        int exponent = (int)((bits >> 23) & 0xff);
+        uint32_t mantissa = bits & 0x7fffff;
+        if (exponent == 0xff) {
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        }
+        exponent += 15 - 127;
+        if (exponent >= 31) {
+            return sign | 0x7c00;
+        }
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            int shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            half += (mantissa >> (shift - 1)) & 1;
+            return sign | (uint16_t)half;
+        }
+        // A carry out of the mantissa correctly bumps the exponent.
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        half += (mantissa >> 12) & 1;
+        return sign | (uint16_t)half;
+    }
+    
+    float halfToFloat(uint16_t half)
+    {
+        float sign = (half & 0x8000) ? -1.0f : 1.0f;
+        int exponent = (half >> 10) & 0x1f;
+        int mantissa = half & 0x3ff;
+        if (exponent == 0) {
+            return sign * ldexp((float)mantissa, -24);
+        }
+        if (exponent == 31) {
+            return mantissa ? NAN : sign * INFINITY;
+        }
+        return sign * ldexp((float)(mantissa | 0x400), exponent - 25);
+    }
+    
+    // x in the low 10 bits, then y, then z; w is left zero.
+    uint32_t packInt2101010(const float* normal)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 3; ++i) {
+            int component = (int)lround(min(max(normal[i], -1.0f), 1.0f) * 511.0f);
+            packed |= ((uint32_t)component & 0x3ff) << (i * 10);
+        }
+        return packed;
+    }
+    
+    // GL 4.2's conversion, which older drivers approximate to within half a step.
+    void unpackInt2101010(uint32_t packed, float* normal)
+    {
+        for (int i = 0; i < 3; ++i) {
+            int component = (int)((packed >> (i * 10)) & 0x3ff);
+            if (component & 0x200) {
+                component -= 0x400;
+            }
+            normal[i] = max(component / 511.0f, -1.0f);
+        }
+    }
+}
+
+const char* OpenGLApp::getVertexFormatsName(const VertexFormats& formats)
+{
+    for (const NamedFormats& named : namedFormats) {
+        if (named.formats.position == formats.position && named.formats.normal == formats.normal && named.formats.texcoord == formats.texcoord) {
+            return named.name;
+        }
+    }
+    return "custom";
+}
+
+bool OpenGLApp::parseVertexFormats(const char* name, VertexFormats& formats)
+{
+    for (const NamedFormats& named : namedFormats) {
+        if (strcmp(name, named.name) == 0) {
+            formats = named.formats;
+            return true;
+        }
+    }
+    return false;
+}
+
+VertexLayout::VertexLayout(const MeshData& mesh, const VertexFormats& formats) : formats(formats), stride(0)
+{
+    float lowest[3], highest[3];
+    mesh.getBounds(lowest, highest);
+    layOut(!mesh.normals.empty(), !mesh.texcoords.empty(), lowest, highest);
+}
+
+VertexLayout::VertexLayout(const VertexFormats& formats, bool hasNormals, bool hasTexcoords, const float lowest[3], const float highest[3]) :
+    formats(formats), stride(0)
+{
+    layOut(hasNormals, hasTexcoords, lowest, highest);
+}
+
+const VertexFormats& VertexLayout::getFormats() const
+{
+    return formats;
+}
+
+bool VertexLayout::hasAttribute(Semantic semantic) const
+{
+    for (const Attribute& attribute : attributes) {
+        if (attribute.semantic == semantic) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t VertexLayout::getStride() const
+{
+    return stride;
+}
+
+const vector<VertexLayout::Attribute>& VertexLayout::getAttributes() const
+{
+    return attributes;
+}
+
+const float* VertexLayout::getPositionOffset() const
+{
+    return positionOffset;
+}
+
+const float* VertexLayout::getPositionScale() const
+{
+    return positionScale;
+}
+
+vector<uint8_t> VertexLayout::pack(const MeshData& mesh) const
+{
+    size_t numVertices = mesh.getNumVertices();
+    vector<uint8_t> packed(numVertices * stride, 0);
+    for (size_t v = 0; v < numVertices; ++v) {
+        uint8_t* vertex = &packed[v * stride];
+        for (const Attribute& attribute : attributes) {
+            uint8_t* out = vertex + attribute.offset;
+            const float* in;
+            switch (attribute.semantic) {
+                case Position:
+                    in = &mesh.positions[v * 3];
+                    if (attribute.type == GL_FLOAT) {
+                        memcpy(out, in, 3 * sizeof(float));
+                    } else {
+                        uint16_t quantized[3];
+                        for (int axis = 0; axis < 3; ++axis) {
+                            float relative = positionScale[axis] > 0.0f ? (in[axis] - positionOffset[axis]) / positionScale[axis] : 0.0f;
+                            quantized[axis] = quantizeUnorm16(relative);
+                        }
+                        memcpy(out, quantized, sizeof(quantized));
+                    }
+                    break;
+                case Normal:
+                    in = &mesh.normals[v * 3];
+                    if (attribute.type == GL_FLOAT) {
+                        memcpy(out, in, 3 * sizeof(float));
+                    } else {
+                        uint32_t quantized = packInt2101010(in);
+                        memcpy(out, &quantized, sizeof(quantized));
+                    }
+                    break;
+                case Texcoord:
+                    in = &mesh.texcoords[v * 2];
+                    if (attribute.type == GL_FLOAT) {
+                        memcpy(out, in, 2 * sizeof(float));
+                    } else {
+                        uint16_t quantized[2];
+                        for (int i = 0; i < 2; ++i) {
+                            quantized[i] = attribute.type == GL_HALF_FLOAT ? floatToHalf(in[i]) : quantizeUnorm16(in[i]);
+                        }
+                        memcpy(out, quantized, sizeof(quantized));
+                    }
+                    break;
+            }
+        }
+    }
+    return packed;
+}
+
+void VertexLayout::unpack(const uint8_t* vertices, size_t vertex, float position[3], float normal[3], float texcoord[2]) const
+{
+    const uint8_t* base = vertices + vertex * stride;
+    for (const Attribute& attribute : attributes) {
+        const uint8_t* in = base + attribute.offset;
+        switch (attribute.semantic) {
+            case Position:
+                if (attribute.type == GL_FLOAT) {
+                    memcpy(position, in, 3 * sizeof(float));
+                } else {
+                    uint16_t quantized[3];
+                    memcpy(quantized, in, sizeof(quantized));
+                    for (int axis = 0; axis < 3; ++axis) {
+                        position[axis] = positionOffset[axis] + positionScale[axis] * (quantized[axis] / 65535.0f);
+                    }
+                }
+                break;
+            case Normal:
+                if (attribute.type == GL_FLOAT) {
+                    memcpy(normal, in, 3 * sizeof(float));
+                } else {
+                    uint32_t quantized;
+                    memcpy(&quantized, in, sizeof(quantized));
+                    unpackInt2101010(quantized, normal);
+                }
+                break;
+            case Texcoord:
+                if (attribute.type == GL_FLOAT) {
+                    memcpy(texcoord, in, 2 * sizeof(float));
+                } else {
+                    uint16_t quantized[2];
+                    memcpy(quantized, in, sizeof(quantized));
+                    for (int i = 0; i < 2; ++i) {
+                        texcoord[i] = attribute.type == GL_HALF_FLOAT ? halfToFloat(quantized[i]) : quantized[i] / 65535.0f;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void VertexLayout::bindAttributes(GLint positionLocation, GLint normalLocation, GLint texcoordLocation) const
+{
+    GLint locations[] = { positionLocation, normalLocation, texcoordLocation };
+    for (const Attribute& attribute : attributes) {
+        GLint location = locations[attribute.semantic];
+        if (location < 0) {
+            continue;
+        }
+        glEnableVertexAttribArray((GLuint)location);
+        glVertexAttribPointer((GLuint)location, attribute.size, attribute.type, attribute.normalized,
+                              (GLsizei)stride, (const GLvoid*)attribute.offset);
+    }
+}
+
+void VertexLayout::layOut(bool hasNormals, bool hasTexcoords, const float lowest[3], const float highest[3])
+{
+    fill(positionOffset, positionOffset + 3, 0.0f);
+    fill(positionScale, positionScale + 3, 1.0f);
+    
+    if (formats.position == PositionFormat::Unorm16) {
+        // Three shorts, with two bytes of padding to keep the next attribute aligned.
+        addAttribute(Position, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8);
+        for (int axis = 0; axis < 3; ++axis) {
+            positionOffset[axis] = lowest[axis];
+            positionScale[axis] = highest[axis] - lowest[axis];
+        }
+    } else {
+        addAttribute(Position, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+    }
+    
+    if (hasNormals) {
+        if (formats.normal == NormalFormat::Int2101010) {
+            addAttribute(Normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4);
+        } else {
+            addAttribute(Normal, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+        }
+    }
+    
+    if (hasTexcoords) {
+        switch (formats.texcoord) {
+            case TexcoordFormat::Float:
+                addAttribute(Texcoord, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float));
+                break;
+            case TexcoordFormat::Half:
+                addAttribute(Texcoord, 2, GL_HALF_FLOAT, GL_FALSE, 4);
+                break;
+            case TexcoordFormat::Unorm16:
+                addAttribute(Texcoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, 4);
+                break;
+        }
+    }
+}
+
+void VertexLayout::addAttribute(Semantic semantic, GLint size, GLenum type, GLboolean normalized, size_t bytes)
+{
+    Attribute attribute = { semantic, size, type, normalized, stride };
+    attributes.push_back(attribute);
+    stride += (bytes + 3) & ~(size_t)3;
+}
@@ -0,0 +1,97 @@
+//
+//  VertexLayout.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__VertexLayout__
+#define __OpenGLApp__VertexLayout__
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MeshData.h"
+
+namespace OpenGLApp {
+    
+    // Unorm16 positions are stored relative to the mesh's bounding box, which the vertex
+    // shader undoes with the layout's position offset and scale.
+    enum class PositionFormat { Float, Unorm16 };
+    // Int2101010 is GL_INT_2_10_10_10_REV: three signed 10-bit components in one word.
+    enum class NormalFormat { Float, Int2101010 };
+    // Unorm16 texcoords are clamped to [0, 1], so only suit meshes that don't wrap.
+    enum class TexcoordFormat { Float, Half, Unorm16 };
+    
+    struct VertexFormats
+    {
+        PositionFormat position;
+        NormalFormat normal;
+        TexcoordFormat texcoord;
+    };
+    
+    // The named sets of formats --vertex-layout takes: "float" is 32 bytes a vertex, "compact"
+    // (10-bit normals, half texcoords) 20 and "quantized" (16-bit positions too) 16.
+    const char* getVertexFormatsName(const VertexFormats& formats);
+    bool parseVertexFormats(const char* name, VertexFormats& formats);
+    
+    // Where each attribute of one mesh goes in a single interleaved vertex buffer, and in what
+    // format. Only the attributes the mesh has are laid out; each starts on a 4-byte boundary,
+    // as GL wants for attributes fetched straight from the buffer. The glVertexAttribPointer()
+    // calls come from the same description that packs the buffer, so the two can't disagree.
+    class VertexLayout
+    {
+    public:
+        enum Semantic { Position, Normal, Texcoord };
+        
+        struct Attribute
+        {
+            Semantic semantic;
+            GLint size;
+            GLenum type;
+            GLboolean normalized;
+            size_t offset;
+        };
+        
+        VertexLayout(const MeshData& mesh, const VertexFormats& formats);
+        // The same layout from what it depends on: the formats, which attributes the mesh has
+        // and its bounds.
+        VertexLayout(const VertexFormats& formats, bool hasNormals, bool hasTexcoords, const float lowest[3], const float highest[3]);
+        
+        const VertexFormats& getFormats() const;
+        bool hasAttribute(Semantic semantic) const;
+        size_t getStride() const;
+        const std::vector<Attribute>& getAttributes() const;
+        
+        // What the vertex shader does to the position it reads to get the mesh's own back:
+        // offset + scale * position. Zero and one for float positions.
+        const float* getPositionOffset() const;
+        const float* getPositionScale() const;
+        
+        // The mesh's vertices, getStride() bytes each.
+        std::vector<uint8_t> pack(const MeshData& mesh) const;
+        
+        // One packed vertex as the vertex shader sees it, after normalisation and the position
+        // transform. normal and texcoord are left alone if the layout has none.
+        void unpack(const uint8_t* vertices, size_t vertex, float position[3], float normal[3], float texcoord[2]) const;
+        
+        // Points the attributes at the buffer bound to GL_ARRAY_BUFFER. Attributes whose
+        // location is -1, being unused by the shader, are left disabled. Needs the VAO bound.
+        void bindAttributes(GLint positionLocation, GLint normalLocation, GLint texcoordLocation) const;
+    private:
+        VertexFormats formats;
+        std::vector<Attribute> attributes;
+        size_t stride;
+        float positionOffset[3];
+        float positionScale[3];
+        
+        void layOut(bool hasNormals, bool hasTexcoords, const float lowest[3], const float highest[3]);
+        void addAttribute(Semantic semantic, GLint size, GLenum type, GLboolean normalized, size_t bytes);
+    };
+}
+
+#endif /* defined(__OpenGLApp__VertexLayout__) */
@@ -0,0 +1,138 @@
+//
+//  VoiceManager.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "VoiceManager.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    // Headroom a physical voice gets before it is dropped, in distance and in loudness, so a
+    // listener sitting on a boundary doesn't switch a track in and out every frame.
+    const float hysteresis = 1.1f;
+}
+
+VoiceManager::Settings::Settings() :
+    referenceDistance(25.0f), maxDistance(200.0f), rolloffFactor(1.0f), cullDistance(200.0f), minAudibleGain(0.01f), maxVoices(32)
+{
+}
+
+VoiceManager::VoiceManager(const Settings& settings) : settings(settings), numPhysical(0)
+{
+    listener[0] = listener[1] = listener[2] = 0.0f;
+    stats.updates = 0;
+    stats.virtualisations = 0;
+    stats.devirtualisations = 0;
+}
+
+size_t VoiceManager::addVoice(float x, float y, float z, float gain)
+{
+    Voice voice = { x, y, z, gain, 0.0f, false };
+    voices.push_back(voice);
+    ranking.push_back(voices.size() - 1);
+    return voices.size() - 1;
+}
+
+void VoiceManager::setVoicePosition(size_t voice, float x, float y, float z)
+{
+    voices.at(voice).x = x;
+    voices.at(voice).y = y;
+    voices.at(voice).z = z;
+}
+
+void VoiceManager::setVoiceGain(size_t voice, float gain)
+{
+    voices.at(voice).gain = gain;
+}
+
+void VoiceManager::setListenerPosition(float x, float y, float z)
+{
+    listener[0] = x;
+    listener[1] = y;
+    listener[2] = z;
+}
+
+void VoiceManager::setMaxVoices(size_t maxVoices)
+{
+    settings.maxVoices = maxVoices;
+}
+
+float VoiceManager::computeAudibility(const Voice& voice) const
+{
+    float dx = voice.x - listener[0], dy = voice.y - listener[1], dz = voice.z - listener[2];
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+    
+    // A voice already playing is held on to a little longer than a silent one is let in.
+    float margin = voice.physical ? hysteresis : 1.0f;
+    if (distance > settings.cullDistance * margin) {
+        return 0.0f;
+    }
+    float clamped = min(max(distance, settings.referenceDistance), settings.maxDistance);
+    float gain = voice.gain * settings.referenceDistance /
+        (settings.referenceDistance + settings.rolloffFactor * (clamped - settings.referenceDistance));
+    return gain * margin >= settings.minAudibleGain ? gain * margin : 0.0f;
+}
+
+void VoiceManager::update(vector<size_t>& becamePhysical, vector<size_t>& becameVirtual)
+{
+    becamePhysical.clear();
+    becameVirtual.clear();
+    for (auto& voice : voices) {
+        voice.audibility = computeAudibility(voice);
+    }
+    
+    // Loudest first; ties keep the order they had, which favours voices already playing.
+    stable_sort(ranking.begin(), ranking.end(), [this](size_t a, size_t b) {
+        return voices[a].audibility > voices[b].audibility;
+    });
+    
+    numPhysical = 0;
+    for (size_t i = 0; i < ranking.size(); ++i) {
+        Voice& voice = voices[ranking[i]];
+        bool physical = voice.audibility > 0.0f && numPhysical < settings.maxVoices;
+        if (physical) {
+            ++numPhysical;
+        }
+        if (physical != voice.physical) {
+            voice.physical = physical;
+            (physical ? becamePhysical : becameVirtual).push_back(ranking[i]);
+        }
+    }
+    
+    ++stats.updates;
+    stats.devirtualisations += becamePhysical.size();
+    stats.virtualisations += becameVirtual.size();
+}
+
+bool VoiceManager::isPhysical(size_t voice) const
+{
+    return voices.at(voice).physical;
+}
+
+size_t VoiceManager::getNumVoices() const
+{
+    return voices.size();
+}
+
+size_t VoiceManager::getNumPhysical() const
+{
+    return numPhysical;
+}
+
+const VoiceManager::Settings& VoiceManager::getSettings() const
+{
+    return settings;
+}
+
+VoiceManager::Stats VoiceManager::getStats() const
+{
+    return stats;
+}
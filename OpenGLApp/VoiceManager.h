@@ -0,0 +1,89 @@
+//
+//  VoiceManager.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__VoiceManager__
+#define __OpenGLApp__VoiceManager__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OpenGLApp {
+    
+    // Decides which tracks are worth mixing. Each voice's loudness at the listener is
+    // estimated from its gain and the same inverse-distance-clamped attenuation the
+    // sources use; voices past the cull distance or quieter than minAudibleGain are
+    // virtual, and of the rest only the loudest maxVoices are physical. The output stops
+    // mixing a virtual voice but its place in the song carries on with the transport, so
+    // it comes back on the right sample when it becomes physical again.
+    //
+    // OpenAL's clamped model holds a source at 1/8 of its gain past AL_MAX_DISTANCE rather
+    // than silencing it, so the cull distance is what actually drops far-off tracks.
+    class VoiceManager
+    {
+    public:
+        struct Settings
+        {
+            float referenceDistance;
+            float maxDistance;
+            float rolloffFactor;
+            float cullDistance;
+            float minAudibleGain;
+            size_t maxVoices;
+            
+            // The distances playback gives its sources, culling at the maximum distance and
+            // below -40 dB, with 32 voices.
+            Settings();
+        };
+        
+        struct Stats
+        {
+            uint64_t updates;
+            uint64_t virtualisations;
+            uint64_t devirtualisations;
+        };
+        
+        VoiceManager(const Settings& settings = Settings());
+        
+        // New voices start virtual; the next update() says whether they should be mixed.
+        size_t addVoice(float x, float y, float z, float gain = 1.0f);
+        void setVoicePosition(size_t voice, float x, float y, float z);
+        void setVoiceGain(size_t voice, float gain);
+        
+        void setListenerPosition(float x, float y, float z);
+        void setMaxVoices(size_t maxVoices);
+        
+        // Re-ranks every voice and reports which ones must start and stop being mixed.
+        void update(std::vector<size_t>& becamePhysical, std::vector<size_t>& becameVirtual);
+        
+        bool isPhysical(size_t voice) const;
+        size_t getNumVoices() const;
+        size_t getNumPhysical() const;
+        const Settings& getSettings() const;
+        Stats getStats() const;
+    private:
+        struct Voice
+        {
+            float x, y, z;
+            float gain;
+            float audibility;
+            bool physical;
+        };
+        
+        Settings settings;
+        float listener[3];
+        std::vector<Voice> voices;
+        std::vector<size_t> ranking;
+        size_t numPhysical;
+        Stats stats;
+        
+        float computeAudibility(const Voice& voice) const;
+    };
+}
+
+#endif /* defined(__OpenGLApp__VoiceManager__) */
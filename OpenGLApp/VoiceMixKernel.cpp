@@ -0,0 +1,310 @@
+//
+//  VoiceMixKernel.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "VoiceMixKernel.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define OPENGLAPP_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define OPENGLAPP_HAS_SSE2 0
+#endif
+
+// AVX2 is compiled per function with a target attribute so the rest of the app keeps
+// running on CPUs without it; detectSimdLevel() only picks it when the CPU reports it.
+#if OPENGLAPP_HAS_SSE2 && defined(__GNUC__)
+#define OPENGLAPP_HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define OPENGLAPP_HAS_AVX2 0
+#endif
+
+using namespace std;
+using namespace OpenGLApp;
+
+size_t VoiceMixBatch::size() const
+{
+    return tables.size();
+}
+
+void VoiceMixBatch::clear()
+{
+    tables.clear();
+    phases.clear();
+    increments.clear();
+    levels.clear();
+    envelopeScales.clear();
+    envelopeOffsets.clear();
+    gainsLeft.clear();
+    gainsRight.clear();
+    startFrames.clear();
+    frameCounts.clear();
+}
+
+void VoiceMixBatch::push(const float* table, float phase, float increment, float level, float envelopeScale, float envelopeOffset,
+                         float gainLeft, float gainRight, uint32_t startFrame, uint32_t frameCount)
+{
+    tables.push_back(table);
+    phases.push_back(phase);
+    increments.push_back(increment);
+    levels.push_back(level);
+    envelopeScales.push_back(envelopeScale);
+    envelopeOffsets.push_back(envelopeOffset);
+    gainsLeft.push_back(gainLeft);
+    gainsRight.push_back(gainRight);
+    startFrames.push_back(startFrame);
+    frameCounts.push_back(frameCount);
+}
+
+namespace {
+    // Every kernel comes in a stereo and a mono form. The mono one mixes into left alone with
+    // the gainsLeft gains and never touches right, halving the output traffic.
+    
+    // Plain per-frame loop; also finishes the frames left over after the vector loops.
+    template <bool stereo>
+    void mixVoiceFrames(const float* table, float size, float& phase, float increment, float& level, float scale, float offset,
+                        float gainLeft, float gainRight, float* left, float* right, size_t numFrames)
+    {
+        for (size_t i = 0; i < numFrames; ++i) {
+            level = level * scale + offset;
+            
+            size_t index = (size_t)phase;
+            float frac = phase - index;
+            float sample = (table[index] + frac * (table[index + 1] - table[index])) * level;
+            
+            left[i] += sample * gainLeft;
+            if (stereo) {
+                right[i] += sample * gainRight;
+            }
+            
+            phase += increment;
+            while (phase >= size) {
+                phase -= size;
+            }
+        }
+    }
+    
+    template <bool stereo>
+    void mixVoicesScalar(VoiceMixBatch& batch, size_t tableSize, float* left, float* right)
+    {
+        for (size_t v = 0; v < batch.size(); ++v) {
+            size_t start = batch.startFrames[v];
+            mixVoiceFrames<stereo>(batch.tables[v], (float)tableSize, batch.phases[v], batch.increments[v], batch.levels[v],
+                                   batch.envelopeScales[v], batch.envelopeOffsets[v], batch.gainsLeft[v], batch.gainsRight[v],
+                                   left + start, stereo ? right + start : NULL, batch.frameCounts[v]);
+        }
+    }
+    
+    // Lane k of a vector holds the envelope k + 1 steps ahead, so
+    // level[k] = scales[k] * level + offsets[k] for the level before the vector.
+    void envelopeLanes(float scale, float offset, float* scales, float* offsets, int lanes)
+    {
+        float a = scale, b = offset;
+        for (int k = 0; k < lanes; ++k) {
+            scales[k] = a;
+            offsets[k] = b;
+            a *= scale;
+            b = b * scale + offset;
+        }
+    }
+    
+    // Phases are wrapped by subtracting whole multiples of the table size; with a power of
+    // two size that is exact, so lanes never land outside [0, size).
+    float wrapPhase(float phase, float size, float inverseSize)
+    {
+        return phase - floorf(phase * inverseSize) * size;
+    }
+
+#if OPENGLAPP_HAS_SSE2
+    template <bool stereo>
+    void mixVoicesSSE2(VoiceMixBatch& batch, size_t tableSize, float* left, float* right)
+    {
+        const float size = (float)tableSize;
+        const float inverseSize = 1.0f / size;
+        const __m128 vSize = _mm_set1_ps(size);
+        const __m128 vInverseSize = _mm_set1_ps(inverseSize);
+        const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        
+        for (size_t v = 0; v < batch.size(); ++v) {
+            const float* table = batch.tables[v];
+            float phase = batch.phases[v];
+            float level = batch.levels[v];
+            float increment = batch.increments[v];
+            size_t numFrames = batch.frameCounts[v];
+            float* outLeft = left + batch.startFrames[v];
+            float* outRight = stereo ? right + batch.startFrames[v] : NULL;
+            
+            float scales[4], offsets[4];
+            envelopeLanes(batch.envelopeScales[v], batch.envelopeOffsets[v], scales, offsets, 4);
+            const __m128 vScales = _mm_loadu_ps(scales);
+            const __m128 vOffsets = _mm_loadu_ps(offsets);
+            const __m128 vLaneIncrements = _mm_mul_ps(laneIndex, _mm_set1_ps(increment));
+            const __m128 vGainLeft = _mm_set1_ps(batch.gainsLeft[v]);
+            const __m128 vGainRight = _mm_set1_ps(batch.gainsRight[v]);
+            
+            size_t i = 0;
+            for (; i + 4 <= numFrames; i += 4) {
+                __m128 p = _mm_add_ps(_mm_set1_ps(phase), vLaneIncrements);
+                __m128 wraps = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(p, vInverseSize)));
+                p = _mm_sub_ps(p, _mm_mul_ps(wraps, vSize));
+                
+                __m128i index = _mm_cvttps_epi32(p);
+                __m128 frac = _mm_sub_ps(p, _mm_cvtepi32_ps(index));
+                
+                // No gather before AVX2, so the table reads stay scalar.
+                int32_t lanes[4];
+                _mm_storeu_si128((__m128i*)lanes, index);
+                __m128 a = _mm_setr_ps(table[lanes[0]], table[lanes[1]], table[lanes[2]], table[lanes[3]]);
+                __m128 b = _mm_setr_ps(table[lanes[0] + 1], table[lanes[1] + 1], table[lanes[2] + 1], table[lanes[3] + 1]);
+                
+                __m128 levels = _mm_add_ps(_mm_mul_ps(vScales, _mm_set1_ps(level)), vOffsets);
+                __m128 sample = _mm_mul_ps(_mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a))), levels);
+                
+                _mm_storeu_ps(outLeft + i, _mm_add_ps(_mm_loadu_ps(outLeft + i), _mm_mul_ps(sample, vGainLeft)));
+                if (stereo) {
+                    _mm_storeu_ps(outRight + i, _mm_add_ps(_mm_loadu_ps(outRight + i), _mm_mul_ps(sample, vGainRight)));
+                }
+                
+                level = _mm_cvtss_f32(_mm_shuffle_ps(levels, levels, _MM_SHUFFLE(3, 3, 3, 3)));
+                phase = wrapPhase(phase + 4.0f * increment, size, inverseSize);
+            }
+            
+            mixVoiceFrames<stereo>(table, size, phase, increment, level, batch.envelopeScales[v], batch.envelopeOffsets[v],
+                                   batch.gainsLeft[v], batch.gainsRight[v], outLeft + i, stereo ? outRight + i : NULL, numFrames - i);
+                           
+            batch.phases[v] = phase;
+            batch.levels[v] = level;
+        }
+    }
+#endif
+
+#if OPENGLAPP_HAS_AVX2
+    template <bool stereo>
+    __attribute__((target("avx2,fma")))
+    void mixVoicesAVX2(VoiceMixBatch& batch, size_t tableSize, float* left, float* right)
+    {
+        const float size = (float)tableSize;
+        const float inverseSize = 1.0f / size;
+        const __m256 vSize = _mm256_set1_ps(size);
+        const __m256 vInverseSize = _mm256_set1_ps(inverseSize);
+        const __m256 laneIndex = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256i one = _mm256_set1_epi32(1);
+        
+        for (size_t v = 0; v < batch.size(); ++v) {
+            const float* table = batch.tables[v];
+            float phase = batch.phases[v];
+            float level = batch.levels[v];
+            float increment = batch.increments[v];
+            size_t numFrames = batch.frameCounts[v];
+            float* outLeft = left + batch.startFrames[v];
+            float* outRight = stereo ? right + batch.startFrames[v] : NULL;
+            
+            float scales[8], offsets[8];
+            envelopeLanes(batch.envelopeScales[v], batch.envelopeOffsets[v], scales, offsets, 8);
+            const __m256 vScales = _mm256_loadu_ps(scales);
+            const __m256 vOffsets = _mm256_loadu_ps(offsets);
+            const __m256 vLaneIncrements = _mm256_mul_ps(laneIndex, _mm256_set1_ps(increment));
+            const __m256 vGainLeft = _mm256_set1_ps(batch.gainsLeft[v]);
+            const __m256 vGainRight = _mm256_set1_ps(batch.gainsRight[v]);
+            
+            size_t i = 0;
+            for (; i + 8 <= numFrames; i += 8) {
+                __m256 p = _mm256_add_ps(_mm256_set1_ps(phase), vLaneIncrements);
+                p = _mm256_fnmadd_ps(_mm256_floor_ps(_mm256_mul_ps(p, vInverseSize)), vSize, p);
+                
+                __m256i index = _mm256_cvttps_epi32(p);
+                __m256 frac = _mm256_sub_ps(p, _mm256_cvtepi32_ps(index));
+                __m256 a = _mm256_i32gather_ps(table, index, 4);
+                __m256 b = _mm256_i32gather_ps(table, _mm256_add_epi32(index, one), 4);
+                
+                __m256 levels = _mm256_fmadd_ps(vScales, _mm256_set1_ps(level), vOffsets);
+                __m256 sample = _mm256_mul_ps(_mm256_fmadd_ps(frac, _mm256_sub_ps(b, a), a), levels);
+                
+                _mm256_storeu_ps(outLeft + i, _mm256_fmadd_ps(sample, vGainLeft, _mm256_loadu_ps(outLeft + i)));
+                if (stereo) {
+                    _mm256_storeu_ps(outRight + i, _mm256_fmadd_ps(sample, vGainRight, _mm256_loadu_ps(outRight + i)));
+                }
+                
+                level = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(levels, _mm256_set1_epi32(7)));
+                phase = wrapPhase(phase + 8.0f * increment, size, inverseSize);
+            }
+            
+            mixVoiceFrames<stereo>(table, size, phase, increment, level, batch.envelopeScales[v], batch.envelopeOffsets[v],
+                                   batch.gainsLeft[v], batch.gainsRight[v], outLeft + i, stereo ? outRight + i : NULL, numFrames - i);
+                           
+            batch.phases[v] = phase;
+            batch.levels[v] = level;
+        }
+    }
+#endif
+}
+
+bool OpenGLApp::isSimdLevelSupported(SimdLevel level)
+{
+    switch (level) {
+        case SimdLevel::Scalar:
+            return true;
+        case SimdLevel::SSE2:
+            return OPENGLAPP_HAS_SSE2;
+        case SimdLevel::AVX2:
+#if OPENGLAPP_HAS_AVX2
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+SimdLevel OpenGLApp::detectSimdLevel()
+{
+    if (isSimdLevelSupported(SimdLevel::AVX2)) {
+        return SimdLevel::AVX2;
+    }
+    if (isSimdLevelSupported(SimdLevel::SSE2)) {
+        return SimdLevel::SSE2;
+    }
+    return SimdLevel::Scalar;
+}
+
+const char* OpenGLApp::getSimdLevelName(SimdLevel level)
+{
+    switch (level) {
+        case SimdLevel::Scalar:
+            return "scalar";
+        case SimdLevel::SSE2:
+            return "sse2";
+        case SimdLevel::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+VoiceMixFunction OpenGLApp::getVoiceMixFunction(SimdLevel level, unsigned int channels)
+{
+    bool stereo = channels > 1;
+    
+    // Fall back to the scalar kernel for anything this build or CPU can't run.
+    if (!isSimdLevelSupported(level)) {
+        return stereo ? mixVoicesScalar<true> : mixVoicesScalar<false>;
+    }
+    switch (level) {
+#if OPENGLAPP_HAS_AVX2
+        case SimdLevel::AVX2:
+            return stereo ? mixVoicesAVX2<true> : mixVoicesAVX2<false>;
+#endif
+#if OPENGLAPP_HAS_SSE2
+        case SimdLevel::SSE2:
+            return stereo ? mixVoicesSSE2<true> : mixVoicesSSE2<false>;
+#endif
+        default:
+            return stereo ? mixVoicesScalar<true> : mixVoicesScalar<false>;
+    }
+}
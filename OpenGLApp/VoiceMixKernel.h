@@ -0,0 +1,57 @@
+//
+//  VoiceMixKernel.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__VoiceMixKernel__
+#define __OpenGLApp__VoiceMixKernel__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OpenGLApp {
+    
+    enum class SimdLevel { Scalar, SSE2, AVX2 };
+    
+    // The widest level both compiled in and supported by this CPU.
+    SimdLevel detectSimdLevel();
+    bool isSimdLevelSupported(SimdLevel level);
+    const char* getSimdLevelName(SimdLevel level);
+    
+    // Voices to be mixed into one block, in structure-of-arrays form. Each voice runs for
+    // frameCounts[i] frames from startFrames[i] with a fixed envelope step
+    //     level = level * envelopeScales[i] + envelopeOffsets[i]
+    // applied before every frame, which covers the attack, decay, sustain and release stages.
+    // Phases and levels are written back so the caller can carry them into the next run.
+    struct VoiceMixBatch
+    {
+        std::vector<const float*> tables;
+        std::vector<float> phases;
+        std::vector<float> increments;
+        std::vector<float> levels;
+        std::vector<float> envelopeScales;
+        std::vector<float> envelopeOffsets;
+        std::vector<float> gainsLeft;
+        std::vector<float> gainsRight;
+        std::vector<uint32_t> startFrames;
+        std::vector<uint32_t> frameCounts;
+        
+        size_t size() const;
+        void clear();
+        void push(const float* table, float phase, float increment, float level, float envelopeScale, float envelopeOffset,
+                  float gainLeft, float gainRight, uint32_t startFrame, uint32_t frameCount);
+    };
+    
+    // Adds every voice in the batch into left/right. Tables hold tableSize (a power of two)
+    // samples plus one guard sample and phases must lie in [0, tableSize).
+    typedef void (*VoiceMixFunction)(VoiceMixBatch& batch, size_t tableSize, float* left, float* right);
+    
+    // With channels == 1 the function mixes into left only, using gainsLeft; right may be null.
+    VoiceMixFunction getVoiceMixFunction(SimdLevel level, unsigned int channels = 2);
+}
+
+#endif /* defined(__OpenGLApp__VoiceMixKernel__) */
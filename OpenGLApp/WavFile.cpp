@@ -0,0 +1,72 @@
+//
+//  WavFile.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "WavFile.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    void putLittleEndian(unsigned char* dest, uint32_t value, int numBytes)
+    {
+        for (int i = 0; i < numBytes; ++i) {
+            dest[i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+}
+
+bool OpenGLApp::writeWavFile(const std::string& path, const int16_t* interleavedSamples, size_t numFrames, unsigned int numChannels, unsigned int sampleRate)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    
+    uint32_t blockAlign = numChannels * sizeof(int16_t);
+    uint32_t dataBytes = (uint32_t)(numFrames * blockAlign);
+    
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    putLittleEndian(header + 4, 36 + dataBytes, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLittleEndian(header + 16, 16, 4);                        // fmt chunk size
+    putLittleEndian(header + 20, 1, 2);                         // PCM
+    putLittleEndian(header + 22, numChannels, 2);
+    putLittleEndian(header + 24, sampleRate, 4);
+    putLittleEndian(header + 28, sampleRate * blockAlign, 4);   // byte rate
+    putLittleEndian(header + 32, blockAlign, 2);
+    putLittleEndian(header + 34, 16, 2);                        // bits per sample
+    memcpy(header + 36, "data", 4);
+    putLittleEndian(header + 40, dataBytes, 4);
+    
+    bool ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+    
+    // WAV is little-endian, as are all the machines we build for.
+    if (ok && dataBytes > 0) {
+        ok = fwrite(interleavedSamples, 1, dataBytes, fp) == dataBytes;
+    }
+    
+    return (fclose(fp) == 0) && ok;
+}
+
+void OpenGLApp::floatToInt16(const float* in, int16_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        float v = in[i] * 32767.0f;
+        if (v > 32767.0f) {
+            v = 32767.0f;
+        } else if (v < -32768.0f) {
+            v = -32768.0f;
+        }
+        out[i] = (int16_t)lrintf(v);
+    }
+}
@@ -0,0 +1,25 @@
+//
+//  WavFile.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__WavFile__
+#define __OpenGLApp__WavFile__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace OpenGLApp {
+    
+    // Minimal 16-bit PCM RIFF/WAVE writer, used where ExtAudioFile isn't available.
+    bool writeWavFile(const std::string& path, const int16_t* interleavedSamples, size_t numFrames, unsigned int numChannels, unsigned int sampleRate);
+    
+    // Converts float samples in [-1, 1] to 16-bit with clipping.
+    void floatToInt16(const float* in, int16_t* out, size_t count);
+}
+
+#endif /* defined(__OpenGLApp__WavFile__) */
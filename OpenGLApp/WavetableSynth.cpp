@@ -0,0 +1,525 @@
+//
+//  WavetableSynth.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "WavetableSynth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+using namespace OpenGLApp;
+
+namespace {
+    const double twoPi = 6.283185307179586;
+    const float silenceLevel = 1e-4f;
+    const int percussionChannel = 9;
+    
+    // Builds a normalised single-cycle table from harmonic amplitudes (harmonics[0] is the fundamental).
+    vector<float> additiveTable(const vector<float>& harmonics)
+    {
+        const size_t size = WavetableInstrument::tableSize;
+        vector<float> table(size + 1, 0.0f);
+        
+        for (size_t h = 0; h < harmonics.size(); ++h) {
+            if (harmonics[h] == 0.0f) {
+                continue;
+            }
+            for (size_t i = 0; i < size; ++i) {
+                table[i] += harmonics[h] * (float)sin(twoPi * (h + 1) * i / size);
+            }
+        }
+        
+        float peak = 0.0f;
+        for (size_t i = 0; i < size; ++i) {
+            peak = max(peak, fabsf(table[i]));
+        }
+        if (peak > 0.0f) {
+            for (size_t i = 0; i < size; ++i) {
+                table[i] /= peak;
+            }
+        }
+        table[size] = table[0];
+        return table;
+    }
+    
+    vector<float> seriesHarmonics(int count, float falloff, bool oddOnly)
+    {
+        vector<float> harmonics(count, 0.0f);
+        for (int h = 0; h < count; ++h) {
+            if (oddOnly && (h % 2) == 1) {
+                continue;
+            }
+            harmonics[h] = 1.0f / powf((float)(h + 1), falloff);
+        }
+        return harmonics;
+    }
+    
+    WavetableInstrument makeInstrument(const vector<float>& harmonics, float attack, float decay, float sustain, float release)
+    {
+        WavetableInstrument instrument;
+        instrument.table = additiveTable(harmonics);
+        instrument.attackSeconds = attack;
+        instrument.decaySeconds = decay;
+        instrument.sustainLevel = sustain;
+        instrument.releaseSeconds = release;
+        instrument.fixedPitch = false;
+        return instrument;
+    }
+    
+    // Coefficient that takes an exponential envelope from 1 down to silenceLevel in the given time.
+    float decayCoefficient(float seconds, double sampleRate)
+    {
+        if (seconds <= 0.0f) {
+            return 0.0f;
+        }
+        return (float)exp(log(silenceLevel) / (seconds * sampleRate));
+    }
+}
+
+WavetableBank WavetableBank::createGeneralMidi()
+{
+    WavetableBank bank;
+    bank.name = "gm-additive-1";
+    
+    vector<float> organ(16, 0.0f);
+    organ[0] = 1.0f; organ[1] = 0.8f; organ[2] = 0.6f; organ[3] = 0.5f; organ[5] = 0.3f; organ[7] = 0.25f;
+    
+    vector<float> pipe(4, 0.0f);
+    pipe[0] = 1.0f; pipe[1] = 0.15f; pipe[2] = 0.05f;
+    
+    vector<float> sine(1, 1.0f);
+    
+    auto& f = bank.families;
+    f.push_back(makeInstrument(seriesHarmonics(24, 1.5f, false), 0.002f, 1.5f, 0.0f, 0.3f));   // piano
+    f.push_back(makeInstrument(seriesHarmonics(6, 2.0f, false), 0.001f, 0.9f, 0.0f, 0.4f));    // chromatic percussion
+    f.push_back(makeInstrument(organ, 0.005f, 0.0f, 1.0f, 0.05f));                            // organ
+    f.push_back(makeInstrument(seriesHarmonics(20, 1.2f, false), 0.002f, 1.2f, 0.1f, 0.2f));   // guitar
+    f.push_back(makeInstrument(seriesHarmonics(12, 2.0f, false), 0.005f, 0.5f, 0.5f, 0.1f));   // bass
+    f.push_back(makeInstrument(seriesHarmonics(32, 1.0f, false), 0.08f, 0.2f, 0.8f, 0.3f));    // strings
+    f.push_back(makeInstrument(seriesHarmonics(32, 1.1f, false), 0.12f, 0.2f, 0.8f, 0.4f));    // ensemble
+    f.push_back(makeInstrument(seriesHarmonics(24, 1.0f, false), 0.03f, 0.1f, 0.9f, 0.15f));   // brass
+    f.push_back(makeInstrument(seriesHarmonics(24, 1.0f, true), 0.02f, 0.1f, 0.9f, 0.1f));     // reed
+    f.push_back(makeInstrument(pipe, 0.04f, 0.1f, 0.9f, 0.15f));                               // pipe
+    f.push_back(makeInstrument(seriesHarmonics(24, 1.0f, true), 0.005f, 0.1f, 0.9f, 0.1f));    // synth lead
+    f.push_back(makeInstrument(seriesHarmonics(16, 2.0f, true), 0.3f, 0.5f, 0.9f, 0.8f));      // synth pad
+    f.push_back(makeInstrument(seriesHarmonics(16, 2.0f, true), 0.2f, 0.5f, 0.8f, 0.8f));      // synth effects
+    f.push_back(makeInstrument(seriesHarmonics(20, 1.3f, false), 0.002f, 1.0f, 0.1f, 0.2f));   // ethnic
+    f.push_back(makeInstrument(seriesHarmonics(6, 2.0f, false), 0.001f, 0.6f, 0.0f, 0.3f));    // percussive
+    f.push_back(makeInstrument(sine, 0.01f, 0.3f, 0.6f, 0.3f));                               // sound effects
+    
+    // Percussion: a cycle of white noise with a short decay, pitched by note number.
+    WavetableInstrument& kit = bank.percussion;
+    kit.table.resize(WavetableInstrument::tableSize + 1);
+    uint32_t seed = 0x1234567;
+    for (size_t i = 0; i < WavetableInstrument::tableSize; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        kit.table[i] = ((seed >> 8) & 0xffff) / 32768.0f - 1.0f;
+    }
+    kit.table[WavetableInstrument::tableSize] = kit.table[0];
+    kit.attackSeconds = 0.001f;
+    kit.decaySeconds = 0.2f;
+    kit.sustainLevel = 0.0f;
+    kit.releaseSeconds = 0.05f;
+    kit.fixedPitch = true;
+    
+    return bank;
+}
+
+const WavetableInstrument& WavetableBank::instrumentForProgram(int program, bool isPercussion) const
+{
+    if (isPercussion) {
+        return percussion;
+    }
+    return families[(program / 8) % families.size()];
+}
+
+const std::string& WavetableBank::getName() const
+{
+    return name;
+}
+
+WavetableSynth::WavetableSynth(const WavetableBank& bank, double sampleRate, unsigned int maxVoices) : bank(bank), sampleRate(sampleRate), mixedVoiceFrames(0), voices(max(1u, maxVoices))
+{
+    setSimdLevel(detectSimdLevel());
+    reset();
+}
+
+void WavetableSynth::reset()
+{
+    currentFrame = 0;
+    nextVoiceAge = 0;
+    for (auto& voice : voices) {
+        voice.stage = Off;
+    }
+    for (int i = 0; i < 16; ++i) {
+        channels[i].program = 0;
+        channels[i].volume = 100.0f / 127.0f;
+        channels[i].expression = 1.0f;
+        setPan(channels[i], 0.5f);
+        channels[i].pitchBend = 0.0f;
+        channels[i].sustain = false;
+    }
+}
+
+uint64_t WavetableSynth::getCurrentFrame() const
+{
+    return currentFrame;
+}
+
+double WavetableSynth::getSampleRate() const
+{
+    return sampleRate;
+}
+
+void WavetableSynth::setSimdLevel(SimdLevel level)
+{
+    simdLevel = isSimdLevelSupported(level) ? level : SimdLevel::Scalar;
+    mixVoices = getVoiceMixFunction(simdLevel);
+    mixVoicesMono = getVoiceMixFunction(simdLevel, 1);
+}
+
+SimdLevel WavetableSynth::getSimdLevel() const
+{
+    return simdLevel;
+}
+
+uint64_t WavetableSynth::getMixedVoiceFrames() const
+{
+    return mixedVoiceFrames;
+}
+
+unsigned int WavetableSynth::getNumActiveVoices() const
+{
+    unsigned int count = 0;
+    for (auto& voice : voices) {
+        if (voice.stage != Off) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void WavetableSynth::handleEvent(unsigned char status, unsigned char data1, unsigned char data2)
+{
+    int channel = status & 0x0f;
+    Channel& state = channels[channel];
+    
+    switch (status & 0xf0) {
+        case 0x90:
+            // Note-on with zero velocity is a note-off.
+            if (data2 > 0) {
+                noteOn(channel, data1, data2);
+            } else {
+                noteOff(channel, data1);
+            }
+            break;
+        case 0x80:
+            noteOff(channel, data1);
+            break;
+        case 0xb0:
+            switch (data1) {
+                case 7:
+                    state.volume = data2 / 127.0f;
+                    break;
+                case 10:
+                    setPan(state, data2 / 127.0f);
+                    break;
+                case 11:
+                    state.expression = data2 / 127.0f;
+                    break;
+                case 64:
+                    state.sustain = data2 >= 64;
+                    if (!state.sustain) {
+                        for (auto& voice : voices) {
+                            if (voice.stage != Off && voice.channel == channel && voice.held) {
+                                releaseVoice(voice);
+                            }
+                        }
+                    }
+                    break;
+                case 120:
+                case 123:
+                    allNotesOff(channel);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 0xc0:
+            state.program = data1;
+            break;
+        case 0xe0:
+            state.pitchBend = (((data2 << 7) | data1) - 8192) / 8192.0f * 2.0f;
+            for (auto& voice : voices) {
+                if (voice.stage != Off && voice.channel == channel) {
+                    updatePitch(voice);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+WavetableSynth::Voice& WavetableSynth::allocateVoice(int channel, int note)
+{
+    // Retrigger the same note on the same channel rather than stacking it.
+    for (auto& voice : voices) {
+        if (voice.stage != Off && voice.channel == channel && voice.note == note) {
+            return voice;
+        }
+    }
+    for (auto& voice : voices) {
+        if (voice.stage == Off) {
+            return voice;
+        }
+    }
+    
+    // Steal the oldest released voice, or failing that the oldest voice overall.
+    Voice* oldestReleased = NULL;
+    Voice* oldest = &voices[0];
+    for (auto& voice : voices) {
+        if (voice.stage == Release && (!oldestReleased || voice.age < oldestReleased->age)) {
+            oldestReleased = &voice;
+        }
+        if (voice.age < oldest->age) {
+            oldest = &voice;
+        }
+    }
+    return oldestReleased ? *oldestReleased : *oldest;
+}
+
+void WavetableSynth::updatePitch(Voice& voice)
+{
+    double semitones = voice.note - 69;
+    if (!voice.instrument->fixedPitch) {
+        semitones += channels[voice.channel].pitchBend;
+    }
+    double frequency = 440.0 * pow(2.0, semitones / 12.0);
+    voice.phaseIncrement = (float)(frequency * WavetableInstrument::tableSize / sampleRate);
+}
+
+void WavetableSynth::setPan(Channel& state, float pan)
+{
+    state.panLeft = (float)cos(pan * twoPi / 4.0);
+    state.panRight = (float)sin(pan * twoPi / 4.0);
+}
+
+void WavetableSynth::noteOn(int channel, int note, int velocity)
+{
+    const Channel& state = channels[channel];
+    Voice& voice = allocateVoice(channel, note);
+    const WavetableInstrument& instrument = bank.instrumentForProgram(state.program, channel == percussionChannel);
+    
+    float v = velocity / 127.0f;
+    
+    voice.stage = Attack;
+    voice.channel = channel;
+    voice.note = note;
+    voice.held = false;
+    voice.age = nextVoiceAge++;
+    voice.instrument = &instrument;
+    voice.phase = 0.0f;
+    voice.velocityGain = v * v * 0.25f;
+    voice.level = 0.0f;
+    voice.attackStep = instrument.attackSeconds > 0.0f ? (float)(1.0 / (instrument.attackSeconds * sampleRate)) : 1.0f;
+    voice.decayCoefficient = decayCoefficient(instrument.decaySeconds, sampleRate);
+    voice.releaseCoefficient = decayCoefficient(instrument.releaseSeconds, sampleRate);
+    updatePitch(voice);
+}
+
+void WavetableSynth::releaseVoice(Voice& voice)
+{
+    voice.held = false;
+    voice.stage = Release;
+}
+
+void WavetableSynth::noteOff(int channel, int note)
+{
+    for (auto& voice : voices) {
+        if (voice.stage == Off || voice.stage == Release || voice.channel != channel || voice.note != note) {
+            continue;
+        }
+        if (channels[channel].sustain) {
+            voice.held = true;
+        } else {
+            releaseVoice(voice);
+        }
+    }
+}
+
+void WavetableSynth::allNotesOff(int channel)
+{
+    for (auto& voice : voices) {
+        if (voice.stage != Off && voice.channel == channel) {
+            releaseVoice(voice);
+        }
+    }
+}
+
+void WavetableSynth::process(const std::vector<SynthEvent>& events, size_t& nextEvent, float* left, float* right, size_t numFrames)
+{
+    size_t done = 0;
+    
+    while (done < numFrames) {
+        // Apply everything that is due now, then render up to the next event or the end of the block.
+        applyEvents(events, nextEvent);
+        
+        size_t chunk = numFrames - done;
+        if (nextEvent < events.size()) {
+            chunk = (size_t)min((uint64_t)chunk, events[nextEvent].frame - currentFrame);
+        }
+        
+        renderVoices(left + done, right ? right + done : NULL, chunk);
+        done += chunk;
+        currentFrame += chunk;
+    }
+}
+
+void WavetableSynth::applyEvents(const std::vector<SynthEvent>& events, size_t& nextEvent)
+{
+    while (nextEvent < events.size() && events[nextEvent].frame <= currentFrame) {
+        const SynthEvent& event = events[nextEvent++];
+        handleEvent(event.status, event.data1, event.data2);
+    }
+}
+
+void WavetableSynth::skipFrames(uint64_t numFrames)
+{
+    currentFrame += numFrames;
+}
+
+uint64_t WavetableSynth::getTailFrames() const
+{
+    uint64_t tail = 0;
+    for (auto& voice : voices) {
+        // Walk a copy of the voice through its remaining envelope stages.
+        Voice envelope = voice;
+        uint64_t frames = 0;
+        while (envelope.stage != Off) {
+            if (envelope.stage == Sustain) {
+                return numeric_limits<uint64_t>::max();
+            }
+            float scale, offset;
+            frames += envelopeStage(envelope, scale, offset);
+            finishEnvelopeStage(envelope);
+        }
+        tail = max(tail, frames);
+    }
+    return tail;
+}
+
+uint32_t WavetableSynth::envelopeStage(const Voice& voice, float& scale, float& offset) const
+{
+    // Every stage is the affine step level = level * scale + offset; the return value is the
+    // number of steps until the stage ends, which the caller clips to the block.
+    double frames = numeric_limits<uint32_t>::max();
+    
+    switch (voice.stage) {
+        case Attack:
+            scale = 1.0f;
+            offset = voice.attackStep;
+            frames = ceil((1.0f - voice.level) / voice.attackStep);
+            break;
+        case Decay: {
+            float sustainLevel = voice.instrument->sustainLevel;
+            float remaining = voice.level - sustainLevel;
+            scale = voice.decayCoefficient;
+            offset = sustainLevel * (1.0f - voice.decayCoefficient);
+            frames = (scale > 0.0f && remaining >= silenceLevel) ? ceil(log(silenceLevel / remaining) / log(scale)) : 1.0;
+            break;
+        }
+        case Release:
+            scale = voice.releaseCoefficient;
+            offset = 0.0f;
+            frames = (scale > 0.0f && voice.level >= silenceLevel) ? ceil(log(silenceLevel / voice.level) / log(scale)) : 1.0;
+            break;
+        default:
+            scale = 1.0f;
+            offset = 0.0f;
+            break;
+    }
+    
+    return (uint32_t)max(1.0, min(frames, (double)numeric_limits<uint32_t>::max()));
+}
+
+void WavetableSynth::finishEnvelopeStage(Voice& voice) const
+{
+    switch (voice.stage) {
+        case Attack:
+            voice.level = 1.0f;
+            voice.stage = Decay;
+            break;
+        case Decay:
+            voice.level = voice.instrument->sustainLevel;
+            voice.stage = voice.level > 0.0f ? Sustain : Off;
+            break;
+        case Release:
+            voice.stage = Off;
+            break;
+        default:
+            break;
+    }
+}
+
+void WavetableSynth::renderVoices(float* left, float* right, size_t numFrames)
+{
+    memset(left, 0, numFrames * sizeof(float));
+    if (right) {
+        memset(right, 0, numFrames * sizeof(float));
+    }
+    
+    voiceRuns.clear();
+    for (auto& voice : voices) {
+        if (voice.stage != Off) {
+            VoiceRun run = { &voice, 0, 0 };
+            voiceRuns.push_back(run);
+        }
+    }
+    
+    // Each pass mixes every pending voice up to its next envelope stage change in one kernel
+    // call; voices that changed stage mid-block go round again from where they stopped.
+    while (!voiceRuns.empty()) {
+        mixBatch.clear();
+        for (auto& run : voiceRuns) {
+            const Voice& voice = *run.voice;
+            const Channel& state = channels[voice.channel];
+            float gain = voice.velocityGain * state.volume * state.expression;
+            float gainLeft = right ? gain * state.panLeft : gain * 0.5f * (state.panLeft + state.panRight);
+            float scale, offset;
+            run.stageFrames = envelopeStage(voice, scale, offset);
+            uint32_t frames = min(run.stageFrames, (uint32_t)numFrames - run.startFrame);
+            mixBatch.push(voice.instrument->table.data(), voice.phase, voice.phaseIncrement, voice.level, scale, offset,
+                          gainLeft, gain * state.panRight,
+                          run.startFrame, frames);
+        }
+        
+        (right ? mixVoices : mixVoicesMono)(mixBatch, WavetableInstrument::tableSize, left, right);
+        
+        nextVoiceRuns.clear();
+        for (size_t i = 0; i < voiceRuns.size(); ++i) {
+            VoiceRun& run = voiceRuns[i];
+            Voice& voice = *run.voice;
+            voice.phase = mixBatch.phases[i];
+            voice.level = mixBatch.levels[i];
+            mixedVoiceFrames += mixBatch.frameCounts[i];
+            
+            if (mixBatch.frameCounts[i] == run.stageFrames) {
+                finishEnvelopeStage(voice);
+                uint32_t end = run.startFrame + run.stageFrames;
+                if (voice.stage != Off && end < numFrames) {
+                    VoiceRun next = { &voice, end, 0 };
+                    nextVoiceRuns.push_back(next);
+                }
+            }
+        }
+        voiceRuns.swap(nextVoiceRuns);
+    }
+}
@@ -0,0 +1,165 @@
+//
+//  WavetableSynth.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__WavetableSynth__
+#define __OpenGLApp__WavetableSynth__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VoiceMixKernel.h"
+
+namespace OpenGLApp {
+    
+    // A channel message scheduled at an absolute sample frame.
+    struct SynthEvent
+    {
+        uint64_t frame;
+        unsigned char status;
+        unsigned char data1;
+        unsigned char data2;
+    };
+    
+    // One single-cycle waveform plus the envelope it is played with.
+    struct WavetableInstrument
+    {
+        static const size_t tableSize = 2048;
+        
+        // tableSize samples followed by a copy of the first one, so interpolation never wraps.
+        std::vector<float> table;
+        float attackSeconds;
+        float decaySeconds;
+        float sustainLevel;
+        float releaseSeconds;
+        bool fixedPitch;
+    };
+    
+    // A small General MIDI style bank: one instrument per GM program family plus a
+    // percussion kit, generated additively at startup so no sample data ships with the app.
+    class WavetableBank
+    {
+    public:
+        static WavetableBank createGeneralMidi();
+        
+        const WavetableInstrument& instrumentForProgram(int program, bool percussion) const;
+        
+        // Identifies the bank contents, e.g. for cache keys.
+        const std::string& getName() const;
+    private:
+        std::string name;
+        std::vector<WavetableInstrument> families;
+        WavetableInstrument percussion;
+    };
+    
+    // Polyphonic offline synthesizer. Events are fed in per block and rendered to float
+    // stereo or mono; voices are allocated from a fixed pool and the oldest one is stolen when full.
+    class WavetableSynth
+    {
+    public:
+        WavetableSynth(const WavetableBank& bank, double sampleRate, unsigned int maxVoices = 64);
+        
+        void reset();
+        void handleEvent(unsigned char status, unsigned char data1, unsigned char data2);
+        
+        // Renders numFrames frames into left/right (overwriting them), applying every event
+        // in events[nextEvent...] whose frame falls inside the block at its exact frame.
+        // With right null the block is rendered in mono into left: each voice is mixed once
+        // at the average of its pan gains, which is the same as downmixing the stereo output.
+        void process(const std::vector<SynthEvent>& events, size_t& nextEvent, float* left, float* right, size_t numFrames);
+        
+        // Applies the events due at the current frame without rendering anything.
+        void applyEvents(const std::vector<SynthEvent>& events, size_t& nextEvent);
+        
+        // Moves the clock on without rendering. Only valid while no voices are active, when
+        // the output would be silence anyway.
+        void skipFrames(uint64_t numFrames);
+        
+        // Frames until every active voice has decayed to silence, worked out from the envelopes;
+        // UINT64_MAX if a voice is sustaining and will never end on its own.
+        uint64_t getTailFrames() const;
+        
+        uint64_t getCurrentFrame() const;
+        unsigned int getNumActiveVoices() const;
+        double getSampleRate() const;
+        
+        // Instruction set used to mix voices; defaults to detectSimdLevel().
+        void setSimdLevel(SimdLevel level);
+        SimdLevel getSimdLevel() const;
+        
+        // Total voice-frames mixed since construction, for throughput figures.
+        uint64_t getMixedVoiceFrames() const;
+    private:
+        enum EnvelopeStage { Attack, Decay, Sustain, Release, Off };
+        
+        struct Voice
+        {
+            EnvelopeStage stage;
+            int channel;
+            int note;
+            bool held; // note-off arrived while the sustain pedal was down
+            uint64_t age;
+            const WavetableInstrument* instrument;
+            float phase;
+            float phaseIncrement;
+            float velocityGain;
+            float level;
+            float attackStep;
+            float decayCoefficient;
+            float releaseCoefficient;
+        };
+        
+        struct Channel
+        {
+            int program;
+            float volume;
+            float expression;
+            float panLeft; // equal-power pan gains
+            float panRight;
+            float pitchBend; // in semitones
+            bool sustain;
+        };
+        
+        // Part of a voice's block that is mixed with one envelope stage.
+        struct VoiceRun
+        {
+            Voice* voice;
+            uint32_t startFrame;
+            uint32_t stageFrames;
+        };
+        
+        const WavetableBank& bank;
+        double sampleRate;
+        uint64_t currentFrame;
+        uint64_t nextVoiceAge;
+        uint64_t mixedVoiceFrames;
+        std::vector<Voice> voices;
+        Channel channels[16];
+        
+        SimdLevel simdLevel;
+        VoiceMixFunction mixVoices;
+        VoiceMixFunction mixVoicesMono;
+        VoiceMixBatch mixBatch;
+        std::vector<VoiceRun> voiceRuns;
+        std::vector<VoiceRun> nextVoiceRuns;
+        
+        void setPan(Channel& state, float pan);
+        void noteOn(int channel, int note, int velocity);
+        void noteOff(int channel, int note);
+        void releaseVoice(Voice& voice);
+        void allNotesOff(int channel);
+        Voice& allocateVoice(int channel, int note);
+        void updatePitch(Voice& voice);
+        uint32_t envelopeStage(const Voice& voice, float& scale, float& offset) const;
+        void finishEnvelopeStage(Voice& voice) const;
+        void renderVoices(float* left, float* right, size_t numFrames);
+    };
+}
+
+#endif /* defined(__OpenGLApp__WavetableSynth__) */
@@ -0,0 +1,87 @@
+//
+//  WorkerPool.cpp
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace OpenGLApp;
+
+WorkerPool::WorkerPool(unsigned int numWorkers) : numWorkers(numWorkers == 0 ? defaultNumWorkers() : numWorkers)
+{
+}
+
+unsigned int WorkerPool::defaultNumWorkers()
+{
+    unsigned int hardwareThreads = thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+unsigned int WorkerPool::getNumWorkers()
+{
+    return numWorkers;
+}
+
+void WorkerPool::run(size_t numJobs, std::function<void(size_t)> job)
+{
+    if (numJobs == 0) {
+        return;
+    }
+    
+    size_t threadCount = min((size_t)numWorkers, numJobs);
+    
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < numJobs; ++i) {
+            job(i);
+        }
+        return;
+    }
+    
+    atomic<size_t> nextJob(0);
+    exception_ptr firstError;
+    mutex errorMutex;
+    
+    auto worker = [&]() {
+        for (;;) {
+            size_t i = nextJob.fetch_add(1);
+            if (i >= numJobs) {
+                return;
+            }
+            try {
+                job(i);
+            } catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                if (!firstError) {
+                    firstError = current_exception();
+                }
+                // Drain the remaining jobs so the other workers stop early.
+                nextJob.store(numJobs);
+                return;
+            }
+        }
+    };
+    
+    vector<thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.push_back(thread(worker));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    if (firstError) {
+        rethrow_exception(firstError);
+    }
+}
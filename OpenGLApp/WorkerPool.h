@@ -0,0 +1,38 @@
+//
+//  WorkerPool.h
+//  OpenGLApp
+//
+//  Created by Eva Leonard on 18/10/2026.
+//  Copyright (c) 2026 Eva Leonard. All rights reserved.
+//
+
+#ifndef __OpenGLApp__WorkerPool__
+#define __OpenGLApp__WorkerPool__
+
+#include <cstddef>
+#include <functional>
+
+namespace OpenGLApp {
+    
+    // Runs a batch of independent jobs across a fixed number of threads. Jobs are
+    // handed out by index, so callers can write each result straight into slot i
+    // of a pre-sized vector and get them back in order.
+    class WorkerPool
+    {
+    public:
+        // numWorkers == 0 picks one worker per hardware thread.
+        WorkerPool(unsigned int numWorkers = 0);
+        
+        unsigned int getNumWorkers();
+        
+        // Calls job(i) for every i in [0, numJobs) and blocks until all have finished.
+        // The first exception thrown by a job is rethrown here once every worker has stopped.
+        void run(size_t numJobs, std::function<void(size_t)> job);
+        
+        static unsigned int defaultNumWorkers();
+    private:
+        unsigned int numWorkers;
+    };
+}
+
+#endif /* defined(__OpenGLApp__WorkerPool__) */
@@ -15,9 +15,12 @@
 #include <assimp/scene.h> // collects data
 #include <assimp/postprocess.h> // various extra operations
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
+#include <chrono>
+#include <cmath>
 #include <exception>
 
 #include "stb_image.h"
@@ -37,43 +40,124 @@
 #include <OpenAL/al.h>
 #include <OpenAl/alc.h>
 
+#include "AudioState.h"
+#include "AudioFormat.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+#include "MeshCache.h"
+#include "MeshData.h"
 #include "MidiProcessor.h"
+#include "MixerOutput.h"
+#include "ShaderProgram.h"
+#include "SpatialMixer.h"
+#include "StemStreamer.h"
+#include "Transport.h"
+#include "VertexLayout.h"
+#include "VoiceManager.h"
+#include "WorkerPool.h"
+#include "Benchmarks.h"
 
 using namespace OpenGLApp;
 
 MidiProcessor* midiProc;
 
-#define AUDIO_FILE_PATH "track1.mp3"
-
 ALCdevice *audioDevice;
 ALCcontext *audioContext;
 
+// The one format audio is rendered and mixed in (--sample-rate).
+AudioFormat audioFormat;
+
 ALuint* sources;
-ALuint* buffers;
+std::vector<ALuint> buffers;
+ALuint silenceBuffer = 0;
+const ALsizei silenceBufferFrames = 44100;
+
+// Set with --stream: sources play from a small refilled ring of buffers instead of whole stems.
+StemStreamer* streamer = NULL;
+
+// Set with --spatial: every track is mixed in software and played through one output source.
+SpatialMixer* spatialMixer = NULL;
+MixerOutput* mixerOutput = NULL;
+
+// Everything the render thread sets on OpenAL goes through here, once a frame and only when changed.
+AudioState* audioState = NULL;
+
+// The song clock: every track starts, stops, seeks and loops with it (Space plays and
+// pauses, Home goes back to the start).
+Transport* transport = NULL;
+
+// Which tracks are worth mixing from where the car is; voice i is track i. Only the loudest
+// --max-voices of them play at once.
+VoiceManager* voiceManager = NULL;
 
-#pragma mark user-data struct
-typedef struct LoopAudioSample {
-	AudioStreamBasicDescription	dataFormat;
-	UInt16				*sampleBuffer;
-	UInt32				bufferSizeBytes;
-	ALuint				sources[1];
-} LoopAudioSample;
+// Tracks are converted in the background and only drawn and played once attached.
+std::vector<bool> trackAttached;
+std::vector<size_t> trackMixerSources;
+int numTracksAttached = 0;
+WorkerPool stemPreparePool;
 
-LoopAudioSample* sample;
+// Startup timing: the main thread's stages in order, plus the time spent getting stems into OpenAL.
+std::chrono::steady_clock::time_point launchTime;
+std::chrono::steady_clock::time_point lastStageTime;
+std::vector<std::pair<std::string, double>> startupStages;
+double stemPrepareSeconds = 0.0;
+double stemUploadSeconds = 0.0;
+bool drewFirstFrame = false;
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void markStartupStage(const char* name)
+{
+    startupStages.push_back(std::make_pair(std::string(name), secondsSince(lastStageTime)));
+    lastStageTime = std::chrono::steady_clock::now();
+}
+
+// Printed once, when the first frame is up and every track is playing.
+void printStartupTimings()
+{
+    if (!drewFirstFrame || numTracksAttached != midiProc->getNumTracks()) {
+        return;
+    }
+    std::cout << "Startup:";
+    for (auto& stage : startupStages) {
+        std::cout << " " << stage.first << " " << stage.second << "s,";
+    }
+    std::cout << " stems prepared in " << stemPrepareSeconds << "s on " << stemPreparePool.getNumWorkers() << " worker(s)"
+              << " and uploaded in " << stemUploadSeconds << "s; all " << numTracksAttached << " tracks playing after "
+              << secondsSince(launchTime) << "s" << std::endl;
+}
 
 // Global variables
-GLuint shaderProgramID;
+ShaderProgram* shaderProgram = NULL;
+
+// Everything draw() sets on GL goes through here, and only when it changes.
+GLState* glState = NULL;
 
 
 
 // Mesh variables
-std::vector<float> g_vp, g_vn, g_vt;
-std::vector<int> point_counts;
 std::vector<unsigned int> vaos, texes;
+// Each mesh's welded, cache-ordered triangles: how many indices, and GL_UNSIGNED_SHORT or _INT.
+std::vector<GLsizei> index_counts;
+std::vector<GLenum> index_types;
+// How each mesh's vertices are laid out, which draw() needs for undoing quantised positions.
+std::vector<OpenGLApp::VertexLayout> mesh_layouts;
+// Compiled meshes from earlier launches; NULL with --no-cache.
+OpenGLApp::MeshCache* meshCache = NULL;
+OpenGLApp::VertexFormats vertexFormats = { OpenGLApp::PositionFormat::Unorm16, OpenGLApp::NormalFormat::Int2101010, OpenGLApp::TexcoordFormat::Half };
 unsigned int mesh_vao = 0;
-int g_point_count = 0;
 
-GLuint loc1, loc2, loc3;
+GLint loc1, loc2, loc3;
+// The uniforms draw() sets, looked up once the shader program is linked.
+GLint view_mat_location, proj_mat_location, position_offset_location, position_scale_location;
+
+// Every track's figure is drawn in one instanced call; these hold each figure's model matrix
+// and colour, and only send the ones that changed.
+InstanceBuffer* figureModels = NULL;
+InstanceBuffer* figureColours = NULL;
 
 GLfloat rotate_y = 0.0f;
 GLfloat wheel_rotation = 0.0f;
@@ -100,6 +184,14 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
+        
+    if (transport && action == GLFW_PRESS) {
+        if (key == GLFW_KEY_SPACE) {
+            transport->togglePlaying();
+        } else if (key == GLFW_KEY_HOME) {
+            transport->seek(0);
+        }
+    }
     
     if (action == GLFW_PRESS) {
         keyStates[key] = true;
@@ -108,9 +200,8 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     }
 }
 
-bool load_mesh (const char* file_name) {
+bool load_mesh (const char* file_name, OpenGLApp::MeshData& mesh_data) {
     const aiScene* scene = aiImportFile (file_name, aiProcess_Triangulate); // TRIANGLES!
-    fprintf (stderr, "ERROR: reading mesh %s\n", file_name);
     if (!scene) {
         fprintf (stderr, "ERROR: reading mesh %s\n", file_name);
         return false;
@@ -122,38 +213,60 @@ bool load_mesh (const char* file_name) {
     printf ("  %i meshes\n", scene->mNumMeshes);
     printf ("  %i textures\n", scene->mNumTextures);
     
+    // Normals and texcoords are kept if any mesh has them; the ones that don't get zeros.
+    bool has_normals = false, has_texcoords = false;
+    for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
+        has_normals = has_normals || scene->mMeshes[m_i]->HasNormals ();
+        has_texcoords = has_texcoords || scene->mMeshes[m_i]->HasTextureCoords (0);
+    }
+    
+    // Every corner of every triangle goes in as a vertex of its own; welding then shares
+    // the ones that are the same.
+    mesh_data = OpenGLApp::MeshData();
     for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
         const aiMesh* mesh = scene->mMeshes[m_i];
         printf ("    %i vertices in mesh\n", mesh->mNumVertices);
-        g_point_count = mesh->mNumVertices;
-        for (unsigned int v_i = 0; v_i < mesh->mNumVertices; v_i++) {
-            if (mesh->HasPositions ()) {
-                const aiVector3D* vp = &(mesh->mVertices[v_i]);
-                //printf ("      vp %i (%f,%f,%f)\n", v_i, vp->x, vp->y, vp->z);
-                g_vp.push_back (vp->x);
-                g_vp.push_back (vp->y);
-                g_vp.push_back (vp->z);
-            }
-            if (mesh->HasNormals ()) {
-                const aiVector3D* vn = &(mesh->mNormals[v_i]);
-                //printf ("      vn %i (%f,%f,%f)\n", v_i, vn->x, vn->y, vn->z);
-                g_vn.push_back (vn->x);
-                g_vn.push_back (vn->y);
-                g_vn.push_back (vn->z);
-            }
-            if (mesh->HasTextureCoords (0)) {
-                const aiVector3D* vt = &(mesh->mTextureCoords[0][v_i]);
-                //printf ("      vt %i (%f,%f)\n", v_i, vt->x, vt->y);
-                g_vt.push_back (vt->x);
-                g_vt.push_back (vt->y);
+        if (!mesh->HasPositions ()) {
+            continue;
+        }
+        OpenGLApp::MeshData::Submesh submesh = { mesh_data.indices.size (), 0, mesh->mMaterialIndex };
+        for (unsigned int f_i = 0; f_i < mesh->mNumFaces; f_i++) {
+            const aiFace* face = &(mesh->mFaces[f_i]);
+            // Triangulate leaves points and lines as they are.
+            if (face->mNumIndices != 3) {
+                continue;
             }
-            if (mesh->HasTangentsAndBitangents ()) {
-                // NB: could store/print tangents here
+            for (unsigned int c_i = 0; c_i < 3; c_i++) {
+                unsigned int v_i = face->mIndices[c_i];
+                const aiVector3D* vp = &(mesh->mVertices[v_i]);
+                mesh_data.positions.insert (mesh_data.positions.end (), { vp->x, vp->y, vp->z });
+                if (has_normals) {
+                    aiVector3D vn = mesh->HasNormals () ? mesh->mNormals[v_i] : aiVector3D ();
+                    mesh_data.normals.insert (mesh_data.normals.end (), { vn.x, vn.y, vn.z });
+                }
+                if (has_texcoords) {
+                    aiVector3D vt = mesh->HasTextureCoords (0) ? mesh->mTextureCoords[0][v_i] : aiVector3D ();
+                    mesh_data.texcoords.insert (mesh_data.texcoords.end (), { vt.x, vt.y });
+                }
+                mesh_data.indices.push_back ((uint32_t)mesh_data.indices.size ());
             }
         }
+        submesh.numIndices = mesh_data.indices.size () - submesh.firstIndex;
+        if (submesh.numIndices > 0) {
+            mesh_data.submeshes.push_back (submesh);
+        }
     }
-    point_counts.push_back(g_point_count);
     aiReleaseImport (scene);
+    
+    size_t num_corners = mesh_data.indices.size ();
+    OpenGLApp::weldVertices (mesh_data);
+    double acmr_before = OpenGLApp::computeAcmr (mesh_data);
+    OpenGLApp::optimizeVertexCache (mesh_data);
+    OpenGLApp::optimizeVertexFetch (mesh_data);
+    printf ("  %zu triangles, %zu corners welded to %zu vertices, %u-bit indices\n",
+            mesh_data.getNumTriangles (), num_corners, mesh_data.getNumVertices (), mesh_data.getIndexBytes () * 8);
+    printf ("  ACMR (%u-entry FIFO) %.3f before reordering, %.3f after\n",
+            OpenGLApp::vertexCacheSize, acmr_before, OpenGLApp::computeAcmr (mesh_data));
     return true;
 }
 
@@ -162,44 +275,53 @@ void generateObjectBufferMeshes(std::string * mesh_names, int numMeshes) {
      LOAD MESH HERE AND COPY INTO BUFFERS
      ----------------------------------------------------------------------------*/
     
-    //Note: you may get an error "vector subscript out of range" if you are using this code for a mesh that doesnt have positions and normals
-    //Might be an idea to do a check for that before generating and binding the buffer.
     for(int i = 0; i < numMeshes; i++)
     {
-        load_mesh (mesh_names[i].c_str());
-        
-        loc1 = glGetAttribLocation(shaderProgramID, "vertex_position");
-        loc2 = glGetAttribLocation(shaderProgramID, "vertex_normal");
-        loc3 = glGetAttribLocation(shaderProgramID, "vertex_texture");
-        
-        unsigned int vp_vbo = 0;
-        glGenBuffers (1, &vp_vbo);
-        glBindBuffer (GL_ARRAY_BUFFER, vp_vbo);
-        glBufferData (GL_ARRAY_BUFFER, g_point_count * 3 * sizeof (float), &g_vp[0], GL_STATIC_DRAW);
-        
-        unsigned int vn_vbo = 0;
-        glGenBuffers (1, &vn_vbo);
-        glBindBuffer (GL_ARRAY_BUFFER, vn_vbo);
-        glBufferData (GL_ARRAY_BUFFER, g_point_count * 3 * sizeof (float), &g_vn[0], GL_STATIC_DRAW);
+        // The compiled mesh is mapped from the cache when there's one from since the source
+        // last changed; only otherwise is the source parsed, and the result cached for next time.
+        auto load_start = std::chrono::steady_clock::now();
+        OpenGLApp::CompiledMesh* compiled = meshCache ? meshCache->load(mesh_names[i], vertexFormats) : NULL;
+        if (!compiled) {
+            OpenGLApp::MeshData mesh_data;
+            if (!load_mesh (mesh_names[i].c_str(), mesh_data)) {
+                exit(1);
+            }
+            compiled = new OpenGLApp::CompiledMesh (mesh_data, vertexFormats);
+            if (meshCache && !meshCache->store (mesh_names[i], *compiled)) {
+                fprintf (stderr, "WARNING: couldn't cache mesh %s\n", mesh_names[i].c_str());
+            }
+        }
+        const OpenGLApp::VertexLayout& layout = compiled->getLayout ();
+        printf ("%s: %zu vertices, %zu triangles in %zu submeshes, %s vertex layout (%zu bytes a vertex), %s in %.1f ms\n",
+                mesh_names[i].c_str(), compiled->getNumVertices (), compiled->getNumIndices () / 3, compiled->getSubmeshes ().size (),
+                OpenGLApp::getVertexFormatsName (vertexFormats), layout.getStride (), compiled->isMapped () ? "mapped from cache" : "imported",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count());
         
-        unsigned int vt_vbo = 0;
-        glGenBuffers (1, &vt_vbo);
-        glBindBuffer (GL_ARRAY_BUFFER, vt_vbo);
-        glBufferData (GL_ARRAY_BUFFER, g_point_count * 2 * sizeof (float), &g_vt[0], GL_STATIC_DRAW);
+        loc1 = shaderProgram->getAttribLocation("vertex_position");
+        loc2 = shaderProgram->getAttribLocation("vertex_normal");
+        loc3 = shaderProgram->getAttribLocation("vertex_texture");
+        view_mat_location = shaderProgram->getUniformLocation("view");
+        proj_mat_location = shaderProgram->getUniformLocation("proj");
+        position_offset_location = shaderProgram->getUniformLocation("position_offset");
+        position_scale_location = shaderProgram->getUniformLocation("position_scale");
         
         unsigned int vao = 0;
         glGenVertexArrays(1, &vao);
         glBindVertexArray (vao);
         
-        glEnableVertexAttribArray (loc1);
-        glBindBuffer (GL_ARRAY_BUFFER, vp_vbo);
-        glVertexAttribPointer (loc1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray (loc2);
-        glBindBuffer (GL_ARRAY_BUFFER, vn_vbo);
-        glVertexAttribPointer (loc2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray (loc3);
-        glBindBuffer(GL_ARRAY_BUFFER, vt_vbo);
-        glVertexAttribPointer (loc3, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+        // All the attributes in one interleaved buffer, in the formats --vertex-layout chose,
+        // sent as they are.
+        unsigned int vertex_buffer = 0;
+        glGenBuffers (1, &vertex_buffer);
+        glBindBuffer (GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferData (GL_ARRAY_BUFFER, compiled->getNumVertices () * layout.getStride (), compiled->getVertexData (), GL_STATIC_DRAW);
+        layout.bindAttributes (loc1, loc2, loc3);
+        
+        // The element buffer binding is part of the VAO, so it's bound while the VAO is.
+        unsigned int index_buffer = 0;
+        glGenBuffers (1, &index_buffer);
+        glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+        glBufferData (GL_ELEMENT_ARRAY_BUFFER, compiled->getNumIndices () * compiled->getIndexBytes (), compiled->getIndexData (), GL_STATIC_DRAW);
         
         unsigned int tex = 0;
         int extension = mesh_names[i].length()-4;
@@ -208,10 +330,11 @@ void generateObjectBufferMeshes(std::string * mesh_names, int numMeshes) {
         load_image_to_texture (withNewExtension.c_str(), tex, true);
         
         vaos.push_back(vao); //keeping track of vao
+        mesh_layouts.push_back(layout);
         texes.push_back(tex);
-        g_vp.clear();
-        g_vn.clear();
-        g_vt.clear();
+        index_counts.push_back((GLsizei)compiled->getNumIndices ());
+        index_types.push_back(compiled->getIndexBytes () == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+        delete compiled;
     }
 }
 
@@ -308,95 +431,6 @@ bool load_image_to_texture (
 	return true;
 }
 
-// Create a NULL-terminated string by reading the provided file
-char* readShaderSource(const char* shaderFile) {
-    FILE* fp = fopen(shaderFile, "rb"); //!->Why does binary flag "RB" work and not "R"... wierd msvc thing?
-    
-    if ( fp == NULL ) { return NULL; }
-    
-    fseek(fp, 0L, SEEK_END);
-    long size = ftell(fp);
-    
-    fseek(fp, 0L, SEEK_SET);
-    char* buf = new char[size + 1];
-    fread(buf, 1, size, fp);
-    buf[size] = '\0';
-    
-    fclose(fp);
-    
-    return buf;
-}
-
-static void AddShader(GLuint ShaderProgram, const char* pShaderText, GLenum ShaderType)
-{
-	// create a shader object
-    GLuint ShaderObj = glCreateShader(ShaderType);
-    
-    if (ShaderObj == 0) {
-        fprintf(stderr, "Error creating shader type %d\n", ShaderType);
-        exit(0);
-    }
-	const char* pShaderSource = readShaderSource( pShaderText);
-    
-	// Bind the source code to the shader, this happens before compilation
-	glShaderSource(ShaderObj, 1, (const GLchar**)&pShaderSource, NULL);
-	// compile the shader and check for errors
-    glCompileShader(ShaderObj);
-    GLint success;
-	// check for shader related errors using glGetShaderiv
-    glGetShaderiv(ShaderObj, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLchar InfoLog[1024];
-        glGetShaderInfoLog(ShaderObj, 1024, NULL, InfoLog);
-        fprintf(stderr, "Error compiling shader type %d: '%s'\n", ShaderType, InfoLog);
-        exit(1);
-    }
-	// Attach the compiled shader object to the program object
-    fprintf(stdout, "Compiled shader\n");
-    glAttachShader(ShaderProgram, ShaderObj);
-}
-
-GLuint CompileShaders()
-{
-	//Start the process of setting up our shaders by creating a program ID
-	//Note: we will link all the shaders together into this ID
-    shaderProgramID = glCreateProgram();
-    if (shaderProgramID == 0) {
-        fprintf(stderr, "Error creating shader program\n");
-        exit(1);
-    }
-    
-	// Create two shader objects, one for the vertex, and one for the fragment shader
-    AddShader(shaderProgramID, "simpleVertexShader.txt", GL_VERTEX_SHADER);
-    AddShader(shaderProgramID, "simpleFragmentShader.txt", GL_FRAGMENT_SHADER);
-    
-    GLint Success = 0;
-    GLchar ErrorLog[1024] = { 0 };
-	// After compiling all shader objects and attaching them to the program, we can finally link it
-    glLinkProgram(shaderProgramID);
-	// check for program related errors using glGetProgramiv
-    glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &Success);
-	if (Success == 0) {
-		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
-		fprintf(stderr, "Error linking shader program: '%s'\n", ErrorLog);
-        exit(1);
-	}
-    
-//	// program has been successfully linked but needs to be validated to check whether the program can execute given the current pipeline state
-//    glValidateProgram(shaderProgramID);
-//	// check for program related errors using glGetProgramiv
-//    glGetProgramiv(shaderProgramID, GL_VALIDATE_STATUS, &Success);
-//    if (!Success) {
-//        glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
-//        fprintf(stderr, "Invalid shader program: '%s'\n", ErrorLog);
-//        exit(1);
-//    }
-	// Finally, use the linked shader program
-	// Note: this program will stay in effect for all draw calls until you replace it with another or explicitly disable its use
-    //glUseProgram(shaderProgramID);
-	return shaderProgramID;
-}
-
 float camPitch = 180.0f;
 int lastMouseX = -1;
 
@@ -457,67 +491,70 @@ void updateScene()
     }
 }
 
-void drawAndPlaySource(float x, float z, ALuint source, vec3 diffuse)
+vec3 getTrackPosition(int trackIndex)
+{
+    return vec3((trackIndex % 3) * 25.0f, 0.0f, (trackIndex / 3) * 25.0f);
+}
+
+mat4 getFigureModel(float x, float z)
 {
     mat4 model = identity_mat4();
     model = rotate_x_deg(model, -90.0f);
-    model = translate(model, vec3(x, 0, z));
-    
-    int matrix_location = glGetUniformLocation (shaderProgramID, "model");
-    int diffuse_location = glGetUniformLocation (shaderProgramID, "Kd");
-    glUniformMatrix4fv (matrix_location, 1, GL_FALSE, model.m);
-    glUniform3f(diffuse_location, diffuse.v[0], diffuse.v[1], diffuse.v[2]);
-    glDrawArrays(GL_TRIANGLES, 0, point_counts[0]);
-    
-    // Play the sound
-    
-    ALint playing;
-    alGetSourcei(sources[source], AL_SOURCE_STATE, &playing);
-    if (playing != AL_PLAYING) {
-        alSource3f(sources[source], AL_POSITION, x, 0.0f, z);
-        alSourcePlay(sources[source]);
-    }
+    return translate(model, vec3(x, 0, z));
 }
 
 void draw(GLFWwindow* window)
 {
-    // tell GL to only draw onto a pixel if the shape is closer to the viewer
-	glEnable (GL_DEPTH_TEST); // enable depth-testing
-	glDepthFunc (GL_LESS); // depth-testing interprets a smaller value as "closer"
-	glClearColor (0.5f, 0.5f, 0.5f, 1.0f);
-	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUseProgram (shaderProgramID);
-    
-    
-	//Declare your uniform variables that will be used in your shader
-	int view_mat_location = glGetUniformLocation (shaderProgramID, "view");
-	int proj_mat_location = glGetUniformLocation (shaderProgramID, "proj");
+    // tell GL to only draw onto a pixel if the shape is closer to the viewer; after the first
+    // frame none of this reaches GL unless it changes
+	glState->setEnabled(GL_DEPTH_TEST, true); // enable depth-testing
+	glState->setDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+	glState->setClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	glState->clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glState->useProgram(*shaderProgram);
     
 	// Camera
     auto camMat = vec3(translateObjX, 0.0f, translateObjZ);
     auto camLookAt = calculate_camera_position();
-    ALfloat lookAtF[6] = { camLookAt.v[0], camLookAt.v[1], camLookAt.v[2], 0.0f, 1.0f, 0.0f};
-    
-    alListener3f(AL_POSITION, translateObjX, 0.0f, translateObjZ);
-    alListener3f(AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alListenerfv(AL_ORIENTATION, lookAtF);
+    ALfloat lookAtDirection[3] = { camLookAt.v[0] - camMat.v[0], camLookAt.v[1] - camMat.v[1], camLookAt.v[2] - camMat.v[2] };
+    ALfloat lookAtUp[3] = { 0.0f, 1.0f, 0.0f };
+    
+    // Only sent when the car has actually moved or turned.
+    audioState->setListenerPosition(translateObjX, 0.0f, translateObjZ);
+    audioState->setListenerOrientation(lookAtDirection, lookAtUp);
+    if (spatialMixer) {
+        SpatialListener listener;
+        listener.position[0] = translateObjX;
+        listener.position[2] = translateObjZ;
+        std::copy(lookAtDirection, lookAtDirection + 3, listener.forward);
+        spatialMixer->setListener(listener);
+    }
     
 	mat4 view = identity_mat4 ();
 	mat4 persp_proj = perspective(45.0, (float)width/(float)height, 0.1, 1000.0);
     
     view = view * look_at(camMat, camLookAt, vec3(0, 1, 0));
     
-    glUniformMatrix4fv (proj_mat_location, 1, GL_FALSE, persp_proj.m);
-	glUniformMatrix4fv (view_mat_location, 1, GL_FALSE, view.m);
-    
-    glBindVertexArray(vaos[0]);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texes[0]);
-    
-    // Render and play the sources/tracks
+    glState->setUniformMatrix4(proj_mat_location, persp_proj.m);
+	glState->setUniformMatrix4(view_mat_location, view.m);
+    
+	glState->setActiveTexture(GL_TEXTURE0);
+	glState->bindTexture(GL_TEXTURE_2D, texes[0]);
+    
+    // Render the sources/tracks; the transport keeps them playing. Tracks sounding at the
+    // current song position are drawn at full brightness, the rest dimmed. Each attached
+    // track is one instance, in track order.
+    const auto& stems = midiProc->getTrackStems();
+    uint64_t songPosition = transport->getPosition();
+    size_t frameSamples = (size_t)(transport->getSampleRate() / 30);
+    size_t numFigures = 0;
+    figureModels->resize(numTracksAttached);
+    figureColours->resize(numTracksAttached);
     for (int i = 0; i < midiProc->getNumTracks(); ++i) {
-        float x = (i % 3) * 25;
-        float z = (i / 3) * 25;
+        if (!trackAttached[i]) {
+            continue;
+        }
+        vec3 position = getTrackPosition(i);
         vec3 diffuse;
         switch (i % 4) {
             case 0:
@@ -537,8 +574,19 @@ void draw(GLFWwindow* window)
                 diffuse = vec3(0.5f, 0.5f, 0.5f);
                 break;
         }
-        drawAndPlaySource(x, z, i, diffuse);
+        if (!stems[i].hasAudibleLoopFrames(transport->getLoopFrames(), songPosition, frameSamples)) {
+            diffuse *= 0.4f;
+        }
+        figureModels->set(numFigures, getFigureModel(position.v[0], position.v[2]).m);
+        figureColours->set(numFigures, diffuse.v);
+        ++numFigures;
     }
+    figureModels->upload(*glState);
+    figureColours->upload(*glState);
+    glState->bindVertexArray(vaos[0]);
+    glState->setUniform3(position_offset_location, mesh_layouts[0].getPositionOffset());
+    glState->setUniform3(position_scale_location, mesh_layouts[0].getPositionScale());
+    glState->drawElementsInstanced(GL_TRIANGLES, index_counts[0], index_types[0], (GLsizei)numFigures);
     
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -571,93 +619,431 @@ void drawTest(GLFWwindow* window)
     glfwPollEvents();
 }
 
-OSStatus loadAudioBuffers(LoopAudioSample *sample, const char* path)
+ALenum getALFormat(const AudioFormat& format)
+{
+    return format.channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+}
+
+ALuint createBuffer(ALenum format, const int16_t* data, size_t numFrames, unsigned int channels, double sampleRate)
+{
+    ALuint buffer;
+    alGenBuffers(1, &buffer);
+    alBufferData(buffer, format, data, (ALsizei)(numFrames * channels * sizeof(int16_t)), (ALsizei)sampleRate);
+    buffers.push_back(buffer);
+    return buffer;
+}
+
+// A stem laid out as the queue it will play from: each block is a run of the shared
+// silenceBuffer followed by one buffer's worth of PCM. Each PCM block carries the odd frames of
+// the rest before it, so the queue adds up to exactly one pass of the song's loop and every
+// source comes round on the same frame. Building it is plain CPU work that any thread can do;
+// only uploadStem() needs the OpenAL context.
+struct PreparedStem
+{
+    struct Block
+    {
+        uint64_t silenceBuffers;
+        size_t numFrames;
+        std::vector<int16_t> samples;
+    };
+    
+    ALenum format;
+    unsigned int channels;
+    double sampleRate;
+    std::vector<Block> blocks;
+};
+
+PreparedStem prepareStem(const AudioStem& stem, uint64_t loopFrames)
+{
+    PreparedStem prepared;
+    prepared.format = getALFormat(stem.getFormat());
+    prepared.channels = stem.channels;
+    prepared.sampleRate = stem.sampleRate;
+    
+    // Where the stem is audible within one pass of the loop. Release tails that run past the
+    // loop point wrap round onto the start, where they may overlap the first notes.
+    std::vector<std::pair<uint64_t, uint64_t>> spans;
+    for (auto& segment : stem.segments) {
+        uint64_t start = segment.startFrame;
+        uint64_t end = segment.startFrame + segment.numFrames;
+        while (start < end) {
+            uint64_t offset = start % loopFrames;
+            uint64_t count = std::min(end - start, loopFrames - offset);
+            spans.push_back(std::make_pair(offset, offset + count));
+            start += count;
+        }
+    }
+    std::sort(spans.begin(), spans.end());
+    spans.push_back(std::make_pair(loopFrames, loopFrames));
+    
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    for (auto& span : spans) {
+        if (!merged.empty() && span.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, span.second);
+        } else {
+            merged.push_back(span);
+        }
+    }
+    
+    uint64_t frame = 0;
+    for (auto& span : merged) {
+        uint64_t gap = span.first - frame;
+        size_t pad = (size_t)(gap % silenceBufferFrames);
+        size_t audibleFrames = (size_t)(span.second - span.first);
+        
+        PreparedStem::Block block;
+        block.silenceBuffers = gap / silenceBufferFrames;
+        block.numFrames = pad + audibleFrames;
+        block.samples.assign(block.numFrames * stem.channels, 0);
+        if (audibleFrames > 0) {
+            stem.copyLoopFrames(loopFrames, span.first, audibleFrames, block.samples.data() + pad * stem.channels);
+        }
+        prepared.blocks.push_back(std::move(block));
+        frame = span.second;
+    }
+    return prepared;
+}
+
+void uploadStem(ALuint source, const PreparedStem& prepared)
 {
-    CFURLRef fileUrl = CFURLCreateWithFileSystemPath(kCFAllocatorDefault, CFStringCreateWithCString(NULL, path, kCFStringEncodingASCII), kCFURLPOSIXPathStyle, false);
- 
-    sample->dataFormat.mFormatID = kAudioFormatLinearPCM;
-    sample->dataFormat.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
-    sample->dataFormat.mSampleRate = 44100.0;
-    sample->dataFormat.mChannelsPerFrame = 1;
-    sample->dataFormat.mFramesPerPacket = 1;
-    sample->dataFormat.mBitsPerChannel = 16;
-    sample->dataFormat.mBytesPerFrame = 2;
-    sample->dataFormat.mBytesPerPacket = 2;
-    
-    ExtAudioFileRef extAudioFile;
-    OSStatus err;
-    err = ExtAudioFileOpenURL(fileUrl, &extAudioFile);
-    if (!(err == 0)) {
-        std::cout << "Couldn't open extAudioFile for reading." << std::endl;
-        return err;
-    }
-    
-    err = ExtAudioFileSetProperty(extAudioFile, kExtAudioFileProperty_ClientDataFormat, sizeof(AudioStreamBasicDescription), &sample->dataFormat);
-    if (!(err == 0)) {
-        std::cout << "Couldn't set extAudioFile format properties." << std::endl;
-        return err;
-    }
-    
-    SInt64 fileLengthFrames;
-    UInt32 propSize = sizeof(fileLengthFrames);
-    ExtAudioFileGetProperty(extAudioFile, kExtAudioFileProperty_FileLengthFrames, &propSize, &fileLengthFrames);
-    
-    sample->bufferSizeBytes = fileLengthFrames * sample->dataFormat.mBytesPerFrame;
-    
-    AudioBufferList *buffers;
-    UInt32 ablSize = offsetof(AudioBufferList, mBuffers[0]) + (sizeof(AudioBuffer) * 1);
-    buffers = (AudioBufferList*)malloc(ablSize);
-    
-    // allocate sample buffer
-    sample->sampleBuffer = (UInt16*)malloc(sizeof(UInt16) * sample->bufferSizeBytes);
-    
-    buffers->mNumberBuffers = 1;
-    buffers->mBuffers[0].mNumberChannels = 1;
-    buffers->mBuffers[0].mDataByteSize = sample->bufferSizeBytes;
-    buffers->mBuffers[0].mData = sample->sampleBuffer;
-    
-    // read into the AudioBufferList until it is full
-    UInt32 totalFramesRead = 0;
-    do {
-        UInt32 framesRead = fileLengthFrames - totalFramesRead;
-        buffers->mBuffers[0].mData = sample->sampleBuffer + (totalFramesRead * (sizeof(UInt16)));
-        err = ExtAudioFileRead(extAudioFile, &framesRead, buffers);
-        if (!(err == 0)) {
-            std::cout << "Couldn't read extAudioFile." << std::endl;
-            return err;
+    if (silenceBuffer == 0) {
+        // Every stem has the same format, so one buffer of silence serves all the rests.
+        std::vector<int16_t> silence(silenceBufferFrames * prepared.channels, 0);
+        silenceBuffer = createBuffer(prepared.format, silence.data(), silenceBufferFrames, prepared.channels, prepared.sampleRate);
+    }
+    for (auto& block : prepared.blocks) {
+        for (uint64_t n = 0; n < block.silenceBuffers; ++n) {
+            alSourceQueueBuffers(source, 1, &silenceBuffer);
+        }
+        if (block.numFrames > 0) {
+            ALuint buffer = createBuffer(prepared.format, block.samples.data(), block.numFrames, prepared.channels, prepared.sampleRate);
+            alSourceQueueBuffers(source, 1, &buffer);
+        }
+    }
+}
+
+// The tracks the transport starts, stops and seeks in the default mode: the physical ones.
+// Virtual tracks are held paused and get their offset when they come back.
+std::vector<ALuint> getPhysicalSources()
+{
+    std::vector<ALuint> physical;
+    for (size_t i = 0; i < trackAttached.size(); ++i) {
+        if (voiceManager->isPhysical(i)) {
+            physical.push_back(sources[i]);
+        }
+    }
+    return physical;
+}
+
+// The default mode's transport listener. Each source's queue is exactly one pass of the loop,
+// so its sample offset is the song position; the batched calls make OpenAL apply the change
+// to every source in the same mixer update.
+void applyTransportState(bool playing, uint64_t position)
+{
+    std::vector<ALuint> physical = getPhysicalSources();
+    if (physical.empty()) {
+        return;
+    }
+    audioState->pauseSources(physical);
+    audioState->setSampleOffsets(physical, (ALint)position);
+    if (playing) {
+        audioState->playSources(physical);
+    }
+}
+
+// Brings the default mode's sources back on the same sample as the tracks still playing: hold
+// those, read back where they got to and start everything from there in one call. With none
+// playing, the transport says where the song is.
+void joinSources(const std::vector<ALuint>& joining)
+{
+    std::vector<ALuint> playing;
+    for (ALuint source : getPhysicalSources()) {
+        if (std::find(joining.begin(), joining.end(), source) == joining.end()) {
+            playing.push_back(source);
+        }
+    }
+    uint64_t position = transport->getPosition();
+    if (transport->isPlaying() && !playing.empty()) {
+        audioState->pauseSources(playing);
+        position = (uint64_t)audioState->getSampleOffset(playing.front());
+    }
+    audioState->setSampleOffsets(joining, (ALint)position);
+    if (transport->isPlaying()) {
+        playing.insert(playing.end(), joining.begin(), joining.end());
+        audioState->playSources(playing);
+    }
+}
+
+// Pulls the transport onto the clock of whatever is actually playing the tracks, so the
+// dimming and the tracks brought back later follow the audio device rather than drift from it
+// on the system clock. Reading the output back is a round trip to OpenAL, and the two clocks
+// only drift apart by parts in ten thousand, so it is done every transportSyncFrames frames
+// and straight after a hitch, when the audio is likeliest to have stalled, not every frame.
+const unsigned int transportSyncFrames = 30;
+const double transportSyncHitchSeconds = 0.1;
+
+void syncTransport()
+{
+    static unsigned int framesSinceSync = 0;
+    static std::chrono::steady_clock::time_point lastFrameTime = std::chrono::steady_clock::now();
+    bool hitch = secondsSince(lastFrameTime) > transportSyncHitchSeconds;
+    lastFrameTime = std::chrono::steady_clock::now();
+    if (!transport->isPlaying() || (++framesSinceSync < transportSyncFrames && !hitch)) {
+        return;
+    }
+    framesSinceSync = 0;
+    uint64_t position;
+    if (spatialMixer) {
+        transport->syncTo(mixerOutput->getAudiblePosition(transport->getLoopFrames()));
+    } else if (streamer) {
+        if (streamer->getPosition(position)) {
+            transport->syncTo(position);
+        }
+    } else {
+        std::vector<ALuint> physical = getPhysicalSources();
+        if (!physical.empty()) {
+            transport->syncTo((uint64_t)audioState->getSampleOffset(physical.front()));
+        }
+    }
+}
+
+// Re-ranks the tracks from where the car is now, then stops mixing the ones that have become
+// virtual and brings back the ones that have become physical, in step with the song.
+void updateVoices()
+{
+    static std::vector<size_t> becamePhysical, becameVirtual;
+    voiceManager->setListenerPosition(translateObjX, 0.0f, translateObjZ);
+    voiceManager->update(becamePhysical, becameVirtual);
+    if (becamePhysical.empty() && becameVirtual.empty()) {
+        return;
+    }
+    
+    if (spatialMixer) {
+        for (size_t track : becameVirtual) {
+            spatialMixer->setSourceVirtual(trackMixerSources[track], true);
+        }
+        for (size_t track : becamePhysical) {
+            spatialMixer->setSourceVirtual(trackMixerSources[track], false);
+        }
+        return;
+    }
+    
+    std::vector<ALuint> stopping, starting;
+    for (size_t track : becameVirtual) {
+        stopping.push_back(sources[track]);
+    }
+    for (size_t track : becamePhysical) {
+        starting.push_back(sources[track]);
+    }
+    if (streamer) {
+        streamer->virtualiseStreams(stopping);
+        streamer->devirtualiseStreams(starting, transport->getPosition());
+    } else {
+        if (!stopping.empty()) {
+            audioState->pauseSources(stopping);
+        }
+        if (!starting.empty()) {
+            joinSources(starting);
+        }
+    }
+}
+
+// Picks up the tracks the background conversion has finished since the last frame. The first
+// to arrive start the transport. Every track arrives virtual, and updateVoices() starts it on
+// the same sample as the rest once it is worth hearing, however long it took to render.
+void attachConvertedTracks()
+{
+    const auto& stems = midiProc->getTrackStems();
+    std::vector<size_t> arrived;
+    size_t trackIndex;
+    
+    while (midiProc->popConvertedTrack(trackIndex)) {
+        arrived.push_back(trackIndex);
+    }
+    if (arrived.empty()) {
+        return;
+    }
+    
+    // Laying the stems out happens on the workers; only the uploads below touch the context.
+    std::vector<PreparedStem> prepared(arrived.size());
+    auto stageStart = std::chrono::steady_clock::now();
+    if (!streamer && !spatialMixer) {
+        stemPreparePool.run(arrived.size(), [&](size_t i) {
+            prepared[i] = prepareStem(stems[arrived[i]], transport->getLoopFrames());
+        });
+    }
+    stemPrepareSeconds += secondsSince(stageStart);
+    stageStart = std::chrono::steady_clock::now();
+    
+    bool firstArrivals = numTracksAttached == 0;
+    for (size_t i = 0; i < arrived.size(); ++i) {
+        trackIndex = arrived[i];
+        const AudioStem& stem = stems[trackIndex];
+        ALuint source = sources[trackIndex];
+        vec3 position = getTrackPosition((int)trackIndex);
+        
+        if (spatialMixer) {
+            trackMixerSources[trackIndex] = spatialMixer->addSource(stem, position.v[0], position.v[1], position.v[2], true);
+        } else {
+            if (streamer) {
+                streamer->addStream(source, stem);
+            } else {
+                uploadStem(source, prepared[i]);
+            }
+            audioState->setSourcePosition(source, position.v[0], position.v[1], position.v[2]);
+            audioState->setSourceGain(source, 1.0f);
         }
-        totalFramesRead += framesRead;
-    } while (totalFramesRead < fileLengthFrames);
+        
+        voiceManager->setVoiceGain(trackIndex, 1.0f);
+        trackAttached[trackIndex] = true;
+        ++numTracksAttached;
+    }
     
-    free(buffers);
-    return err;
+    if (firstArrivals) {
+        transport->play();
+    }
+    stemUploadSeconds += secondsSince(stageStart);
+    
+    printStartupTimings();
+    if (numTracksAttached == midiProc->getNumTracks()) {
+        if (streamer) {
+            std::cout << "Streaming through " << streamer->getBufferBytes() / 1024 << " KB of OpenAL buffers" << std::endl;
+        }
+    }
+}
+
+// The --render-spatial mode: renders every track, places them as they would be in the scene
+// and writes one pass of the longest of them, heard from the origin, to path. No window or
+// audio device is opened.
+int renderSpatialMix(const std::string& path)
+{
+    midiProc->convertTracks();
+    const auto& stems = midiProc->getTrackStems();
+    
+    // Looping at the end of the longest stem, so one pass is the whole piece, tails and all.
+    uint64_t numFrames = 0;
+    for (auto& stem : stems) {
+        numFrames = std::max(numFrames, stem.getNumFrames());
+    }
+    SpatialMixer mixer(audioFormat, numFrames);
+    for (size_t i = 0; i < stems.size(); ++i) {
+        vec3 position = getTrackPosition((int)i);
+        mixer.addSource(stems[i], position.v[0], position.v[1], position.v[2]);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    if (!mixer.renderToFile(path, numFrames)) {
+        std::cerr << "Couldn't write " << path << std::endl;
+        return -1;
+    }
+    std::cout << "Mixed " << stems.size() << " sources to " << path << " in " << secondsSince(start) << "s ("
+              << mixer.getSkippedSourceFrames() * 100 / std::max(mixer.getSkippedSourceFrames() + mixer.getMixedSourceFrames(), (uint64_t)1)
+              << "% of source blocks skipped as silence)" << std::endl;
+    return 0;
 }
 
 int main(int argc, const char * argv[])
 {
+    launchTime = lastStageTime = std::chrono::steady_clock::now();
+    
     if (argc < 2) {
         std::cerr << "You must specify an input MIDI file to process!" << std::endl;
         return -1;
     }
     
+    if (std::string(argv[1]) == "--benchmark") {
+        return runBenchmark(argc - 2, argv + 2);
+    }
+    
     std::string inputFile = argv[1];
     
+    // Stems are played straight from memory; --export-wav also writes them out as files and
+    // --export-mixdown <file> writes a stereo mix of the whole piece.
+    // Rendered stems and compiled meshes are cached between launches unless --no-cache is
+    // given. --stream plays the stems through at most --stream-budget megabytes of OpenAL
+    // buffers in total.
+    // --sample-rate sets the rate of the whole pipeline, render and playback alike.
+    // --spatial mixes the tracks in software instead of giving each its own OpenAL source;
+    // --render-spatial <file> renders that mix, heard from the origin, to a file and exits.
+    // --max-voices caps how many tracks are mixed at once, the ones loudest at the car.
+    // --vertex-layout picks how mesh vertices are stored: float, compact or quantized.
+    bool exportWavFiles = false;
+    std::string mixdownPath;
+    bool useRenderCache = true;
+    bool streamStems = false;
+    size_t streamBudgetBytes = StemStreamer::defaultMemoryBudgetBytes;
+    bool spatialMix = false;
+    std::string spatialRenderPath;
+    VoiceManager::Settings voiceSettings;
+    for (int i = 2; i < argc; ++i) {
+        if (std::string(argv[i]) == "--export-wav") {
+            exportWavFiles = true;
+        } else if (std::string(argv[i]) == "--export-mixdown" && i + 1 < argc) {
+            mixdownPath = argv[++i];
+        } else if (std::string(argv[i]) == "--no-cache") {
+            useRenderCache = false;
+        } else if (std::string(argv[i]) == "--stream") {
+            streamStems = true;
+        } else if (std::string(argv[i]) == "--stream-budget" && i + 1 < argc) {
+            streamStems = true;
+            streamBudgetBytes = (size_t)(atof(argv[++i]) * 1024 * 1024);
+        } else if (std::string(argv[i]) == "--spatial") {
+            spatialMix = true;
+        } else if (std::string(argv[i]) == "--render-spatial" && i + 1 < argc) {
+            spatialRenderPath = argv[++i];
+        } else if (std::string(argv[i]) == "--max-voices" && i + 1 < argc) {
+            voiceSettings.maxVoices = (size_t)std::max(atoi(argv[++i]), 0);
+        } else if (std::string(argv[i]) == "--vertex-layout" && i + 1 < argc) {
+            if (!parseVertexFormats(argv[++i], vertexFormats)) {
+                std::cerr << "Unknown vertex layout " << argv[i] << " (float, compact or quantized)" << std::endl;
+                return -1;
+            }
+        } else if (std::string(argv[i]) == "--sample-rate" && i + 1 < argc) {
+            audioFormat.sampleRate = atof(argv[++i]);
+        }
+    }
+    
     try {
         midiProc = new MidiProcessor(inputFile);
+        midiProc->setStemFormat(audioFormat);
+        midiProc->setExportWavFiles(exportWavFiles);
+        midiProc->setMixdownPath(mixdownPath);
+        if (useRenderCache) {
+            try {
+                midiProc->setRenderCacheDirectory(RenderCache::getDefaultDirectory());
+            } catch (std::runtime_error e) {
+                // Not fatal: everything is just rendered from scratch.
+                std::cerr << "Render cache disabled: " << e.what() << std::endl;
+            }
+        }
         midiProc->splitTracks();
-        midiProc->convertTracks();
+        transport = new Transport(audioFormat.sampleRate, midiProc->getSongEndFrame());
+        
+        if (!spatialRenderPath.empty()) {
+            return renderSpatialMix(spatialRenderPath);
+        }
+        
+        // Splitting is quick; rendering is what takes the time, so it runs in the background
+        // while the window and audio device come up, and tracks are attached as they finish.
+        midiProc->startConvertingTracks();
+        markStartupStage("split");
     } catch (std::runtime_error e) {
         std::cerr << "Error in MIDIProcessor: " << e.what() << std::endl;
         return -1;
     }
     
     auto numAudioSources = midiProc->getNumTracks();
-    auto audioFilenames = midiProc->getConvertedTrackNames();
     
     sources = new ALuint[numAudioSources]();
-    buffers = new ALuint[numAudioSources]();
+    trackAttached.assign(numAudioSources, false);
+    trackMixerSources.assign(numAudioSources, 0);
     
-    sample = new LoopAudioSample[numAudioSources]();
+    // Silent until attached, so a track can't be picked to play before it has any audio.
+    voiceManager = new VoiceManager(voiceSettings);
+    for (int i = 0; i < numAudioSources; i++) {
+        vec3 position = getTrackPosition(i);
+        voiceManager->addVoice(position.v[0], position.v[1], position.v[2], 0.0f);
+    }
     
     // init OpenAL stuff
     audioDevice = alcOpenDevice(NULL);
@@ -666,12 +1052,26 @@ int main(int argc, const char * argv[])
         return 0;
     }
     
-    audioContext = alcCreateContext(audioDevice, NULL);
+    // Mix at the pipeline rate, so OpenAL has no reason to resample the stems either.
+    ALCint contextAttributes[] = { ALC_FREQUENCY, (ALCint)audioFormat.sampleRate, 0 };
+    audioContext = alcCreateContext(audioDevice, contextAttributes);
     if (!alcMakeContextCurrent(audioContext)) {
         std::cout << "Error initializing audio context!" << std::endl;
         return 0;
     }
     alGetError();
+    audioState = new AudioState();
+    if (spatialMix) {
+        // One source for the whole mix; the per-track ones are never created.
+        spatialMixer = new SpatialMixer(audioFormat, transport->getLoopFrames());
+        spatialMixer->setState(false, 0);
+        transport->setListener([](bool playing, uint64_t position) {
+            spatialMixer->setState(playing, position);
+        });
+        mixerOutput = new MixerOutput(*spatialMixer);
+        mixerOutput->start();
+        numAudioSources = 0;
+    }
     alGenSources(numAudioSources, sources);
     if (alGetError() != AL_NO_ERROR) {
         std::cout << "Error generating sources!" << std::endl;
@@ -679,16 +1079,23 @@ int main(int argc, const char * argv[])
     }
     for (int i = 0; i < numAudioSources; i++) {
         alSourcef(sources[i], AL_PITCH, 1);
-        alSourcef(sources[i], AL_GAIN, 1.0f);
         alSource3f(sources[i], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
         alSourcei(sources[i], AL_LOOPING, AL_TRUE);
-        alSourcef(sources[i], AL_REFERENCE_DISTANCE, 25.0f);
-        alSourcef(sources[i], AL_MAX_DISTANCE, 200.0f);
-        alGenBuffers((ALuint)1, &buffers[i]);
-        loadAudioBuffers(&(sample[i]), audioFilenames[i].c_str());
-        alBufferData(buffers[i], AL_FORMAT_MONO16, sample[i].sampleBuffer, sample[i].bufferSizeBytes, sample[i].dataFormat.mSampleRate);
-        alSourcei(sources[i], AL_BUFFER, buffers[i]);
+        alSourcef(sources[i], AL_REFERENCE_DISTANCE, voiceSettings.referenceDistance);
+        alSourcef(sources[i], AL_MAX_DISTANCE, voiceSettings.maxDistance);
+        // Silent until attached, like its voice; goes out with the first flush.
+        audioState->setSourceGain(sources[i], 0.0f);
     }
+    if (streamStems) {
+        streamer = new StemStreamer(numAudioSources, transport->getLoopFrames(), streamBudgetBytes);
+        streamer->start();
+        transport->setListener([](bool playing, uint64_t position) {
+            streamer->setState(playing, position);
+        });
+    } else if (!spatialMixer) {
+        transport->setListener(applyTransportState);
+    }
+    markStartupStage("audio device");
     
     glfwSetErrorCallback(error_callback);
     
@@ -728,23 +1135,93 @@ int main(int argc, const char * argv[])
     
     glfwSwapInterval(2);
     glfwSetKeyCallback(window, key_callback);
-    // insert code here...
-    CompileShaders();
+    markStartupStage("window");
+    try {
+        shaderProgram = new ShaderProgram("simpleVertexShader.txt", "simpleFragmentShader.txt");
+    } catch (std::runtime_error e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
     const int numMesh = 1;
     std::string meshes[numMesh] = {"man.dae"};
+    if (useRenderCache) {
+        try {
+            meshCache = new MeshCache(MeshCache::getDefaultDirectory());
+        } catch (std::runtime_error e) {
+            // Not fatal: meshes are just imported from their sources every time.
+            std::cerr << "Mesh cache disabled: " << e.what() << std::endl;
+        }
+    }
     
 	// load mesh into a vertex buffer array
 	generateObjectBufferMeshes(meshes, numMesh);
     
+    // The figures' instance attributes live in the mesh's VAO alongside its vertex ones.
+    figureModels = new InstanceBuffer(16);
+    figureColours = new InstanceBuffer(3);
+    glBindVertexArray(vaos[0]);
+    figureModels->bindAttribute(shaderProgram->getAttribLocation("instance_model"));
+    figureColours->bindAttribute(shaderProgram->getAttribLocation("instance_diffuse"));
+    
+    // Loading left GL in a state the tracker didn't see, so it starts from knowing nothing.
+    glState = new GLState();
+    glState->invalidate();
+    markStartupStage("scene");
+    
     
     
     
     
     std::cout << "Hello, World!\n";
     while (!glfwWindowShouldClose(window)) {
+        try {
+            attachConvertedTracks();
+        } catch (std::exception& e) {
+            std::cerr << "Error in MIDIProcessor: " << e.what() << std::endl;
+            break;
+        }
+        syncTransport();
         draw(window);
+        glState->endFrame();
+        // New positions go out before updateVoices() starts anything.
+        audioState->flush();
+        updateVoices();
+        audioState->endFrame();
+        if (!drewFirstFrame) {
+            markStartupStage("first frame");
+            std::cout << "First frame drawn after " << secondsSince(launchTime) << "s" << std::endl;
+            drewFirstFrame = true;
+            printStartupTimings();
+        }
     }
     
+    // Don't sit out the rest of a long render just to quit.
+    midiProc->cancelConversion();
+    AudioState::Stats audioStats = audioState->getStats();
+    std::cout << "OpenAL calls from the render thread: " << (double)audioStats.totalCalls / std::max(audioStats.frames, (uint64_t)1)
+              << " per frame on average, " << audioStats.maxCallsPerFrame << " at most"
+              << (audioState->hasDeferredUpdates() ? " (deferred updates)" : "") << std::endl;
+    GLState::Stats glStats = glState->getStats();
+    std::cout << "GL calls from draw(): " << (double)glStats.totalCalls / std::max(glStats.frames, (uint64_t)1)
+              << " per frame on average, " << glStats.maxCallsPerFrame << " at most; " << glStats.stateChanges
+              << " state changes made and " << glStats.redundantCallsSkipped << " redundant ones skipped" << std::endl;
+    VoiceManager::Stats voiceStats = voiceManager->getStats();
+    std::cout << "Voices: " << voiceManager->getNumPhysical() << " of " << voiceManager->getNumVoices() << " physical at exit, "
+              << voiceStats.virtualisations << " virtualised and " << voiceStats.devirtualisations << " brought back" << std::endl;
+    if (meshCache) {
+        MeshCache::Stats meshStats = meshCache->getStats();
+        std::cout << "Mesh cache: " << meshStats.hits << " mapped (" << meshStats.bytesMapped / 1024 << " KB), "
+                  << meshStats.stale << " stale and " << meshStats.misses << " missing; " << meshStats.stores << " stored" << std::endl;
+    }
+    if (streamer) {
+        std::cout << "Stream underruns: " << streamer->getUnderruns() << std::endl;
+        delete streamer;
+    }
+    if (mixerOutput) {
+        std::cout << "Mixer underruns: " << mixerOutput->getUnderruns() << ", late buffers: " << mixerOutput->getLateBuffers() << std::endl;
+        delete mixerOutput;
+        delete spatialMixer;
+    }
     glfwTerminate();
     return 0;
 }